@@ -21,6 +21,7 @@ HEADERS += \
     settingshelper.h \
     fake_integer_sequence.h \
     apply_parse.h \
+    fixed_codec.h \
     data_stream.h \
     zfile.h \
     zstring.h
@@ -0,0 +1,231 @@
+#ifndef HELPZ_QT_FIXED_CODEC_H
+#define HELPZ_QT_FIXED_CODEC_H
+
+#include <array>
+#include <tuple>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+
+#include <QBuffer>
+#include <QtEndian>
+
+namespace Helpz {
+
+/**
+ * @brief The Fixed_Codec struct
+ *
+ * Compile time layout of fixed size types, wire compatible with big endian QDataStream::Qt_5_6:
+ * bool is 1 byte, integers and enums are big endian, float and double are 8 bytes double.
+ * std::array is written as its elements without size.
+ * Struct gets layout by specialization:
+ * template<> struct Fixed_Codec<My_Struct> : Fixed_Struct_Codec<My_Struct, &My_Struct::a, &My_Struct::b> {};
+ * Its QDataStream operators must write same fields in same order.
+ */
+template<typename T, typename = void>
+struct Fixed_Codec {};
+
+template<typename T>
+struct Fixed_Codec<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value>>
+{
+    static constexpr std::size_t size = sizeof(T);
+    static void write(uchar* data, T value) { qToBigEndian<T>(value, data); }
+    static T read(const uchar* data) { return qFromBigEndian<T>(data); }
+};
+
+template<>
+struct Fixed_Codec<bool>
+{
+    static constexpr std::size_t size = 1;
+    static void write(uchar* data, bool value) { *data = value ? 1 : 0; }
+    static bool read(const uchar* data) { return *data != 0; }
+};
+
+template<typename T>
+struct Fixed_Codec<T, std::enable_if_t<std::is_enum<T>::value>>
+{
+    typedef Fixed_Codec<std::underlying_type_t<T>> Underlying;
+    static constexpr std::size_t size = Underlying::size;
+    static void write(uchar* data, T value) { Underlying::write(data, static_cast<std::underlying_type_t<T>>(value)); }
+    static T read(const uchar* data) { return static_cast<T>(Underlying::read(data)); }
+};
+
+template<typename T>
+struct Fixed_Codec<T, std::enable_if_t<std::is_floating_point<T>::value>>
+{
+    // QDataStream::DoublePrecision is default since Qt 4.6
+    static constexpr std::size_t size = sizeof(double);
+    static void write(uchar* data, T value)
+    {
+        const double d = value;
+        quint64 bits;
+        memcpy(&bits, &d, sizeof(bits));
+        qToBigEndian<quint64>(bits, data);
+    }
+    static T read(const uchar* data)
+    {
+        const quint64 bits = qFromBigEndian<quint64>(data);
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return static_cast<T>(d);
+    }
+};
+
+template<typename T, std::size_t N>
+struct Fixed_Codec<std::array<T, N>, std::void_t<decltype(Fixed_Codec<T>::size)>>
+{
+    static constexpr std::size_t size = Fixed_Codec<T>::size * N;
+    static void write(uchar* data, const std::array<T, N>& value)
+    {
+        for (const T& item: value)
+        {
+            Fixed_Codec<T>::write(data, item);
+            data += Fixed_Codec<T>::size;
+        }
+    }
+    static std::array<T, N> read(const uchar* data)
+    {
+        std::array<T, N> value;
+        for (T& item: value)
+        {
+            item = Fixed_Codec<T>::read(data);
+            data += Fixed_Codec<T>::size;
+        }
+        return value;
+    }
+};
+
+template<typename S, typename M>
+M fixed_member_type(M S::*);
+
+template<typename S, auto... Members>
+struct Fixed_Struct_Codec
+{
+    static_assert(std::is_trivially_copyable<S>::value, "Fixed struct must be trivially copyable");
+
+    static constexpr std::size_t size = (Fixed_Codec<decltype(fixed_member_type(Members))>::size + ... + 0);
+
+    static void write(uchar* data, const S& value)
+    {
+        ((Fixed_Codec<decltype(fixed_member_type(Members))>::write(data, value.*Members),
+          data += Fixed_Codec<decltype(fixed_member_type(Members))>::size), ...);
+    }
+    static S read(const uchar* data)
+    {
+        S value;
+        ((value.*Members = Fixed_Codec<decltype(fixed_member_type(Members))>::read(data),
+          data += Fixed_Codec<decltype(fixed_member_type(Members))>::size), ...);
+        return value;
+    }
+};
+
+template<typename T, typename = void>
+struct Is_Fixed : std::false_type {};
+
+template<typename T>
+struct Is_Fixed<T, std::void_t<decltype(Fixed_Codec<T>::size)>> : std::true_type {};
+
+template<typename... Args>
+constexpr std::size_t fixed_size_v = (Fixed_Codec<std::decay_t<Args>>::size + ... + 0);
+
+template<typename... Args>
+void fixed_write(uchar* data, const Args&... args)
+{
+    ((Fixed_Codec<std::decay_t<Args>>::write(data, args), data += Fixed_Codec<std::decay_t<Args>>::size), ...);
+}
+
+template<typename... Args>
+QByteArray fixed_serialize(const Args&... args)
+{
+    QByteArray data(static_cast<int>(fixed_size_v<Args...>), Qt::Uninitialized);
+    fixed_write(reinterpret_cast<uchar*>(data.data()), args...);
+    return data;
+}
+
+/**
+ * @brief fixed_parse_out
+ * Decode arguments straight from bytes, data must contain at least fixed_size_v<Args...> bytes.
+ */
+template<typename... Args>
+void fixed_parse_out(const char* data, std::size_t size, Args&... args)
+{
+    static_assert((Is_Fixed<Args>::value && ...), "All types must have Fixed_Codec");
+
+    if (size < fixed_size_v<Args...>)
+        throw std::runtime_error("Fixed parse failed: need " + std::to_string(fixed_size_v<Args...>) + " bytes, have " + std::to_string(size));
+
+    const uchar* pos = reinterpret_cast<const uchar*>(data);
+    ((args = Fixed_Codec<Args>::read(pos), pos += Fixed_Codec<Args>::size), ...);
+}
+
+/**
+ * @brief fixed_read_device
+ * Call func with Size bytes from current position of data_dev.
+ * Data of QBuffer is used in place, other devices are read with one call.
+ */
+template<std::size_t Size, typename Func>
+auto fixed_read_device(QIODevice& data_dev, Func func)
+{
+    if (!data_dev.isOpen() && !data_dev.open(QIODevice::ReadOnly))
+        throw std::runtime_error(("Can't open msg device:" + data_dev.errorString()).toStdString());
+
+    const qint64 pos = data_dev.pos();
+    if (data_dev.size() - pos < static_cast<qint64>(Size))
+        throw std::runtime_error("Fixed parse failed: need " + std::to_string(Size) + " bytes, have " + std::to_string(data_dev.size() - pos));
+
+    if (QBuffer* buffer = qobject_cast<QBuffer*>(&data_dev))
+    {
+        const char* data = static_cast<const QBuffer*>(buffer)->buffer().constData() + pos;
+        buffer->seek(pos + static_cast<qint64>(Size));
+        return func(data, Size);
+    }
+
+    char data[Size ? Size : 1];
+    if (data_dev.read(data, Size) != static_cast<qint64>(Size))
+        throw std::runtime_error(("Fixed parse read failed:" + data_dev.errorString()).toStdString());
+    return func(static_cast<const char*>(data), Size);
+}
+
+template<typename... Args>
+void fixed_parse_out(QIODevice& data_dev, Args&... args)
+{
+    fixed_read_device<fixed_size_v<Args...>>(data_dev, [&](const char* data, std::size_t size)
+    {
+        fixed_parse_out(data, size, args...);
+    });
+}
+
+template <typename RetType, typename _Tuple, typename _Fn, class T, std::size_t... _Idx, typename... Args>
+RetType __apply_parse_fixed_impl(QIODevice& data_dev, _Fn __f, T* obj, std::index_sequence<_Idx...>, Args&&... args)
+{
+    _Tuple tuple;
+    fixed_parse_out(data_dev, std::get<_Idx>(tuple)...);
+    return std::invoke(__f, obj, std::get<_Idx>(std::move(tuple))..., std::forward<Args&&>(args)...);
+}
+
+/**
+ * @brief apply_parse_fixed
+ * Same as apply_parse for handlers with fixed size arguments, but without QDataStream.
+ */
+template<class FT, class T, typename RetType, typename... FArgs, typename... Args>
+RetType apply_parse_fixed(QIODevice& data_dev, RetType(FT::*__f)(FArgs...), T* obj, Args&&... args)
+{
+    using Tuple = std::tuple<typename std::decay<FArgs>::type...>;
+    using Indices = std::make_index_sequence<sizeof...(FArgs) - sizeof...(Args)>;
+    return __apply_parse_fixed_impl<RetType, Tuple>(data_dev, __f, obj, Indices{}, std::forward<Args&&>(args)...);
+}
+
+template<class FT, class T, typename RetType, typename... FArgs, typename... Args>
+RetType apply_parse_fixed(QIODevice& data_dev, RetType(FT::*__f)(FArgs...) const, T* obj, Args&&... args)
+{
+    using Tuple = std::tuple<typename std::decay<FArgs>::type...>;
+    using Indices = std::make_index_sequence<sizeof...(FArgs) - sizeof...(Args)>;
+    return __apply_parse_fixed_impl<RetType, Tuple>(data_dev, __f, obj, Indices{}, std::forward<Args&&>(args)...);
+}
+
+} // namespace Helpz
+
+#endif // HELPZ_QT_FIXED_CODEC_H
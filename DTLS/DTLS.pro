@@ -18,9 +18,14 @@ SOURCES += \
     dtls_client_thread.cpp \
     dtls_controller.cpp \
     dtls_socket.cpp \
+    dtls_buffer_pool.cpp \
     dtls_server_thread.cpp \
     dtls_server.cpp \
+    dtls_server_shard.cpp \
     dtls_server_controller.cpp \
+    dtls_client_registry.cpp \
+    dtls_record_pool.cpp \
+    dtls_cookie_filter.cpp \
     dtls_server_node.cpp \
     dtls_node.cpp \
     dtls_client_node.cpp
@@ -35,9 +40,14 @@ HEADERS += \
     dtls_client_thread.h \
     dtls_controller.h \
     dtls_socket.h \
+    dtls_buffer_pool.h \
     dtls_server_thread.h \
     dtls_server.h \
+    dtls_server_shard.h \
     dtls_server_controller.h \
+    dtls_client_registry.h \
+    dtls_record_pool.h \
+    dtls_cookie_filter.h \
     dtls_server_node.h \
     dtls_node.h \
     dtls_client_node.h
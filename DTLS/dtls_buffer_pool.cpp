@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include "dtls_buffer_pool.h"
+
+namespace Helpz {
+namespace DTLS {
+
+void Buffer_Pool::Deleter::operator()(uint8_t *data) const
+{
+    if (pool_)
+        pool_->give(data, capacity_);
+    else
+        delete[] data;
+}
+
+Buffer_Pool::Buffer_Pool(std::size_t small_size, std::size_t max_cached, std::size_t record_size, std::size_t max_cached_records) :
+    small_size_(small_size), max_cached_(max_cached),
+    record_size_(std::max(record_size, small_size + 1)), max_cached_records_(max_cached_records)
+{
+}
+
+Buffer_Pool::~Buffer_Pool()
+{
+    for (uint8_t* data: record_)
+        delete[] data;
+    for (uint8_t* data: large_)
+        delete[] data;
+}
+
+std::size_t Buffer_Pool::small_size() const { return small_size_; }
+
+Buffer_Pool::Buffer Buffer_Pool::take(std::size_t size)
+{
+    if (size <= small_size_)
+    {
+        std::lock_guard lock(mutex_);
+        if (small_.empty())
+        {
+            uint8_t* slab = new uint8_t[small_size_ * HELPZ_SOCKET_SLAB_SIZE];
+            slabs_.emplace_back(slab);
+            for (std::size_t i = HELPZ_SOCKET_SLAB_SIZE; i > 0; --i)
+                small_.push_back(slab + (i - 1) * small_size_);
+        }
+
+        uint8_t* data = small_.back();
+        small_.pop_back();
+        return Buffer{data, Deleter{shared_from_this(), small_size_}};
+    }
+
+    // Decrypted records of fragmented transfers are mostly here
+    if (size <= record_size_)
+        return take_cached(record_, record_size_);
+
+    if (size <= HELPZ_MAX_UDP_PACKET_SIZE)
+        return take_cached(large_, HELPZ_MAX_UDP_PACKET_SIZE);
+
+    return Buffer{new uint8_t[size], Deleter{nullptr, size}};
+}
+
+std::size_t Buffer_Pool::slab_count() const
+{
+    std::lock_guard lock(mutex_);
+    return slabs_.size();
+}
+
+std::size_t Buffer_Pool::cached_small() const
+{
+    std::lock_guard lock(mutex_);
+    return small_.size();
+}
+
+std::size_t Buffer_Pool::cached_record() const
+{
+    std::lock_guard lock(mutex_);
+    return record_.size();
+}
+
+std::size_t Buffer_Pool::cached_large() const
+{
+    std::lock_guard lock(mutex_);
+    return large_.size();
+}
+
+void Buffer_Pool::give(uint8_t *data, std::size_t capacity)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (capacity == small_size_)
+        {
+            small_.push_back(data);
+            return;
+        }
+
+        if (capacity == record_size_)
+        {
+            if (record_.size() < max_cached_records_)
+            {
+                record_.push_back(data);
+                return;
+            }
+        }
+        else if (large_.size() < max_cached_)
+        {
+            large_.push_back(data);
+            return;
+        }
+    }
+
+    delete[] data;
+}
+
+Buffer_Pool::Buffer Buffer_Pool::take_cached(std::vector<uint8_t*> &cache, std::size_t capacity)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (!cache.empty())
+        {
+            uint8_t* data = cache.back();
+            cache.pop_back();
+            return Buffer{data, Deleter{shared_from_this(), capacity}};
+        }
+    }
+    return Buffer{new uint8_t[capacity], Deleter{shared_from_this(), capacity}};
+}
+
+} // namespace DTLS
+} // namespace Helpz
@@ -0,0 +1,71 @@
+#ifndef HELPZ_DTLS_BUFFER_POOL_H
+#define HELPZ_DTLS_BUFFER_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <Helpz/net_defs.h>
+
+namespace Helpz {
+namespace DTLS {
+
+/**
+ * @brief The Buffer_Pool class
+ *
+ * Datagram buffers of three sizes. Small ones fit MTU sized datagram, they are cut from slabs
+ * of HELPZ_SOCKET_SLAB_SIZE buffers and are never freed before the pool.
+ * Record ones fit decrypted DTLS record, up to max_cached_records of them are kept.
+ * Large ones fit any UDP datagram, up to max_cached of them are kept for receive.
+ * Bigger buffers are allocated as is. Buffer returns to the pool when it's destroyed,
+ * so it may be given to other thread, pool lives while any its buffer lives.
+ */
+class Buffer_Pool : public std::enable_shared_from_this<Buffer_Pool>
+{
+public:
+    struct Deleter
+    {
+        std::shared_ptr<Buffer_Pool> pool_;
+        std::size_t capacity_;
+
+        void operator()(uint8_t* data) const;
+    };
+    typedef std::unique_ptr<uint8_t[], Deleter> Buffer;
+
+    explicit Buffer_Pool(std::size_t small_size = HELPZ_SOCKET_BUFFER_SIZE, std::size_t max_cached = HELPZ_SOCKET_LARGE_POOL_SIZE,
+                         std::size_t record_size = HELPZ_SOCKET_RECORD_BUFFER_SIZE,
+                         std::size_t max_cached_records = HELPZ_SOCKET_RECORD_POOL_SIZE);
+    Buffer_Pool(const Buffer_Pool&) = delete;
+    Buffer_Pool& operator =(const Buffer_Pool&) = delete;
+    ~Buffer_Pool();
+
+    std::size_t small_size() const;
+
+    /**
+     * @brief take
+     * Buffer which has at least size bytes, its capacity is in deleter.
+     */
+    Buffer take(std::size_t size);
+
+    std::size_t slab_count() const;
+    std::size_t cached_small() const;
+    std::size_t cached_record() const;
+    std::size_t cached_large() const;
+
+private:
+    void give(uint8_t* data, std::size_t capacity);
+
+    Buffer take_cached(std::vector<uint8_t*>& cache, std::size_t capacity);
+
+    const std::size_t small_size_, max_cached_, record_size_, max_cached_records_;
+    std::vector<std::unique_ptr<uint8_t[]>> slabs_;
+    std::vector<uint8_t*> small_;
+    std::vector<uint8_t*> record_;
+    std::vector<uint8_t*> large_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace DTLS
+} // namespace Helpz
+
+#endif // HELPZ_DTLS_BUFFER_POOL_H
@@ -21,7 +21,7 @@ public:
     std::shared_ptr<Net::Protocol> create_protocol(const std::string& app_proto);
 
     std::shared_ptr<Node> get_node(const udp::endpoint& remote_endpoint = udp::endpoint()) override;
-    void process_data(std::shared_ptr<Node> &node, std::unique_ptr<uint8_t[]> &&data, std::size_t size) override;
+    void process_data(std::shared_ptr<Node> &node, const uint8_t* data, std::size_t size) override;
 private:
     void on_protocol_timeout(boost::asio::ip::udp::endpoint remote_endpoint, void* data) override;
 
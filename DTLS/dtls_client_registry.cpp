@@ -0,0 +1,145 @@
+#include <mutex>
+
+#include "dtls_client_registry.h"
+
+namespace Helpz {
+namespace DTLS {
+
+Client_Registry::Client_Registry(std::size_t shard_count)
+{
+    if (shard_count == 0)
+        shard_count = 1;
+
+    shards_.reserve(shard_count);
+    for (std::size_t i = 0; i < shard_count; ++i)
+        shards_.emplace_back(new Shard);
+}
+
+std::shared_ptr<Server_Node> Client_Registry::find(const udp::endpoint &remote_endpoint) const
+{
+    const Shard& item_shard = shard(remote_endpoint);
+    boost::shared_lock lock(item_shard.mutex_);
+    auto it = item_shard.clients_.find(remote_endpoint);
+    if (it != item_shard.clients_.cend())
+        return it->second;
+    return {};
+}
+
+std::shared_ptr<Server_Node> Client_Registry::find_if(const Check_Func_T &check_func) const
+{
+    for (const std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        boost::shared_lock lock(item_shard->mutex_);
+        for (const std::pair<const udp::endpoint, std::shared_ptr<Server_Node>>& it: item_shard->clients_)
+        {
+            if (check_func(it.second))
+                return it.second;
+        }
+    }
+    return {};
+}
+
+std::shared_ptr<Server_Node> Client_Registry::find_or_create(const udp::endpoint &remote_endpoint,
+                                                             const std::function<std::shared_ptr<Server_Node>()> &create_func)
+{
+    Shard& item_shard = shard(remote_endpoint);
+    std::lock_guard lock(item_shard.mutex_);
+    auto it = item_shard.clients_.find(remote_endpoint);
+    if (it != item_shard.clients_.cend())
+        return it->second;
+
+    std::shared_ptr<Server_Node> node = create_func();
+    if (node)
+        item_shard.clients_.emplace(remote_endpoint, node);
+    return node;
+}
+
+void Client_Registry::remove(const udp::endpoint &remote_endpoint)
+{
+    Shard& item_shard = shard(remote_endpoint);
+    std::lock_guard lock(item_shard.mutex_);
+    item_shard.clients_.erase(remote_endpoint);
+}
+
+std::vector<std::shared_ptr<Server_Node>> Client_Registry::remove_if(const Check_Func_T &check_func)
+{
+    std::vector<std::shared_ptr<Server_Node>> removed;
+    for (std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        bool is_found = false;
+        {
+            boost::shared_lock lock(item_shard->mutex_);
+            for (const std::pair<const udp::endpoint, std::shared_ptr<Server_Node>>& it: item_shard->clients_)
+            {
+                if (check_func(it.second))
+                {
+                    is_found = true;
+                    break;
+                }
+            }
+        }
+
+        if (!is_found)
+            continue;
+
+        std::lock_guard lock(item_shard->mutex_);
+        for (auto it = item_shard->clients_.begin(); it != item_shard->clients_.end();)
+        {
+            if (check_func(it->second))
+            {
+                removed.push_back(std::move(it->second));
+                it = item_shard->clients_.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    return removed;
+}
+
+std::vector<std::shared_ptr<Server_Node>> Client_Registry::clients() const
+{
+    std::vector<std::shared_ptr<Server_Node>> nodes;
+    for (const std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        boost::shared_lock lock(item_shard->mutex_);
+        for (const std::pair<const udp::endpoint, std::shared_ptr<Server_Node>>& it: item_shard->clients_)
+            nodes.push_back(it.second);
+    }
+    return nodes;
+}
+
+std::size_t Client_Registry::size() const
+{
+    std::size_t count = 0;
+    for (const std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        boost::shared_lock lock(item_shard->mutex_);
+        count += item_shard->clients_.size();
+    }
+    return count;
+}
+
+std::size_t Client_Registry::shard_count() const
+{
+    return shards_.size();
+}
+
+std::size_t Client_Registry::shard_index(const udp::endpoint &remote_endpoint) const
+{
+    // Hash mixes address and port, so clients with fixed local port are spread too
+    return Net::Timing_Wheel::endpoint_hash(remote_endpoint) % shards_.size();
+}
+
+const Client_Registry::Shard &Client_Registry::shard(const udp::endpoint &remote_endpoint) const
+{
+    return *shards_[shard_index(remote_endpoint)];
+}
+
+Client_Registry::Shard &Client_Registry::shard(const udp::endpoint &remote_endpoint)
+{
+    return *shards_[shard_index(remote_endpoint)];
+}
+
+} // namespace DTLS
+} // namespace Helpz
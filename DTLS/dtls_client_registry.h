@@ -0,0 +1,74 @@
+#ifndef HELPZ_DTLS_CLIENT_REGISTRY_H
+#define HELPZ_DTLS_CLIENT_REGISTRY_H
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/asio/ip/udp.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <Helpz/net_timing_wheel.h>
+
+namespace Helpz {
+namespace DTLS {
+
+class Server_Node;
+
+/**
+ * @brief The Client_Registry class
+ *
+ * Clients of server in hash maps sharded by endpoint, each shard has own shared mutex,
+ * so lookups of different clients rarely take same mutex and lookups of one client take only read lock.
+ * Functions which visit all clients lock shards one by one.
+ */
+class Client_Registry
+{
+public:
+    using udp = boost::asio::ip::udp;
+    typedef std::function<bool(const std::shared_ptr<Server_Node>&)> Check_Func_T;
+
+    explicit Client_Registry(std::size_t shard_count = HELPZ_SERVER_CLIENT_SHARD_COUNT);
+
+    std::shared_ptr<Server_Node> find(const udp::endpoint& remote_endpoint) const;
+    std::shared_ptr<Server_Node> find_if(const Check_Func_T& check_func) const;
+
+    /**
+     * @brief find_or_create
+     * create_func is called under write lock of shard only if client isn't found.
+     */
+    std::shared_ptr<Server_Node> find_or_create(const udp::endpoint& remote_endpoint,
+                                                const std::function<std::shared_ptr<Server_Node>()>& create_func);
+
+    void remove(const udp::endpoint& remote_endpoint);
+
+    /**
+     * @brief remove_if
+     * Shard is checked under read lock, write lock is taken only if something is found there.
+     * @return removed clients, caller closes them without shard lock.
+     */
+    std::vector<std::shared_ptr<Server_Node>> remove_if(const Check_Func_T& check_func);
+
+    std::vector<std::shared_ptr<Server_Node>> clients() const;
+    std::size_t size() const;
+
+    std::size_t shard_count() const;
+    std::size_t shard_index(const udp::endpoint& remote_endpoint) const;
+private:
+    struct Shard
+    {
+        mutable boost::shared_mutex mutex_;
+        std::unordered_map<udp::endpoint, std::shared_ptr<Server_Node>, Net::Timing_Wheel::Endpoint_Hash> clients_;
+    };
+
+    const Shard& shard(const udp::endpoint& remote_endpoint) const;
+    Shard& shard(const udp::endpoint& remote_endpoint);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace DTLS
+} // namespace Helpz
+
+#endif // HELPZ_DTLS_CLIENT_REGISTRY_H
@@ -8,9 +8,9 @@ namespace DTLS {
 
 Q_LOGGING_CATEGORY(Log, "DTLS")
 
-Controller::Controller(Tools* dtls_tools) :
+Controller::Controller(Tools* dtls_tools, boost::asio::io_context *io_context) :
     dtls_tools_(dtls_tools),
-    protocol_timer_(this)
+    protocol_timer_(io_context ? new Net::Protocol_Timer{this, io_context} : new Net::Protocol_Timer{this})
 {
 }
 
@@ -22,10 +22,20 @@ Tools *Controller::dtls_tools()
 void Controller::add_timeout_at(const boost::asio::ip::udp::endpoint &remote_endpoint,
                                 std::chrono::system_clock::time_point time_point, void *data)
 {
-    protocol_timer_.add(time_point, remote_endpoint, data);
+    protocol_timer_->add(time_point, remote_endpoint, data);
+}
+
+void Controller::cancel_timeouts(const boost::asio::ip::udp::endpoint &remote_endpoint)
+{
+    protocol_timer_->cancel_all(remote_endpoint);
 }
 
 
 
+std::shared_ptr<Node> Controller::admit_node(const udp::endpoint &remote_endpoint, const uint8_t * /*data*/, std::size_t /*size*/)
+{
+    return get_node(remote_endpoint);
+}
+
 } // namespace DTLS
 } // namespace Helpz
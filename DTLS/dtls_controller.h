@@ -21,20 +21,30 @@ class Controller : public Net::Protocol_Timer_Emiter
 public:
     using udp = boost::asio::ip::udp;
 
-    Controller(Tools* dtls_tools);
+    /**
+     * Timeouts are advanced on io_context if it's set, otherwise on own thread of timer.
+     */
+    Controller(Tools* dtls_tools, boost::asio::io_context* io_context = nullptr);
     virtual ~Controller() = default;
 
     Tools* dtls_tools();
 
     void add_timeout_at(const udp::endpoint& remote_endpoint, std::chrono::system_clock::time_point time_point, void* data);
+    void cancel_timeouts(const udp::endpoint& remote_endpoint);
 
     virtual std::shared_ptr<Node> get_node(const udp::endpoint& remote_endpoint) = 0;
-    virtual void process_data(std::shared_ptr<Node>& node, std::unique_ptr<uint8_t[]>&& data, std::size_t size) = 0;
+
+    /**
+     * @brief admit_node
+     * Node for received datagram. Server creates node for unknown endpoint only after datagram passes its filter.
+     */
+    virtual std::shared_ptr<Node> admit_node(const udp::endpoint& remote_endpoint, const uint8_t* data, std::size_t size);
+    virtual void process_data(std::shared_ptr<Node>& node, const uint8_t* data, std::size_t size) = 0;
 protected:
 
     Tools* dtls_tools_;
 
-    Net::Protocol_Timer protocol_timer_;
+    std::unique_ptr<Net::Protocol_Timer> protocol_timer_;
 };
 
 } // namespace DTLS
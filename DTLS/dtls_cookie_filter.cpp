@@ -0,0 +1,243 @@
+#include <sstream>
+#include <algorithm>
+
+#include <botan-2/botan/auto_rng.h>
+#include <botan-2/botan/tls_messages.h>
+
+#include "dtls_cookie_filter.h"
+
+namespace Helpz {
+namespace DTLS {
+
+namespace {
+
+enum : uint8_t
+{
+    RECORD_HANDSHAKE = 22,
+    CLIENT_HELLO = 1,
+    HELLO_VERIFY_REQUEST = 3
+};
+
+enum : std::size_t
+{
+    RECORD_HEADER_SIZE = 13,
+    HANDSHAKE_HEADER_SIZE = 12,
+    // client_version and random
+    CLIENT_HELLO_SESSION_ID_POS = 34
+};
+
+uint32_t get_u24(const uint8_t* data) { return (uint32_t(data[0]) << 16) | (uint32_t(data[1]) << 8) | data[2]; }
+void put_u24(uint8_t* data, uint32_t value) { data[0] = value >> 16; data[1] = value >> 8; data[2] = value; }
+
+uint64_t get_u48(const uint8_t* data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 6; ++i)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+void put_u48(uint8_t* data, uint64_t value)
+{
+    for (int i = 5; i >= 0; --i, value >>= 8)
+        data[i] = value & 0xFF;
+}
+
+/**
+ * @brief make_datagram
+ * One handshake record in epoch 0 with one unfragmented message.
+ */
+std::vector<uint8_t> make_datagram(const uint8_t* version, uint64_t record_seq, uint8_t type, uint16_t message_seq,
+                                   const std::vector<uint8_t>& body)
+{
+    const std::size_t record_size = HANDSHAKE_HEADER_SIZE + body.size();
+    std::vector<uint8_t> datagram(RECORD_HEADER_SIZE + record_size);
+    uint8_t* data = datagram.data();
+
+    data[0] = RECORD_HANDSHAKE;
+    data[1] = version[0];
+    data[2] = version[1];
+    data[3] = data[4] = 0;
+    put_u48(data + 5, record_seq);
+    data[11] = record_size >> 8;
+    data[12] = record_size & 0xFF;
+
+    data += RECORD_HEADER_SIZE;
+    data[0] = type;
+    put_u24(data + 1, body.size());
+    data[4] = message_seq >> 8;
+    data[5] = message_seq & 0xFF;
+    put_u24(data + 6, 0);
+    put_u24(data + 9, body.size());
+
+    std::copy(body.cbegin(), body.cend(), data + HANDSHAKE_HEADER_SIZE);
+    return datagram;
+}
+
+} // namespace
+
+Cookie_Filter::Cookie_Filter(std::chrono::seconds rotate_interval, double new_client_rate, double new_client_burst) :
+    rotate_interval_(rotate_interval), new_client_rate_(new_client_rate), new_client_burst_(new_client_burst),
+    rng_(new Botan::AutoSeeded_RNG),
+    secret_(*rng_, 32), previous_secret_(*rng_, 32),
+    rotated_at_(Clock::now()),
+    rate_slots_(new Rate_Slot[HELPZ_SERVER_RATE_SLOT_COUNT])
+{
+    const Clock::time_point now = Clock::now();
+    for (std::size_t i = 0; i < HELPZ_SERVER_RATE_SLOT_COUNT; ++i)
+    {
+        rate_slots_[i].tokens_ = new_client_burst_;
+        rate_slots_[i].updated_at_ = now;
+    }
+}
+
+Botan::SymmetricKey Cookie_Filter::secret()
+{
+    rotate_if_needed();
+    boost::shared_lock lock(secret_mutex_);
+    return secret_;
+}
+
+/*static*/ std::string Cookie_Filter::identity(const udp::endpoint &remote_endpoint)
+{
+    // Same as Node::address
+    std::stringstream identity_s; identity_s << remote_endpoint;
+    return identity_s.str();
+}
+
+Cookie_Filter::Result Cookie_Filter::check(const udp::endpoint &remote_endpoint, const uint8_t *data, std::size_t size, std::vector<uint8_t> &out)
+{
+    out.clear();
+
+    // Only first ClientHello of handshake in epoch 0 and in one fragment can come from unknown endpoint
+    if (size < RECORD_HEADER_SIZE + HANDSHAKE_HEADER_SIZE || data[0] != RECORD_HANDSHAKE || data[3] || data[4])
+        return DROP;
+
+    const std::size_t record_size = (std::size_t(data[11]) << 8) | data[12];
+    if (record_size < HANDSHAKE_HEADER_SIZE || RECORD_HEADER_SIZE + record_size > size)
+        return DROP;
+
+    const uint8_t* handshake = data + RECORD_HEADER_SIZE;
+    const uint32_t body_size = get_u24(handshake + 1);
+    const uint16_t message_seq = (uint16_t(handshake[4]) << 8) | handshake[5];
+    if (handshake[0] != CLIENT_HELLO || get_u24(handshake + 6) != 0 || get_u24(handshake + 9) != body_size
+        || HANDSHAKE_HEADER_SIZE + body_size > record_size)
+        return DROP;
+
+    const std::vector<uint8_t> body(handshake + HANDSHAKE_HEADER_SIZE, handshake + HANDSHAKE_HEADER_SIZE + body_size);
+    if (body.size() <= CLIENT_HELLO_SESSION_ID_POS)
+        return DROP;
+
+    const std::size_t cookie_size_pos = CLIENT_HELLO_SESSION_ID_POS + 1 + body[CLIENT_HELLO_SESSION_ID_POS];
+    if (cookie_size_pos >= body.size() || cookie_size_pos + 1 + body[cookie_size_pos] > body.size())
+        return DROP;
+
+    try
+    {
+        const Botan::TLS::Client_Hello hello{body};
+        const std::string peer_identity = identity(remote_endpoint);
+
+        if (!hello.cookie().empty() && is_valid_cookie(hello.cookie_input_data(), peer_identity, hello.cookie()))
+        {
+            if (message_seq == 0)
+                return ACCEPT;
+
+            /* Botan expects handshake from message sequence zero, it gets ClientHello which was answered by us.
+             * Client repeats it with cookie added, so it's rebuilt by removing cookie.
+             * Only one round of verify is supported.
+             */
+            const uint64_t record_seq = get_u48(data + 5);
+            if (message_seq != 1 || record_seq == 0)
+                return DROP;
+
+            std::vector<uint8_t> first_body(body.cbegin(), body.cbegin() + cookie_size_pos);
+            first_body.push_back(0);
+            first_body.insert(first_body.end(), body.cbegin() + cookie_size_pos + 1 + body[cookie_size_pos], body.cend());
+
+            out = make_datagram(data + 1, record_seq - 1, CLIENT_HELLO, 0, first_body);
+            return ACCEPT;
+        }
+
+        /* Only answer costs a token. Spoofed sources can't get a valid cookie,
+         * so they can't lock clients with cookie out of admission.
+         */
+        if (!check_rate(remote_endpoint))
+            return DROP;
+
+        // Record sequence number is copied from ClientHello, so server keeps nothing (RFC 6347 4.2.1)
+        const Botan::TLS::Hello_Verify_Request verify{hello.cookie_input_data(), peer_identity, secret()};
+        out = make_datagram(data + 1, get_u48(data + 5), HELLO_VERIFY_REQUEST, message_seq, verify.serialize());
+        return VERIFY;
+    }
+    catch (...) {}
+
+    return DROP;
+}
+
+bool Cookie_Filter::check_rate(const udp::endpoint &remote_endpoint)
+{
+    uint64_t prefix;
+    const boost::asio::ip::address address = remote_endpoint.address();
+    if (address.is_v4())
+        prefix = address.to_v4().to_uint() >> 8;
+    else
+    {
+        prefix = 0;
+        const boost::asio::ip::address_v6::bytes_type bytes = address.to_v6().to_bytes();
+        for (std::size_t i = 0; i < 8; ++i)
+            prefix = (prefix << 8) | bytes[i];
+        prefix ^= 0x9E3779B97F4A7C15ull;
+    }
+
+    // Spread close prefixes over slots
+    prefix *= 0x9E3779B97F4A7C15ull;
+    Rate_Slot& slot = rate_slots_[(prefix >> 32) % HELPZ_SERVER_RATE_SLOT_COUNT];
+
+    const Clock::time_point now = Clock::now();
+    std::lock_guard lock(slot.mutex_);
+    const double elapsed = std::chrono::duration<double>(now - slot.updated_at_).count();
+    slot.tokens_ = std::min(new_client_burst_, slot.tokens_ + elapsed * new_client_rate_);
+    slot.updated_at_ = now;
+
+    if (slot.tokens_ < 1.)
+        return false;
+    slot.tokens_ -= 1.;
+    return true;
+}
+
+bool Cookie_Filter::is_valid_cookie(const std::vector<uint8_t> &cookie_input, const std::string &identity, const std::vector<uint8_t> &cookie)
+{
+    rotate_if_needed();
+
+    Botan::SymmetricKey secret, previous_secret;
+    {
+        boost::shared_lock lock(secret_mutex_);
+        secret = secret_;
+        previous_secret = previous_secret_;
+    }
+
+    // Botan rejects cookie of previous secret and sends new HelloVerifyRequest itself
+    return Botan::TLS::Hello_Verify_Request{cookie_input, identity, secret}.cookie() == cookie
+        || Botan::TLS::Hello_Verify_Request{cookie_input, identity, previous_secret}.cookie() == cookie;
+}
+
+void Cookie_Filter::rotate_if_needed()
+{
+    {
+        boost::shared_lock lock(secret_mutex_);
+        if (Clock::now() - rotated_at_ < rotate_interval_)
+            return;
+    }
+
+    std::lock_guard lock(secret_mutex_);
+    const Clock::time_point now = Clock::now();
+    if (now - rotated_at_ < rotate_interval_)
+        return;
+
+    previous_secret_ = secret_;
+    secret_ = Botan::SymmetricKey(*rng_, 32);
+    rotated_at_ = now;
+}
+
+} // namespace DTLS
+} // namespace Helpz
@@ -0,0 +1,91 @@
+#ifndef HELPZ_DTLS_COOKIE_FILTER_H
+#define HELPZ_DTLS_COOKIE_FILTER_H
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <boost/asio/ip/udp.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <botan-2/botan/rng.h>
+#include <botan-2/botan/symkey.h>
+
+#include <Helpz/net_defs.h>
+
+namespace Helpz {
+namespace DTLS {
+
+/**
+ * @brief The Cookie_Filter class
+ *
+ * Admission of new clients without any state per client. Datagram from unknown endpoint must be ClientHello.
+ * ClientHello without valid cookie gets HelloVerifyRequest built here, these answers are limited
+ * by rate of source prefix (/24 for IPv4, /64 for IPv6). ClientHello with valid cookie costs nothing.
+ * Cookie is the same one Botan server makes: HMAC over ClientHello and peer identity (endpoint)
+ * with dtls-cookie-secret, so Botan accepts it when client is created. Secret is rotated,
+ * cookie of previous secret is still accepted.
+ */
+class Cookie_Filter
+{
+public:
+    using udp = boost::asio::ip::udp;
+
+    enum Result
+    {
+        DROP,
+        VERIFY,
+        ACCEPT
+    };
+
+    Cookie_Filter(std::chrono::seconds rotate_interval = std::chrono::seconds(HELPZ_SERVER_COOKIE_ROTATE_SEC),
+                  double new_client_rate = HELPZ_SERVER_NEW_CLIENT_RATE, double new_client_burst = HELPZ_SERVER_NEW_CLIENT_BURST);
+
+    /**
+     * @brief secret
+     * Current secret, it's given to Botan as dtls-cookie-secret PSK.
+     */
+    Botan::SymmetricKey secret();
+
+    static std::string identity(const udp::endpoint& remote_endpoint);
+
+    /**
+     * @brief check
+     * @param out HelloVerifyRequest datagram if VERIFY. If ACCEPT it's first ClientHello rebuilt without cookie,
+     * new node must process it before datagram, because Botan waits for message sequence from zero.
+     */
+    Result check(const udp::endpoint& remote_endpoint, const uint8_t* data, std::size_t size, std::vector<uint8_t>& out);
+
+    /**
+     * @brief check_rate
+     * Token bucket of source prefix. Prefixes share slot on hash collision.
+     */
+    bool check_rate(const udp::endpoint& remote_endpoint);
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool is_valid_cookie(const std::vector<uint8_t>& cookie_input, const std::string& identity, const std::vector<uint8_t>& cookie);
+    void rotate_if_needed();
+
+    std::chrono::seconds rotate_interval_;
+    double new_client_rate_, new_client_burst_;
+
+    boost::shared_mutex secret_mutex_;
+    std::unique_ptr<Botan::RandomNumberGenerator> rng_;
+    Botan::SymmetricKey secret_, previous_secret_;
+    Clock::time_point rotated_at_;
+
+    struct Rate_Slot
+    {
+        std::mutex mutex_;
+        double tokens_;
+        Clock::time_point updated_at_;
+    };
+    std::unique_ptr<Rate_Slot[]> rate_slots_;
+};
+
+} // namespace DTLS
+} // namespace Helpz
+
+#endif // HELPZ_DTLS_COOKIE_FILTER_H
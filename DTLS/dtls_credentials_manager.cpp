@@ -105,5 +105,22 @@ Botan::Private_Key *Credentials_Manager::private_key_for(const Botan::X509_Certi
     return nullptr;
 }
 
+Botan::SymmetricKey Credentials_Manager::psk(const std::string &type, const std::string &context, const std::string &identity)
+{
+    if (type == "tls-server" && context == "dtls-cookie-secret" && m_cookie_secret_func)
+    {
+        Botan::SymmetricKey secret = m_cookie_secret_func();
+        if (secret.length())
+            return secret;
+    }
+
+    return Botan::Credentials_Manager::psk(type, context, identity);
+}
+
+void Credentials_Manager::set_cookie_secret_func(std::function<Botan::SymmetricKey ()> cookie_secret_func)
+{
+    m_cookie_secret_func = std::move(cookie_secret_func);
+}
+
 } // namespace DTLS
 } // namespace Helpz
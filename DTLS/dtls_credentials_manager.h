@@ -1,6 +1,8 @@
 #ifndef HELPZ_DTLS_CREDENTIALS_MANAGER_H
 #define HELPZ_DTLS_CREDENTIALS_MANAGER_H
 
+#include <functional>
+
 #include <botan-2/botan/credentials_manager.h>
 
 namespace Helpz {
@@ -29,6 +31,14 @@ public:
                                         const std::string& /*type*/,
                                         const std::string& /*context*/) override;
 
+    Botan::SymmetricKey psk(const std::string& type, const std::string& context, const std::string& identity) override;
+
+    /**
+     * @brief set_cookie_secret_func
+     * Botan server sends HelloVerifyRequest only if it has dtls-cookie-secret.
+     */
+    void set_cookie_secret_func(std::function<Botan::SymmetricKey()> cookie_secret_func);
+
 private:
     struct Certificate_Info
     {
@@ -38,6 +48,7 @@ private:
 
     std::vector<Certificate_Info> m_creds;
     std::vector<std::shared_ptr<Botan::Certificate_Store>> m_certstores;
+    std::function<Botan::SymmetricKey()> m_cookie_secret_func;
 };
 
 } // namespace DTLS
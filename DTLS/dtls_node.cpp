@@ -9,9 +9,18 @@
 namespace Helpz {
 namespace DTLS {
 
+namespace {
+
+// Messages written by one io job, then job is posted again so other nodes aren't delayed
+constexpr std::size_t SCHEDULED_WRITE_BATCH = 32;
+
+} // namespace
+
 Node::Node(Controller *controller, Helpz::DTLS::Socket *socket) :
-    controller_(controller), socket_(socket)
+    controller_(controller), socket_(socket),
+    coalesce_timer_{*socket->get_io_context()}
 {
+    send_buffer_.reserve(HELPZ_PROTOCOL_COALESCE_SIZE);
 }
 
 Node::~Node()
@@ -30,9 +39,11 @@ void Node::close()
     }
     if (dtls_)
     {
+        flush_coalesced();
         dtls_->close();
         dtls_.reset();
     }
+    send_scheduler_.clear();
 }
 
 std::shared_ptr<Net::Protocol> Node::protocol()
@@ -66,7 +77,7 @@ std::string Node::address() const
     return title_s.str();
 }
 
-void Node::process_received_data(std::unique_ptr<uint8_t[]> &&data, std::size_t size)
+void Node::process_received_data(const uint8_t* data, std::size_t size)
 {
     try
     {
@@ -76,7 +87,7 @@ void Node::process_received_data(std::unique_ptr<uint8_t[]> &&data, std::size_t
 
         bool first_active = !dtls_->is_active();
 
-        dtls_->received_data(data.get(), size);
+        dtls_->received_data(data, size);
 
         if (first_active && dtls_)
         {
@@ -128,23 +139,49 @@ void Node::write(const QByteArray& data)
 }
 
 void Node::write(std::shared_ptr<Net::Message_Item> message)
+{
+    // Only first message posts job, it writes all queued ones
+    if (send_scheduler_.push(std::move(message)))
+        post_scheduled_write();
+}
+
+Net::Send_Scheduler &Node::send_scheduler() { return send_scheduler_; }
+
+void Node::post_scheduled_write()
 {
     auto* ctrl = controller_;
     boost::asio::ip::udp::endpoint endpoint = receiver_endpoint_;
 
-    socket_->get_io_context()->post([ctrl, endpoint, message]()
+    socket_->get_io_context()->post([ctrl, endpoint]()
     {
         auto node = ctrl->get_node(endpoint);
         if (node)
-            node->write_impl(message);
+            node->write_scheduled();
     });
 }
 
+void Node::write_scheduled()
+{
+    for (std::size_t i = 0; i < SCHEDULED_WRITE_BATCH; ++i)
+    {
+        std::shared_ptr<Net::Message_Item> message = send_scheduler_.pop();
+        if (!message)
+            return;
+        write_impl(std::move(message));
+    }
+
+    if (!send_scheduler_.empty())
+        post_scheduled_write();
+}
+
 void Node::write_impl(const QByteArray &data)
 {
     std::lock_guard lock(mutex_);
     if (dtls_ && dtls_->is_active())
+    {
+        flush_coalesced();
         dtls_->send(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+    }
 }
 
 void Node::write_impl(std::shared_ptr<Net::Message_Item> message)
@@ -152,11 +189,74 @@ void Node::write_impl(std::shared_ptr<Net::Message_Item> message)
     std::lock_guard lock(mutex_);
     if (dtls_ && dtls_->is_active() && protocol_)
     {
-        const QByteArray data = protocol_->prepare_packet_to_send(std::move(message));
-        dtls_->send(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+        // Big fragments of lower priority would delay messages which wait behind them
+        const uint32_t max_fragment_size = send_scheduler_.has_pending_above(message->priority()) ? HELPZ_PROTOCOL_BUSY_FRAGMENT_SIZE : 0;
+
+        const int pos = send_buffer_.size();
+        const int size = static_cast<int>(protocol_->prepare_packet_to_send(std::move(message), send_buffer_, max_fragment_size));
+        if (!size)
+            return;
+
+        const std::chrono::milliseconds window = protocol_->coalesce_window();
+        const int max_size = static_cast<int>(protocol_->coalesce_max_size());
+        const bool is_coalesce = window.count() > 0 && size < max_size;
+        if (is_coalesce && send_buffer_.size() <= max_size)
+        {
+            if (pos == 0)
+                start_coalesce_timer(window);
+            return;
+        }
+
+        // Packet doesn't fit to waiting ones, so they are sent alone
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(send_buffer_.constData());
+        if (pos)
+            dtls_->send(data, pos);
+
+        if (is_coalesce)
+        {
+            send_buffer_.remove(0, pos);
+            start_coalesce_timer(window);
+        }
+        else
+        {
+            dtls_->send(data + pos, size);
+            send_buffer_.resize(0);
+        }
     }
 }
 
+void Node::start_coalesce_timer(std::chrono::milliseconds window)
+{
+    auto* ctrl = controller_;
+    boost::asio::ip::udp::endpoint endpoint = receiver_endpoint_;
+
+    coalesce_timer_.expires_after(window);
+    coalesce_timer_.async_wait([ctrl, endpoint](const boost::system::error_code& err)
+    {
+        if (err)
+            return;
+
+        auto node = ctrl->get_node(endpoint);
+        if (node)
+        {
+            std::lock_guard lock(node->mutex_);
+            node->flush_coalesced();
+        }
+    });
+}
+
+void Node::flush_coalesced()
+{
+    if (send_buffer_.isEmpty())
+        return;
+
+    if (dtls_ && dtls_->is_active())
+        dtls_->send(reinterpret_cast<const uint8_t*>(send_buffer_.constData()), send_buffer_.size());
+
+    // Capacity is reserved, so it's kept for next packets
+    send_buffer_.resize(0);
+}
+
 void Node::add_timeout_at(std::chrono::system_clock::time_point time_point, void *data)
 {
     controller_->add_timeout_at(receiver_endpoint(), time_point, data);
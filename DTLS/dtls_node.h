@@ -3,11 +3,14 @@
 
 #include <memory>
 
+#include <boost/asio/steady_timer.hpp>
+
 #include <botan-2/botan/tls_channel.h>
 #include <botan-2/botan/tls_callbacks.h>
 #include <botan-2/botan/tls_policy.h>
 
 #include <Helpz/net_protocol.h>
+#include <Helpz/net_send_scheduler.h>
 #include <Helpz/dtls_socket.h>
 
 namespace Helpz {
@@ -31,13 +34,23 @@ public:
 
     std::string address() const;
 
-    void process_received_data(std::unique_ptr<uint8_t[]> &&data, std::size_t size);
+    void process_received_data(const uint8_t* data, std::size_t size);
 
     void write(const QByteArray& data) override;
     void write(std::shared_ptr<Net::Message_Item> message) override;
+
+    /**
+     * @brief send_scheduler
+     * Messages wait for write in it by their priority. Weights can be changed at any time.
+     */
+    Net::Send_Scheduler& send_scheduler();
 private:
     void write_impl(const QByteArray& data);
     void write_impl(std::shared_ptr<Net::Message_Item> message);
+    void post_scheduled_write();
+    void write_scheduled();
+    void start_coalesce_timer(std::chrono::milliseconds window);
+    void flush_coalesced();
 protected:
     virtual std::shared_ptr<Node> get_shared() = 0;
 
@@ -63,6 +76,12 @@ private:
     Socket* socket_;
     std::shared_ptr<Net::Protocol> protocol_;
     boost::asio::ip::udp::endpoint receiver_endpoint_;
+
+    // Packets are built here in place, coalesced packets wait here for flush
+    QByteArray send_buffer_;
+    boost::asio::steady_timer coalesce_timer_;
+
+    Net::Send_Scheduler send_scheduler_;
 };
 
 } // namespace DTLS
@@ -0,0 +1,112 @@
+#include "dtls_record_pool.h"
+
+namespace Helpz {
+namespace DTLS {
+
+namespace {
+thread_local Record_Pool* current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+} // namespace
+
+Record_Pool::Record_Pool(std::size_t thread_count, Run_Func_T run_func) :
+    run_func_(std::move(run_func)),
+    break_flag_(false), pending_(0), sleeping_(0), next_worker_(0)
+{
+    if (thread_count == 0)
+        thread_count = 1;
+
+    for (std::size_t i = 0; i < thread_count; ++i)
+        workers_.emplace_back(new Worker);
+
+    // Threads are started after all queues exist, because they steal from each other
+    for (std::size_t i = 0; i < thread_count; ++i)
+        workers_.at(i)->thread_ = std::thread(&Record_Pool::run, this, i);
+}
+
+Record_Pool::~Record_Pool()
+{
+    stop();
+    join();
+}
+
+void Record_Pool::stop()
+{
+    std::lock_guard lock(idle_mutex_);
+    break_flag_ = true;
+    idle_cond_.notify_all();
+}
+
+void Record_Pool::join()
+{
+    for (std::unique_ptr<Worker>& worker: workers_)
+    {
+        if (worker->thread_.joinable())
+            worker->thread_.join();
+    }
+}
+
+void Record_Pool::schedule(std::shared_ptr<Server_Node> node)
+{
+    const std::size_t index = current_pool == this ? current_index : next_worker_++ % workers_.size();
+    push(index, std::move(node));
+
+    // Sleeping thread sees pending_ either before wait or by notify
+    if (sleeping_ > 0)
+    {
+        std::lock_guard lock(idle_mutex_);
+        idle_cond_.notify_one();
+    }
+}
+
+void Record_Pool::run(std::size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    std::shared_ptr<Server_Node> node;
+    while (!break_flag_)
+    {
+        if (!pop(index, node))
+        {
+            std::unique_lock lock(idle_mutex_);
+            ++sleeping_;
+            idle_cond_.wait(lock, [this]() { return pending_ > 0 || break_flag_; });
+            --sleeping_;
+            continue;
+        }
+
+        if (run_func_(node))
+            push(index, std::move(node));
+        node.reset();
+    }
+}
+
+void Record_Pool::push(std::size_t index, std::shared_ptr<Server_Node> &&node)
+{
+    // Counted before push, so pop never makes it negative
+    ++pending_;
+
+    Worker& worker = *workers_.at(index);
+    std::lock_guard lock(worker.mutex_);
+    worker.queue_.push_back(std::move(node));
+}
+
+bool Record_Pool::pop(std::size_t index, std::shared_ptr<Server_Node> &node)
+{
+    for (std::size_t i = 0; i < workers_.size(); ++i)
+    {
+        Worker& worker = *workers_.at((index + i) % workers_.size());
+        std::lock_guard lock(worker.mutex_);
+        if (!worker.queue_.empty())
+        {
+            node = std::move(worker.queue_.front());
+            worker.queue_.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace DTLS
+} // namespace Helpz
@@ -0,0 +1,67 @@
+#ifndef HELPZ_DTLS_RECORD_POOL_H
+#define HELPZ_DTLS_RECORD_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+namespace Helpz {
+namespace DTLS {
+
+class Server_Node;
+
+/**
+ * @brief The Record_Pool class
+ *
+ * Threads which run nodes with pending records. Node is scheduled only when its mailbox becomes non empty,
+ * so it's never run by two threads at once and its records are processed in order without node lock.
+ * Each thread has own queue, node scheduled from pool thread goes to its queue, others are spread by round robin.
+ * Thread with empty queue steals from other queues before sleep.
+ */
+class Record_Pool
+{
+public:
+    /**
+     * @brief Run_Func_T
+     * Processes some records of node, returns true if node still has records and must be scheduled again.
+     */
+    typedef std::function<bool(const std::shared_ptr<Server_Node>&)> Run_Func_T;
+
+    Record_Pool(std::size_t thread_count, Run_Func_T run_func);
+    ~Record_Pool();
+
+    void stop();
+    void join();
+
+    void schedule(std::shared_ptr<Server_Node> node);
+private:
+    struct Worker
+    {
+        std::mutex mutex_;
+        std::deque<std::shared_ptr<Server_Node>> queue_;
+        std::thread thread_;
+    };
+
+    void run(std::size_t index);
+    void push(std::size_t index, std::shared_ptr<Server_Node>&& node);
+    bool pop(std::size_t index, std::shared_ptr<Server_Node>& node);
+
+    Run_Func_T run_func_;
+
+    std::atomic<bool> break_flag_;
+    std::atomic<std::size_t> pending_, sleeping_, next_worker_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} // namespace DTLS
+} // namespace Helpz
+
+#endif // HELPZ_DTLS_RECORD_POOL_H
@@ -1,56 +1,124 @@
+#include <stdexcept>
 
+#include "dtls_tools.h"
 #include "dtls_server_controller.h"
 #include "dtls_server.h"
 
 namespace Helpz {
 namespace DTLS {
 
+#ifdef __linux__
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> Reuse_Port_Option;
+#endif
+
 Server::Server(Tools *dtls_tools, boost::asio::io_context *io_context, uint16_t port,
                Create_Server_Protocol_Func_T &&create_protocol_func, std::chrono::seconds cleaning_timeout, int record_thread_count) :
-    Socket{io_context, new udp::socket{*io_context, udp::endpoint(udp::v4(), port)}, new Server_Controller{ dtls_tools, this, std::move(create_protocol_func), record_thread_count }},
-    cleaning_timeout_{cleaning_timeout},
-    cleaning_timer_{*io_context, cleaning_timeout_}
+    Server{dtls_tools, std::vector<boost::asio::io_context*>{io_context}, port, std::move(create_protocol_func), cleaning_timeout, record_thread_count}
 {
-    cleaning_timer_.async_wait(std::bind(&Server::cleaning, this, std::placeholders::_1));
+}
+
+Server::Server(Tools *dtls_tools, const std::vector<boost::asio::io_context *> &io_contexts, uint16_t port,
+               Create_Server_Protocol_Func_T &&create_protocol_func, std::chrono::seconds cleaning_timeout, int record_thread_count) :
+    cookie_filter_(std::make_shared<Cookie_Filter>())
+{
+    if (io_contexts.empty())
+        throw std::runtime_error("DTLS Server without io_context");
+    if (io_contexts.size() > 1 && !is_sharding_supported())
+        throw std::runtime_error("DTLS Server sharding isn't supported");
+
+    // Botan checks cookie of admitted ClientHello with the same secret
+    std::weak_ptr<Cookie_Filter> cookie_filter = cookie_filter_;
+    dtls_tools->creds_->set_cookie_secret_func([cookie_filter]()
+    {
+        std::shared_ptr<Cookie_Filter> filter = cookie_filter.lock();
+        return filter ? filter->secret() : Botan::SymmetricKey{};
+    });
+
+    const bool is_reuse_port = io_contexts.size() > 1;
+    for (boost::asio::io_context* io_context: io_contexts)
+    {
+        // Port 0 is resolved by first shard, others are bound to the same one
+        if (!shards_.empty())
+            port = shards_.front()->get_local_port();
+
+        Create_Server_Protocol_Func_T shard_create_protocol_func{create_protocol_func};
+        shards_.emplace_back(new Server_Shard{dtls_tools, io_context, open_socket(io_context, port, is_reuse_port),
+                                              std::move(shard_create_protocol_func), cleaning_timeout, record_thread_count, cookie_filter_});
+    }
+}
+
+bool Server::is_sharding_supported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Server::start_receive()
+{
+    for (std::unique_ptr<Server_Shard>& shard: shards_)
+        shard->start_receive();
 }
 
 uint16_t Server::get_local_port() const
 {
-    return socket_->local_endpoint().port();
+    return shards_.front()->get_local_port();
 }
 
-std::shared_ptr<Server_Node> Server::find_client(std::function<bool (const Net::Protocol *)> check_protocol_func) const
+std::size_t Server::shard_count() const
 {
-    return controller()->find_client(check_protocol_func);
+    return shards_.size();
 }
 
-void Server::remove_copy(Net::Protocol *client)
+Server_Shard *Server::shard(std::size_t index)
 {
-    controller()->remove_copy(client);
+    return index < shards_.size() ? shards_.at(index).get() : nullptr;
 }
 
-void Server::cleaning(const boost::system::error_code &err)
+std::shared_ptr<Server_Node> Server::find_client(std::function<bool (const Net::Protocol *)> check_protocol_func) const
 {
-    if (err)
+    for (const std::unique_ptr<Server_Shard>& shard: shards_)
     {
-        std::cerr << "cleaning timer error " << err << std::endl;
-        return;
+        std::shared_ptr<Server_Node> node = shard->controller()->find_client(check_protocol_func);
+        if (node)
+            return node;
     }
+    return {};
+}
 
-    controller()->remove_frozen_clients(cleaning_timeout_);
+void Server::remove_copy(Net::Protocol *client)
+{
+    // Copy may be connected from other port, so it can be in any shard
+    for (std::unique_ptr<Server_Shard>& shard: shards_)
+        shard->controller()->remove_copy(client);
+}
 
-    cleaning_timer_.expires_at(cleaning_timer_.expiry() + cleaning_timeout_);
-    cleaning_timer_.async_wait(std::bind(&Server::cleaning, this, std::placeholders::_1));
+Net::Protocol_Stats::Snapshot Server::stats() const
+{
+    Net::Protocol_Stats::Snapshot snapshot;
+    for (const std::unique_ptr<Server_Shard>& shard: shards_)
+        snapshot += shard->controller()->stats();
+    return snapshot;
 }
 
-const Server_Controller *Server::controller() const
+Cookie_Filter *Server::cookie_filter()
 {
-    return static_cast<const Server_Controller*>(controller_.get());
+    return cookie_filter_.get();
 }
 
-Server_Controller *Server::controller()
+boost::asio::ip::udp::socket *Server::open_socket(boost::asio::io_context *io_context, uint16_t port, bool is_reuse_port)
 {
-    return static_cast<Server_Controller*>(controller_.get());
+    std::unique_ptr<udp::socket> socket{new udp::socket{*io_context, udp::v4()}};
+#ifdef __linux__
+    if (is_reuse_port)
+        socket->set_option(Reuse_Port_Option{true});
+#else
+    Q_UNUSED(is_reuse_port);
+#endif
+    socket->bind(udp::endpoint(udp::v4(), port));
+    return socket.release();
 }
 
 } // namespace DTLS
@@ -1,31 +1,66 @@
 #ifndef HELPZ_DTLS_SERVER_H
 #define HELPZ_DTLS_SERVER_H
 
-#include <boost/asio/steady_timer.hpp>
+#include <vector>
 
-#include <Helpz/dtls_socket.h>
-#include <Helpz/dtls_server_controller.h>
+#include <Helpz/dtls_server_shard.h>
 
 namespace Helpz {
 namespace DTLS {
 
-class Server final : public Socket
+/**
+ * @brief The Server class
+ * Facade over shards. Each shard is socket bound to same port with SO_REUSEPORT,
+ * kernel hashes address of client, so client always comes to one shard.
+ * With one io_context it's single socket without SO_REUSEPORT.
+ */
+class Server final
 {
 public:
+    using udp = boost::asio::ip::udp;
+
     Server(Tools* dtls_tools, boost::asio::io_context *io_context, uint16_t port, Create_Server_Protocol_Func_T&& create_protocol_func,
            std::chrono::seconds cleaning_timeout, int record_thread_count = 5);
 
+    /**
+     * @brief Server
+     * One shard for each io_context, record_thread_count is for each shard.
+     */
+    Server(Tools* dtls_tools, const std::vector<boost::asio::io_context*>& io_contexts, uint16_t port, Create_Server_Protocol_Func_T&& create_protocol_func,
+           std::chrono::seconds cleaning_timeout, int record_thread_count = 5);
+
+    /**
+     * @brief is_sharding_supported
+     * Only Linux balances datagrams between sockets with SO_REUSEPORT.
+     */
+    static bool is_sharding_supported();
+
+    void start_receive();
+
     uint16_t get_local_port() const;
 
+    std::size_t shard_count() const;
+    Server_Shard* shard(std::size_t index);
+
     std::shared_ptr<Server_Node> find_client(std::function<bool(const Net::Protocol *)> check_protocol_func) const;
     void remove_copy(Net::Protocol *client);
+
+    /**
+     * @brief stats
+     * Sum of transport counters of all connected clients of all shards.
+     */
+    Net::Protocol_Stats::Snapshot stats() const;
+
+    /**
+     * @brief cookie_filter
+     * Admission of new clients, it's shared by all shards.
+     */
+    Cookie_Filter* cookie_filter();
 private:
-    void cleaning(const boost::system::error_code &err);
-    const Server_Controller* controller() const;
-    Server_Controller* controller();
+    static udp::socket* open_socket(boost::asio::io_context *io_context, uint16_t port, bool is_reuse_port);
 
-    std::chrono::seconds cleaning_timeout_;
-    boost::asio::steady_timer cleaning_timer_;
+    std::shared_ptr<Cookie_Filter> cookie_filter_;
+    std::vector<std::unique_ptr<Server_Shard>> shards_;
 };
 
 } // namespace DTLS
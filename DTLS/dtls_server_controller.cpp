@@ -5,40 +5,25 @@
 namespace Helpz {
 namespace DTLS {
 
-Server_Controller::Server_Controller(Tools *dtls_tools, Socket *socket, Create_Server_Protocol_Func_T &&create_protocol_func, int record_thread_count) :
-    Controller{ dtls_tools },
+Server_Controller::Server_Controller(Tools *dtls_tools, Socket *socket, boost::asio::io_context *io_context,
+                                     Create_Server_Protocol_Func_T &&create_protocol_func, int record_thread_count,
+                                     std::shared_ptr<Cookie_Filter> cookie_filter) :
+    Controller{ dtls_tools, io_context },
     socket_(socket),
     create_protocol_func_(std::move(create_protocol_func)),
-    records_thread_break_flag_(false)
+    cookie_filter_(std::move(cookie_filter)),
+    records_pool_(record_thread_count > 0 ? record_thread_count : 1, std::bind(&Server_Controller::process_records, this, std::placeholders::_1))
 {
-    for (int i = 0; i < record_thread_count; ++i)
-    {
-        records_thread_list_.emplace_back(std::thread(&Server_Controller::records_thread_run, this));
-    }
 }
 
 Server_Controller::~Server_Controller()
 {
-    {
-        std::lock_guard lock(records_mutex_);
-        records_thread_break_flag_ = true;
-        records_cond_.notify_all();
-    }
+    records_pool_.stop();
 
-    {
-        std::unique_lock lock(clients_mutex_);
-        for (const auto& it: clients_)
-            it.second->close();
-        clients_.clear();
-    }
+    for (const std::shared_ptr<Server_Node>& node: clients_.remove_if([](const std::shared_ptr<Server_Node>&) { return true; }))
+        node->close();
 
-    for (std::thread& t: records_thread_list_)
-    {
-        if (t.joinable())
-        {
-            t.join();
-        }
-    }
+    records_pool_.join();
 }
 
 Socket *Server_Controller::socket()
@@ -47,141 +32,136 @@ Socket *Server_Controller::socket()
 }
 
 std::shared_ptr<Node> Server_Controller::get_node(const boost::asio::ip::udp::endpoint &remote_endpoint)
+{
+    return find_client(remote_endpoint);
+}
+
+std::shared_ptr<Node> Server_Controller::admit_node(const udp::endpoint &remote_endpoint, const uint8_t *data, std::size_t size)
 {
     std::shared_ptr<Node> node = find_client(remote_endpoint);
-    if (!node)
+    if (node)
+        return node;
+
+    if (!cookie_filter_)
+        return create_client(remote_endpoint, {});
+
+    std::vector<uint8_t> out;
+    switch (cookie_filter_->check(remote_endpoint, data, size, out))
     {
-        node = create_client(remote_endpoint);
-//        return get_or_create_client(remote_endpoint);
+    case Cookie_Filter::ACCEPT:
+        return create_client(remote_endpoint, out);
+    case Cookie_Filter::VERIFY:
+        socket_->send(remote_endpoint, out.data(), out.size());
+        break;
+    default:
+        break;
     }
-    return node;
+    return {};
 }
 
-void Server_Controller::process_data(std::shared_ptr<Node> &node, std::unique_ptr<uint8_t[]> &&data, std::size_t size)
+void Server_Controller::process_data(std::shared_ptr<Node> &node, const uint8_t* data, std::size_t size)
 {
     // node already locked
-    node->process_received_data(std::move(data), size);
+    node->process_received_data(data, size);
 }
 
 void Server_Controller::remove_copy(Net::Protocol *client)
 {
-    if (check_copy(client))
+    auto is_copy = [client](const std::shared_ptr<Server_Node>& node)
+    {
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        return proto && proto.get() != client && *proto == *client;
+    };
+
+    for (const std::shared_ptr<Server_Node>& node: clients_.remove_if(is_copy))
     {
-        std::shared_ptr<Net::Protocol> proto;
-        std::lock_guard lock(clients_mutex_);
-        for(auto it = clients_.begin(); it != clients_.end();)
-        {
-            proto = it->second->protocol();
-            if (proto && proto.get() != client && *proto == *client)
-            {
-                qCDebug(Log).noquote() << it->second->title() << "same. Erase it.";
-                proto->before_remove_copy();
-                it->second->close();
-                it = clients_.erase(it);
-            }
-            else
-                ++it;
-        }
+        qCDebug(Log).noquote() << node->title() << "same. Erase it.";
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        if (proto)
+            proto->before_remove_copy();
+        cancel_timeouts(node->receiver_endpoint());
+        node->close();
     }
 }
 
 bool Server_Controller::check_copy(Net::Protocol *client)
 {
-    std::shared_ptr<Net::Protocol> proto;
-    boost::shared_lock lock(clients_mutex_);
-    for (const std::pair<udp::endpoint, std::shared_ptr<Server_Node>>& it: clients_)
+    return static_cast<bool>(clients_.find_if([client](const std::shared_ptr<Server_Node>& node)
     {
-        proto = it.second->protocol();
-        if (proto && proto.get() != client && *proto == *client)
-        {
-            return true;
-        }
-    }
-    return false;
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        return proto && proto.get() != client && *proto == *client;
+    }));
 }
 
 void Server_Controller::remove_frozen_clients(std::chrono::seconds frozen_timeout)
 {
-    if (check_frozen_clients(frozen_timeout))
+    const auto now = std::chrono::system_clock::now();
+    auto is_frozen = [now, frozen_timeout](const std::shared_ptr<Server_Node>& node)
     {
-        std::lock_guard lock(clients_mutex_);
-        auto now = std::chrono::system_clock::now();
-
-        for(auto it = clients_.begin(); it != clients_.end();)
-        {
-            if ((now - it->second->last_msg_recv_time()) > frozen_timeout)
-            {
-                qCDebug(Log).noquote() << it->second->title() << "timeout. Erase it.";
-                it->second->close();
-                it = clients_.erase(it);
-            }
-            else
-                ++it;
-        }
+        return (now - node->last_msg_recv_time()) > frozen_timeout;
+    };
+
+    for (const std::shared_ptr<Server_Node>& node: clients_.remove_if(is_frozen))
+    {
+        qCDebug(Log).noquote() << node->title() << "timeout. Erase it.";
+        cancel_timeouts(node->receiver_endpoint());
+        node->close();
     }
 }
 
 bool Server_Controller::check_frozen_clients(std::chrono::seconds frozen_timeout)
 {
-    boost::shared_lock lock(clients_mutex_);
-    auto now = std::chrono::system_clock::now();
-    for (const std::pair<udp::endpoint, std::shared_ptr<Server_Node>>& it: clients_)
+    const auto now = std::chrono::system_clock::now();
+    return static_cast<bool>(clients_.find_if([now, frozen_timeout](const std::shared_ptr<Server_Node>& node)
     {
-        if ((now - it.second->last_msg_recv_time()) > frozen_timeout)
-        {
-            return true;
-        }
-    }
-    return false;
+        return (now - node->last_msg_recv_time()) > frozen_timeout;
+    }));
 }
 
 std::shared_ptr<Server_Node> Server_Controller::find_client(const udp::endpoint &remote_endpoint) const
 {
-    boost::shared_lock lock(clients_mutex_);
-    auto it = clients_.find(remote_endpoint);
-    if (it != clients_.cend())
-    {
-        return it->second;
-    }
-    return {};
+    return clients_.find(remote_endpoint);
 }
 
 std::shared_ptr<Server_Node> Server_Controller::find_client(std::function<bool (const Net::Protocol *)> check_protocol_func) const
 {
-    std::shared_ptr<Net::Protocol> proto;
-    boost::shared_lock lock(clients_mutex_);
-    for (const std::pair<udp::endpoint, std::shared_ptr<Server_Node>>& it: clients_)
+    return clients_.find_if([&check_protocol_func](const std::shared_ptr<Server_Node>& node)
     {
-        proto = it.second->protocol();
-        if (proto && check_protocol_func(proto.get()))
-        {
-            return it.second;
-        }
-    }
-    return {};
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        return proto && check_protocol_func(proto.get());
+    });
 }
 
-std::shared_ptr<Server_Node> Server_Controller::create_client(const udp::endpoint &remote_endpoint)
+Net::Protocol_Stats::Snapshot Server_Controller::stats() const
 {
-    std::lock_guard lock(clients_mutex_);
-    auto it = clients_.find(remote_endpoint);
-    if (it != clients_.cend())
+    // Protocol locks its own mutex for queue depth, so it's read without clients lock
+    Net::Protocol_Stats::Snapshot snapshot;
+    for (const std::shared_ptr<Server_Node>& node: clients_.clients())
     {
-        return it->second;
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        if (proto)
+            snapshot += proto->stats();
     }
+    return snapshot;
+}
 
-    auto create_pair = clients_.emplace(remote_endpoint, std::make_shared<Server_Node>(this, remote_endpoint));
-    if (create_pair.second)
+std::shared_ptr<Server_Node> Server_Controller::create_client(const udp::endpoint &remote_endpoint, const std::vector<uint8_t> &first_hello)
+{
+    return clients_.find_or_create(remote_endpoint, [this, &remote_endpoint, &first_hello]()
     {
-        return create_pair.first->second;
-    }
-    return {};
+        std::shared_ptr<Server_Node> node = std::make_shared<Server_Node>(this, remote_endpoint);
+        // Node isn't visible to other threads yet, so rebuilt ClientHello is processed before datagram
+        if (!first_hello.empty())
+            node->process_first_hello(first_hello);
+        return node;
+    });
 }
 
 void Server_Controller::remove_client(const udp::endpoint &remote_endpoint)
 {
-    std::lock_guard lock(clients_mutex_);
-    clients_.erase(remote_endpoint);
+    clients_.remove(remote_endpoint);
+    // Timer added by record which was still running is dropped in on_protocol_timeout
+    cancel_timeouts(remote_endpoint);
 }
 
 std::shared_ptr<Net::Protocol> Server_Controller::create_protocol(const std::vector<std::string> &client_protos, std::string *choose_out)
@@ -189,53 +169,40 @@ std::shared_ptr<Net::Protocol> Server_Controller::create_protocol(const std::vec
     return create_protocol_func_(client_protos, choose_out);
 }
 
-void Server_Controller::add_received_record(std::shared_ptr<Node> &&node, std::unique_ptr<uint8_t[]> &&buffer, std::size_t size)
+void Server_Controller::add_record(std::shared_ptr<Server_Node> node, Server_Node::Record &&record)
 {
-    std::lock_guard lock(records_mutex_);
-    records_queue_.push(Record_Item{std::move(node), std::move(buffer), size});
-    records_cond_.notify_one();
+    if (node->add_record(std::move(record)))
+        records_pool_.schedule(std::move(node));
 }
 
-void Server_Controller::records_thread_run()
+bool Server_Controller::process_records(const std::shared_ptr<Server_Node> &node)
 {
-    std::unique_lock lock(records_mutex_, std::defer_lock);
-    while (!records_thread_break_flag_)
+    // Only one pool thread runs node at once, so records are processed in order without node lock
+    Server_Node::Record record;
+    for (std::size_t i = 0; i < HELPZ_SERVER_RECORD_BUDGET; ++i)
     {
-        lock.lock();
-        records_cond_.wait(lock, [this](){ return records_queue_.size() || records_thread_break_flag_; });
-        if (records_thread_break_flag_)
-        {
-            break;
-        }
-
-        Record_Item record{std::move(records_queue_.front())};
-        records_queue_.pop();
-        lock.unlock();
-
-        if (record.node_ && record.buffer_)
-        {
-            auto proto = record.node_->protocol();
-            if (proto)
-            {
-                std::lock_guard node_lock(static_cast<Server_Node*>(record.node_.get())->record_mutex_);
-                proto->process_bytes(record.buffer_.get(), record.size_);
-            }
-        }
+        if (!node->take_record(record))
+            return false;
+
+        std::shared_ptr<Net::Protocol> proto = node->protocol();
+        if (!proto)
+            continue;
+
+        if (record.buffer_)
+            proto->process_bytes(record.buffer_.get(), record.size_);
+        else
+            proto->process_wait_list(record.timeout_data_);
     }
+
+    // Budget is spent, node is queued again after others
+    return true;
 }
 
 void Server_Controller::on_protocol_timeout(boost::asio::ip::udp::endpoint remote_endpoint, void *data)
 {
     std::shared_ptr<Server_Node> node = find_client(remote_endpoint);
     if (node)
-    {
-        std::shared_ptr<Net::Protocol> proto = node->protocol();
-        if (proto)
-        {
-            std::lock_guard node_lock(node->record_mutex_);
-            proto->process_wait_list(data);
-        }
-    }
+        add_record(std::move(node), Server_Node::Record{Buffer_Pool::Buffer{}, 0, data});
 }
 
 } // namespace DTLS
@@ -1,15 +1,13 @@
 #ifndef DTLS_SERVER_CONTROLLER_H
 #define DTLS_SERVER_CONTROLLER_H
 
-#include <map>
-#include <queue>
-#include <thread>
 #include <mutex>
-#include <condition_variable>
-
-#include <boost/thread/shared_mutex.hpp>
 
 #include <Helpz/dtls_controller.h>
+#include <Helpz/dtls_buffer_pool.h>
+#include <Helpz/dtls_client_registry.h>
+#include <Helpz/dtls_cookie_filter.h>
+#include <Helpz/dtls_record_pool.h>
 #include <Helpz/dtls_server_node.h>
 
 namespace Helpz {
@@ -20,13 +18,15 @@ typedef std::function<std::shared_ptr<Net::Protocol>(const std::vector<std::stri
 class Server_Controller final : public Controller
 {
 public:
-    Server_Controller(Tools* dtls_tools, Socket* socket, Create_Server_Protocol_Func_T&& create_protocol_func, int record_thread_count = 5);
+    Server_Controller(Tools* dtls_tools, Socket* socket, boost::asio::io_context* io_context, Create_Server_Protocol_Func_T&& create_protocol_func, int record_thread_count = 5,
+                      std::shared_ptr<Cookie_Filter> cookie_filter = {});
     ~Server_Controller();
 
     Socket* socket();
 
     std::shared_ptr<Node> get_node(const udp::endpoint& remote_endpoint) override;
-    void process_data(std::shared_ptr<Node> &node, std::unique_ptr<uint8_t[]> &&data, std::size_t size) override;
+    std::shared_ptr<Node> admit_node(const udp::endpoint& remote_endpoint, const uint8_t* data, std::size_t size) override;
+    void process_data(std::shared_ptr<Node> &node, const uint8_t* data, std::size_t size) override;
 
     void remove_copy(Net::Protocol* client);
     bool check_copy(Net::Protocol* client);
@@ -36,36 +36,35 @@ public:
 
     std::shared_ptr<Server_Node> find_client(const udp::endpoint& remote_endpoint) const;
     std::shared_ptr<Server_Node> find_client(std::function<bool(const Net::Protocol *)> check_protocol_func) const;
+
+    /**
+     * @brief stats
+     * Sum of transport counters of all connected clients.
+     */
+    Net::Protocol_Stats::Snapshot stats() const;
 private:
-    std::shared_ptr<Server_Node> create_client(const udp::endpoint& remote_endpoint);
+    std::shared_ptr<Server_Node> create_client(const udp::endpoint& remote_endpoint, const std::vector<uint8_t>& first_hello);
 public:
     void remove_client(const udp::endpoint& remote_endpoint);
 
     std::shared_ptr<Net::Protocol> create_protocol(const std::vector<std::string> &client_protos, std::string* choose_out);
 
-    void add_received_record(std::shared_ptr<Node>&& node, std::unique_ptr<uint8_t[]>&& buffer, std::size_t size);
+    /**
+     * @brief add_record
+     * Record goes to mailbox of node, node is scheduled on record pool if it was idle.
+     */
+    void add_record(std::shared_ptr<Server_Node> node, Server_Node::Record&& record);
 private:
-    void records_thread_run();
+    bool process_records(const std::shared_ptr<Server_Node>& node);
     void on_protocol_timeout(boost::asio::ip::udp::endpoint remote_endpoint, void* data) override;
 
-    mutable boost::shared_mutex clients_mutex_;
-    std::map<udp::endpoint, std::shared_ptr<Server_Node>> clients_;
+    Client_Registry clients_;
 
     Socket* socket_;
     Create_Server_Protocol_Func_T create_protocol_func_;
+    std::shared_ptr<Cookie_Filter> cookie_filter_;
 
-    struct Record_Item
-    {
-        std::shared_ptr<Node> node_;
-        std::unique_ptr<uint8_t[]> buffer_;
-        std::size_t size_;
-    };
-
-    bool records_thread_break_flag_;
-    std::vector<std::thread> records_thread_list_;
-    std::queue<Record_Item> records_queue_;
-    std::condition_variable records_cond_;
-    std::mutex records_mutex_;
+    Record_Pool records_pool_;
 };
 
 } // namespace DTLS
@@ -4,6 +4,7 @@
 #include <botan-2/botan/tls_server.h>
 
 #include "dtls_tools.h"
+#include "dtls_socket.h"
 #include "dtls_server_controller.h"
 #include "dtls_server_node.h"
 
@@ -11,7 +12,8 @@ namespace Helpz {
 namespace DTLS {
 
 Server_Node::Server_Node(Server_Controller *controller, const boost::asio::ip::udp::endpoint &endpoint) :
-    Node{ controller, controller->socket() }
+    Node{ controller, controller->socket() },
+    is_scheduled_(false), is_emit_dropped_(false)
 {
     set_receiver_endpoint(endpoint);
 
@@ -22,6 +24,38 @@ Server_Node::Server_Node(Server_Controller *controller, const boost::asio::ip::u
                                         *tools->policy_, *tools->rng_, true });
 }
 
+bool Server_Node::add_record(Record &&record)
+{
+    std::lock_guard lock(mailbox_mutex_);
+    mailbox_.push_back(std::move(record));
+    if (is_scheduled_)
+        return false;
+    is_scheduled_ = true;
+    return true;
+}
+
+bool Server_Node::take_record(Record &record)
+{
+    std::lock_guard lock(mailbox_mutex_);
+    if (mailbox_.empty())
+    {
+        is_scheduled_ = false;
+        return false;
+    }
+
+    record = std::move(mailbox_.front());
+    mailbox_.pop_front();
+    return true;
+}
+
+void Server_Node::process_first_hello(const std::vector<uint8_t> &datagram)
+{
+    std::lock_guard lock(mutex_);
+    is_emit_dropped_ = true;
+    process_received_data(datagram.data(), datagram.size());
+    is_emit_dropped_ = false;
+}
+
 std::shared_ptr<Node> Server_Node::get_shared()
 {
     return std::static_pointer_cast<Node>(shared_from_this());
@@ -29,9 +63,21 @@ std::shared_ptr<Node> Server_Node::get_shared()
 
 void Server_Node::tls_record_received(Botan::u64bit, const uint8_t data[], size_t size)
 {
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+    Buffer_Pool::Buffer buffer = controller()->socket()->buffer_pool()->take(size);
     memcpy(buffer.get(), data, size);
-    controller()->add_received_record(get_shared(), std::move(buffer), size);
+    controller()->add_record(shared_from_this(), Record{std::move(buffer), size, nullptr});
+}
+
+void Server_Node::tls_emit_data(const uint8_t data[], size_t size)
+{
+    if (!is_emit_dropped_)
+        Node::tls_emit_data(data, size);
+}
+
+std::string Server_Node::tls_peer_network_identity()
+{
+    // Cookie is bound to endpoint, Cookie_Filter uses the same identity
+    return address();
 }
 
 void Server_Node::tls_alert(Botan::TLS::Alert alert)
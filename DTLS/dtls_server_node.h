@@ -2,6 +2,7 @@
 #define HELPZ_DTLS_SERVER_NODE_H
 
 #include <mutex>
+#include <deque>
 #include <functional>
 
 #include <boost/asio/ip/udp.hpp>
@@ -16,17 +17,51 @@ class Server_Controller;
 class Server_Node final : public Node, public std::enable_shared_from_this<Server_Node>
 {
 public:
-    std::mutex record_mutex_;
+    /**
+     * @brief The Record struct
+     * Decrypted record or timeout of protocol wait list when buffer is empty.
+     */
+    struct Record
+    {
+        Buffer_Pool::Buffer buffer_;
+        std::size_t size_;
+        void* timeout_data_;
+    };
 
     Server_Node(Server_Controller* controller, const boost::asio::ip::udp::endpoint& endpoint);
+
+    /**
+     * @brief add_record
+     * @return true if mailbox was idle, then caller must schedule node.
+     */
+    bool add_record(Record&& record);
+
+    /**
+     * @brief take_record
+     * @return false if mailbox is empty, then it becomes idle.
+     */
+    bool take_record(Record& record);
+
+    /**
+     * @brief process_first_hello
+     * ClientHello which was answered with HelloVerifyRequest by Cookie_Filter. Botan answers it again, that is dropped.
+     */
+    void process_first_hello(const std::vector<uint8_t>& datagram);
 private:
     std::shared_ptr<Node> get_shared() override;
 
     void tls_record_received(Botan::u64bit, const uint8_t data[], size_t size) override final;
+    void tls_emit_data(const uint8_t data[], size_t size) override final;
+    std::string tls_peer_network_identity() override final;
     void tls_alert(Botan::TLS::Alert alert) override final;
     std::string tls_server_choose_app_protocol(const std::vector<std::string> &client_protos) override final;
 
     constexpr Server_Controller* controller();
+
+    std::mutex mailbox_mutex_;
+    std::deque<Record> mailbox_;
+    bool is_scheduled_;
+    bool is_emit_dropped_;
 };
 
 } // namespace DTLS
@@ -0,0 +1,54 @@
+#include <iostream>
+
+#include "dtls_server_shard.h"
+
+namespace Helpz {
+namespace DTLS {
+
+Server_Shard::Server_Shard(Tools *dtls_tools, boost::asio::io_context *io_context, udp::socket *socket,
+                           Create_Server_Protocol_Func_T &&create_protocol_func, std::chrono::seconds cleaning_timeout, int record_thread_count,
+                           std::shared_ptr<Cookie_Filter> cookie_filter) :
+    Socket{io_context, socket, new Server_Controller{ dtls_tools, this, io_context, std::move(create_protocol_func), record_thread_count, std::move(cookie_filter) }},
+    cleaning_timeout_{cleaning_timeout},
+    cleaning_timer_{*io_context, cleaning_timeout_}
+{
+    set_batch_mode(true);
+    cleaning_timer_.async_wait(std::bind(&Server_Shard::cleaning, this, std::placeholders::_1));
+}
+
+void Server_Shard::start_receive()
+{
+    Socket::start_receive(receive_endpoint_);
+}
+
+uint16_t Server_Shard::get_local_port() const
+{
+    return socket_->local_endpoint().port();
+}
+
+const Server_Controller *Server_Shard::controller() const
+{
+    return static_cast<const Server_Controller*>(controller_.get());
+}
+
+Server_Controller *Server_Shard::controller()
+{
+    return static_cast<Server_Controller*>(controller_.get());
+}
+
+void Server_Shard::cleaning(const boost::system::error_code &err)
+{
+    if (err)
+    {
+        std::cerr << "cleaning timer error " << err << std::endl;
+        return;
+    }
+
+    controller()->remove_frozen_clients(cleaning_timeout_);
+
+    cleaning_timer_.expires_at(cleaning_timer_.expiry() + cleaning_timeout_);
+    cleaning_timer_.async_wait(std::bind(&Server_Shard::cleaning, this, std::placeholders::_1));
+}
+
+} // namespace DTLS
+} // namespace Helpz
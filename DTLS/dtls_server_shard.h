@@ -0,0 +1,42 @@
+#ifndef HELPZ_DTLS_SERVER_SHARD_H
+#define HELPZ_DTLS_SERVER_SHARD_H
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <Helpz/dtls_socket.h>
+#include <Helpz/dtls_server_controller.h>
+
+namespace Helpz {
+namespace DTLS {
+
+/**
+ * @brief The Server_Shard class
+ * One socket of server with its own clients, cleaning timer, protocol timer and record threads.
+ * All its handlers run on own io_context.
+ */
+class Server_Shard final : public Socket
+{
+public:
+    Server_Shard(Tools* dtls_tools, boost::asio::io_context *io_context, udp::socket* socket, Create_Server_Protocol_Func_T&& create_protocol_func,
+                 std::chrono::seconds cleaning_timeout, int record_thread_count = 5, std::shared_ptr<Cookie_Filter> cookie_filter = {});
+
+    using Socket::start_receive;
+    void start_receive();
+
+    uint16_t get_local_port() const;
+
+    const Server_Controller* controller() const;
+    Server_Controller* controller();
+private:
+    void cleaning(const boost::system::error_code &err);
+
+    udp::endpoint receive_endpoint_;
+
+    std::chrono::seconds cleaning_timeout_;
+    boost::asio::steady_timer cleaning_timer_;
+};
+
+} // namespace DTLS
+} // namespace Helpz
+
+#endif // HELPZ_DTLS_SERVER_SHARD_H
@@ -12,8 +12,8 @@ namespace DTLS {
 
 Server_Thread_Config::Server_Thread_Config(uint16_t port, const std::string &tls_police_file_name, const std::string &certificate_file_name,
                                            const std::string &certificate_key_file_name, uint32_t cleaning_timeout_sec, uint16_t receive_thread_count,
-                                           uint16_t record_thread_count, int main_thread_priority) :
-    port_(port), receive_thread_count_(receive_thread_count), record_thread_count_(record_thread_count),
+                                           uint16_t record_thread_count, int main_thread_priority, uint16_t shard_count) :
+    port_(port), receive_thread_count_(receive_thread_count), record_thread_count_(record_thread_count), shard_count_(shard_count),
     main_thread_priority_(main_thread_priority), cleaning_timeout_(std::chrono::seconds{cleaning_timeout_sec}),
     tls_police_file_name_(tls_police_file_name), certificate_file_name_(certificate_file_name), certificate_key_file_name_(certificate_key_file_name)
 {
@@ -109,6 +109,16 @@ void Server_Thread_Config::set_main_thread_priority(int main_thread_priority)
     main_thread_priority_ = main_thread_priority;
 }
 
+uint16_t Server_Thread_Config::shard_count() const
+{
+    return shard_count_;
+}
+
+void Server_Thread_Config::set_shard_count(uint16_t shard_count)
+{
+    shard_count_ = shard_count;
+}
+
 // -------------------------------------------------------------------------------------------------------------------
 
 Server_Thread::Server_Thread(Server_Thread_Config&& conf) :
@@ -181,20 +191,55 @@ void Server_Thread::run(Server_Thread_Config conf)
         io_context_ = new boost::asio::io_context{};
         Tools dtls_tools{ conf.tls_police_file_name(), conf.certificate_file_name(), conf.certificate_key_file_name() };
 
-        Server server(&dtls_tools, io_context_, conf.port(), std::move(conf.create_protocol_func()), conf.cleaning_timeout(), conf.record_thread_count());
+        std::vector<std::unique_ptr<boost::asio::io_context>> shard_contexts;
+        std::vector<boost::asio::io_context*> io_contexts{io_context_};
+        if (Server::is_sharding_supported())
+        {
+            for (uint16_t i = 1; i < conf.shard_count(); ++i)
+            {
+                shard_contexts.emplace_back(new boost::asio::io_context{});
+                io_contexts.push_back(shard_contexts.back().get());
+            }
+        }
+
+        Server server(&dtls_tools, io_contexts, conf.port(), std::move(conf.create_protocol_func()), conf.cleaning_timeout(), conf.record_thread_count());
 
         server_.store(&server);
         promises_->set_value(true);
         delete promises_; promises_ = nullptr;
 
-        boost::asio::ip::udp::endpoint remote_endpoint;
-        server.start_receive(remote_endpoint);
+        server.start_receive();
+
+        if (shard_contexts.empty())
+        {
+            for (uint16_t i = 1; i < conf.receive_thread_count(); ++i)
+            {
+                additional_threads.emplace_back(std::thread{&Server_Thread::run_context, this, io_context_, i});
+            }
+        }
+        else
+        {
+            // One thread per shard, so shard handlers are never run in parallel
+            for (std::size_t i = 0; i < shard_contexts.size(); ++i)
+            {
+                additional_threads.emplace_back(std::thread{&Server_Thread::run_context, this, shard_contexts.at(i).get(), static_cast<uint16_t>(i + 1)});
+            }
+        }
+        run_context(io_context_, 0);
+
+        // Shards must be stopped before server is destroyed
+        for (std::unique_ptr<boost::asio::io_context>& shard_context: shard_contexts)
+        {
+            shard_context->stop();
+        }
 
-        for (uint16_t i = 1; i < conf.receive_thread_count(); ++i)
+        for (std::thread& thread: additional_threads)
         {
-            additional_threads.emplace_back(std::thread{&Server_Thread::run_context, this, i});
+            if (thread.joinable())
+            {
+                thread.join();
+            }
         }
-        run_context(0);
     }
     catch (std::exception& e)
     {
@@ -227,11 +272,11 @@ void Server_Thread::run(Server_Thread_Config conf)
     delete io_context_;
 }
 
-void Server_Thread::run_context(uint16_t thread_number)
+void Server_Thread::run_context(boost::asio::io_context *io_context, uint16_t thread_number)
 {
     try
     {
-        io_context_->run();
+        io_context->run();
     }
     catch (std::exception& e)
     {
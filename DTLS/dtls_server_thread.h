@@ -22,7 +22,7 @@ public:
                          const std::string& certificate_file_name = std::string{},
                          const std::string& certificate_key_file_name = std::string{},
                          uint32_t cleaning_timeout_sec = 3 * 60, uint16_t receive_thread_count = 5,
-                         uint16_t record_thread_count = 5, int main_thread_priority = -1);
+                         uint16_t record_thread_count = 5, int main_thread_priority = -1, uint16_t shard_count = 1);
     Server_Thread_Config(Server_Thread_Config&&) = default;
     Server_Thread_Config(const Server_Thread_Config&) = delete;
 
@@ -53,8 +53,16 @@ public:
     int main_thread_priority() const;
     void set_main_thread_priority(int main_thread_priority);
 
+    /**
+     * @brief shard_count
+     * With more than one shard each of them has own socket, io_context thread and record_thread_count record threads,
+     * receive_thread_count isn't used then. Sharding is used only where Server::is_sharding_supported.
+     */
+    uint16_t shard_count() const;
+    void set_shard_count(uint16_t shard_count);
+
 private:
-    uint16_t port_, receive_thread_count_, record_thread_count_;
+    uint16_t port_, receive_thread_count_, record_thread_count_, shard_count_;
     int main_thread_priority_;
     std::chrono::seconds cleaning_timeout_;
     std::string tls_police_file_name_, certificate_file_name_, certificate_key_file_name_;
@@ -77,7 +85,7 @@ public:
 private:
     void run(Server_Thread_Config conf);
 
-    void run_context(uint16_t thread_number);
+    void run_context(boost::asio::io_context* io_context, uint16_t thread_number);
 
     Thread_Promises* promises_;
 
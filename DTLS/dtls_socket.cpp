@@ -1,4 +1,11 @@
 #include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <array>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
 
 #include <Helpz/net_defs.h>
 #include "dtls_node.h"
@@ -7,16 +14,67 @@
 namespace Helpz {
 namespace DTLS {
 
+#ifdef __linux__
+struct Socket::Receive_Batch
+{
+    explicit Receive_Batch(Buffer_Pool& pool)
+    {
+        for (Buffer_Pool::Buffer& buffer: buffers_)
+            buffer = pool.take(HELPZ_MAX_UDP_PACKET_SIZE);
+    }
+
+    int receive(int fd)
+    {
+        for (std::size_t i = 0; i < HELPZ_SOCKET_BATCH_SIZE; ++i)
+        {
+            iovecs_[i].iov_base = buffers_[i].get();
+            iovecs_[i].iov_len = HELPZ_MAX_UDP_PACKET_SIZE;
+
+            msgs_[i] = mmsghdr{};
+            msgs_[i].msg_hdr.msg_name = &addrs_[i];
+            msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+            msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+        return ::recvmmsg(fd, msgs_.data(), HELPZ_SOCKET_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    }
+
+    udp::endpoint endpoint(std::size_t i) const
+    {
+        udp::endpoint remote_endpoint;
+        std::memcpy(remote_endpoint.data(), &addrs_[i], msgs_[i].msg_hdr.msg_namelen);
+        remote_endpoint.resize(msgs_[i].msg_hdr.msg_namelen);
+        return remote_endpoint;
+    }
+
+    std::array<mmsghdr, HELPZ_SOCKET_BATCH_SIZE> msgs_;
+    std::array<iovec, HELPZ_SOCKET_BATCH_SIZE> iovecs_;
+    std::array<sockaddr_storage, HELPZ_SOCKET_BATCH_SIZE> addrs_;
+    std::array<Buffer_Pool::Buffer, HELPZ_SOCKET_BATCH_SIZE> buffers_;
+};
+#else
+struct Socket::Receive_Batch {};
+#endif
+
 Socket::Socket(boost::asio::io_context *io_context, udp::socket *socket, Controller *controller) :
-    socket_(socket), controller_(controller), io_context_(io_context)
+    socket_(socket), controller_(controller), io_context_(io_context),
+    buffer_pool_(std::make_shared<Buffer_Pool>()), is_batch_mode_(false)
 {
 }
 
+Socket::~Socket() = default;
+
 void Socket::start_receive(udp::endpoint& remote_endpoint)
 {
     if (socket_)
     {
-        std::unique_ptr<uint8_t[]> recv_buffer(new uint8_t[ HELPZ_MAX_UDP_PACKET_SIZE ]);
+        if (is_batch_mode_)
+        {
+            start_batch_receive();
+            return;
+        }
+
+        Buffer_Pool::Buffer recv_buffer = buffer_pool_->take(HELPZ_MAX_UDP_PACKET_SIZE);
         auto buffer = boost::asio::buffer(recv_buffer.get(), HELPZ_MAX_UDP_PACKET_SIZE);
 
         socket_->async_receive_from(
@@ -32,15 +90,25 @@ void Socket::send(const udp::endpoint &remote_endpoint, const uint8_t *data, std
 {
     if (socket_)
     {
-        std::unique_ptr<uint8_t[]> send_buffer(new uint8_t[ size ]);
-        memcpy(send_buffer.get(), data, size);
-        auto buffer = boost::asio::buffer(send_buffer.get(), size);
+        Send_Item item{remote_endpoint, buffer_pool_->take(size), size};
+        memcpy(item.buffer_.get(), data, size);
 
-        socket_->async_send_to(std::move(buffer), remote_endpoint,
-                               std::bind(&Socket::handle_send, this, remote_endpoint,
-                                         std::move(send_buffer), size,
-                                         std::placeholders::_1,   // boost::asio::placeholders::error,
-                                         std::placeholders::_2)); // boost::asio::placeholders::bytes_transferred
+        if (is_batch_mode_)
+        {
+            bool is_first;
+            {
+                std::lock_guard lock(batch_mutex_);
+                is_first = send_queue_.empty();
+                send_queue_.push_back(std::move(item));
+            }
+
+            // Only first datagram posts job, it sends all queued ones
+            if (is_first)
+                io_context_->post(std::bind(&Socket::flush_send_queue, this));
+            return;
+        }
+
+        async_send(std::move(item));
     }
 }
 
@@ -49,7 +117,26 @@ boost::asio::io_context*Socket::get_io_context()
     return io_context_;
 }
 
-void Socket::handle_receive(udp::endpoint& remote_endpoint, std::unique_ptr<uint8_t[]> &data, const boost::system::error_code &err, std::size_t size)
+const std::shared_ptr<Buffer_Pool> &Socket::buffer_pool() const
+{
+    return buffer_pool_;
+}
+
+void Socket::set_batch_mode(bool state)
+{
+#ifdef __linux__
+    is_batch_mode_ = state;
+#else
+    Q_UNUSED(state);
+#endif
+}
+
+bool Socket::is_batch_mode() const
+{
+    return is_batch_mode_;
+}
+
+void Socket::handle_receive(udp::endpoint& remote_endpoint, Buffer_Pool::Buffer &data, const boost::system::error_code &err, std::size_t size)
 {
     if (err)
     {
@@ -57,14 +144,14 @@ void Socket::handle_receive(udp::endpoint& remote_endpoint, std::unique_ptr<uint
         return;
     }
 
-    std::shared_ptr<Node> node = controller_->get_node(remote_endpoint);
+    std::shared_ptr<Node> node = controller_->admit_node(remote_endpoint, data.get(), size);
     remote_endpoint = udp::endpoint();
     if (node)
     {
         std::lock_guard lock(node->mutex_);
         start_receive(remote_endpoint);
 
-        controller_->process_data(node, std::move(data), size);
+        controller_->process_data(node, data.get(), size);
     }
     else
     {
@@ -72,7 +159,28 @@ void Socket::handle_receive(udp::endpoint& remote_endpoint, std::unique_ptr<uint
     }
 }
 
-void Socket::handle_send(const boost::asio::ip::udp::endpoint &remote_endpoint, std::unique_ptr<uint8_t[]> &data, std::size_t size, const boost::system::error_code &error, const std::size_t &bytes_transferred)
+void Socket::process_datagram(const udp::endpoint &remote_endpoint, const uint8_t *data, std::size_t size)
+{
+    std::shared_ptr<Node> node = controller_->admit_node(remote_endpoint, data, size);
+    if (node)
+    {
+        std::lock_guard lock(node->mutex_);
+        controller_->process_data(node, data, size);
+    }
+}
+
+void Socket::async_send(Send_Item &&item)
+{
+    auto buffer = boost::asio::buffer(item.buffer_.get(), item.size_);
+
+    socket_->async_send_to(std::move(buffer), item.endpoint_,
+                           std::bind(&Socket::handle_send, this, item.endpoint_,
+                                     std::move(item.buffer_), item.size_,
+                                     std::placeholders::_1,   // boost::asio::placeholders::error,
+                                     std::placeholders::_2)); // boost::asio::placeholders::bytes_transferred
+}
+
+void Socket::handle_send(const boost::asio::ip::udp::endpoint &remote_endpoint, Buffer_Pool::Buffer &data, std::size_t size, const boost::system::error_code &error, const std::size_t &bytes_transferred)
 {
     if (error.value() != 0)
     {
@@ -96,6 +204,113 @@ void Socket::handle_send(const boost::asio::ip::udp::endpoint &remote_endpoint,
     }
 }
 
+void Socket::start_batch_receive()
+{
+    socket_->async_wait(udp::socket::wait_read, std::bind(&Socket::handle_batch_receive, this, std::placeholders::_1));
+}
+
+void Socket::handle_batch_receive(const boost::system::error_code &err)
+{
+#ifdef __linux__
+    if (err)
+    {
+        error_message(std::string("RECV ERROR ") + err.category().name() + ": " + err.message());
+        return;
+    }
+
+    std::unique_ptr<Receive_Batch> batch;
+    {
+        std::lock_guard lock(batch_mutex_);
+        if (!receive_batches_.empty())
+        {
+            batch = std::move(receive_batches_.back());
+            receive_batches_.pop_back();
+        }
+    }
+    if (!batch)
+        batch.reset(new Receive_Batch{*buffer_pool_});
+
+    const int count = batch->receive(socket_->native_handle());
+    const int receive_errno = errno;
+
+    /* Next batch is received by other thread while this one is processed,
+     * so datagrams of one node from different batches may be processed out of order.
+     * DTLS and protocol accept reordered datagrams.
+     */
+    start_batch_receive();
+
+    if (count < 0)
+    {
+        if (receive_errno != EAGAIN && receive_errno != EWOULDBLOCK && receive_errno != EINTR)
+            error_message(std::string("RECV ERROR ") + std::strerror(receive_errno));
+    }
+
+    for (int i = 0; i < count; ++i)
+        process_datagram(batch->endpoint(i), batch->buffers_[i].get(), batch->msgs_[i].msg_len);
+
+    std::lock_guard lock(batch_mutex_);
+    receive_batches_.push_back(std::move(batch));
+#else
+    Q_UNUSED(err);
+#endif
+}
+
+void Socket::flush_send_queue()
+{
+#ifdef __linux__
+    std::vector<Send_Item> items;
+    {
+        std::lock_guard lock(batch_mutex_);
+        items.swap(send_queue_);
+    }
+
+    std::array<mmsghdr, HELPZ_SOCKET_BATCH_SIZE> msgs;
+    std::array<iovec, HELPZ_SOCKET_BATCH_SIZE> iovecs;
+
+    std::size_t pos = 0;
+    while (pos < items.size())
+    {
+        const std::size_t count = std::min<std::size_t>(HELPZ_SOCKET_BATCH_SIZE, items.size() - pos);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            Send_Item& item = items[pos + i];
+            iovecs[i].iov_base = item.buffer_.get();
+            iovecs[i].iov_len = item.size_;
+
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_name = item.endpoint_.data();
+            msgs[i].msg_hdr.msg_namelen = item.endpoint_.size();
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int sent = ::sendmmsg(socket_->native_handle(), msgs.data(), count, MSG_DONTWAIT);
+        if (sent > 0)
+        {
+            pos += sent;
+            continue;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // Send buffer of socket is full, rest is sent when socket is writable
+            for (; pos < items.size(); ++pos)
+                async_send(std::move(items[pos]));
+            break;
+        }
+
+        // Failed datagram is first one, it's skipped
+        std::stringstream strm;
+        strm << items[pos].endpoint_ << " SEND ERROR " << std::strerror(errno) << " size: " << items[pos].size_;
+        error_message(strm.str());
+        ++pos;
+    }
+#endif
+}
+
 void Socket::error_message(const std::string &msg)
 {
     std::cerr << msg << std::endl;
@@ -2,10 +2,13 @@
 #define HELPZ_DTLS_SOCKET_H
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <boost/asio/ip/udp.hpp>
 
 #include <Helpz/dtls_controller.h>
+#include <Helpz/dtls_buffer_pool.h>
 
 namespace Helpz {
 namespace DTLS {
@@ -16,22 +19,52 @@ public:
     using udp = boost::asio::ip::udp;
 
     Socket(boost::asio::io_context *io_context, udp::socket* socket, Controller* controller);
-    virtual ~Socket() = default;
+    virtual ~Socket();
 
     virtual void start_receive(udp::endpoint& remote_endpoint);
 
     void send(const udp::endpoint& remote_endpoint, const uint8_t* data, std::size_t size);
 
     boost::asio::io_context* get_io_context();
+
+    /**
+     * @brief buffer_pool
+     * Received datagrams, sent records and decrypted records are kept in its buffers.
+     */
+    const std::shared_ptr<Buffer_Pool>& buffer_pool() const;
+
+    /**
+     * @brief set_batch_mode
+     * On Linux datagrams are received by recvmmsg and sent by sendmmsg up to HELPZ_SOCKET_BATCH_SIZE per call.
+     * Sends of one io turn are joined, so they are written by one job posted after the first of them.
+     * Set it before start_receive. On other systems it's ignored.
+     */
+    void set_batch_mode(bool state);
+    bool is_batch_mode() const;
 private:
-    void handle_receive(udp::endpoint &remote_endpoint, std::unique_ptr<uint8_t[]> &data, const boost::system::error_code& err,
+    struct Send_Item
+    {
+        udp::endpoint endpoint_;
+        Buffer_Pool::Buffer buffer_;
+        std::size_t size_;
+    };
+
+    struct Receive_Batch;
+
+    void handle_receive(udp::endpoint &remote_endpoint, Buffer_Pool::Buffer &data, const boost::system::error_code& err,
                         std::size_t size);
+    void process_datagram(const udp::endpoint& remote_endpoint, const uint8_t* data, std::size_t size);
 
+    void async_send(Send_Item&& item);
     void handle_send(const udp::endpoint& remote_endpoint,
-                     std::unique_ptr<uint8_t[]> &data, std::size_t size,
+                     Buffer_Pool::Buffer &data, std::size_t size,
                      const boost::system::error_code& error,
                      const std::size_t & bytes_transferred);
 
+    void start_batch_receive();
+    void handle_batch_receive(const boost::system::error_code& err);
+    void flush_send_queue();
+
 protected:
     virtual void error_message(const std::string& msg);
 
@@ -41,6 +74,12 @@ protected:
 
 private:
     boost::asio::io_context* io_context_;
+    std::shared_ptr<Buffer_Pool> buffer_pool_;
+
+    bool is_batch_mode_;
+    std::mutex batch_mutex_;
+    std::vector<std::unique_ptr<Receive_Batch>> receive_batches_;
+    std::vector<Send_Item> send_queue_;
 };
 
 } // namespace DTLS
@@ -83,11 +83,11 @@ private:
         test_simple_message();
         test_message_with_answer();
     }
-    void process_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    void process_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
     {
         std::cout << "process_message #" << int(msg_id) << ' ' << cmd << " size " << data_dev.size() << std::endl;
     }
-    void process_answer_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    void process_answer_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
     {
         std::cout << "process_answer_message #" << int(msg_id) << ' ' << cmd << " size " << data_dev.size() << std::endl;
     }
@@ -42,7 +42,7 @@ private:
     {
         qDebug().noquote() << title() << "CONNECTED";
     }
-    void process_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    void process_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
     {
         // Maybe you want call server->remove_copy(this); after authentication process done.
 
@@ -57,7 +57,7 @@ private:
             break;
         }
     }
-    void process_answer_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    void process_answer_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
     {
         qDebug().noquote() << title() << "process_answer_message #" << int(msg_id) << cmd << "size" << data_dev.size();
     }
@@ -66,7 +66,7 @@ private:
     {
         qDebug().noquote() << title() << "MSG_SIMPLE" << value1;
     }
-    void process_answered(bool value1, quint32 value2, uint16_t cmd, uint8_t msg_id)
+    void process_answered(bool value1, quint32 value2, uint16_t cmd, uint32_t msg_id)
     {
         qDebug().noquote() << title() << "MSG_ANSWERED" << value1 << "v" << value2;
         send_answer(cmd, msg_id) << QString("OK");
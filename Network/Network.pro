@@ -12,7 +12,22 @@ SOURCES += \
     net_protocol_timer.cpp \
     net_fragmented_message.cpp \
     net_protocol_writer.cpp \
-    net_message_item.cpp
+    net_message_item.cpp \
+    net_ring_buffer.cpp \
+    net_packet_header.cpp \
+    net_waiting_table.cpp \
+    net_codec.cpp \
+    net_crc32c.cpp \
+    net_gap_tracker.cpp \
+    net_mapped_file.cpp \
+    net_message_pool.cpp \
+    net_timing_wheel.cpp \
+    net_rtt_estimator.cpp \
+    net_protocol_stats.cpp \
+    net_send_scheduler.cpp \
+    net_fragment_stream.cpp \
+    net_emulator.cpp \
+    net_fec.cpp
 
 HEADERS += \
     udpclient.h \
@@ -24,10 +39,35 @@ HEADERS += \
     net_defs.h \
     net_fragmented_message.h \
     net_protocol_writer.h \
-    net_message_item.h
+    net_message_item.h \
+    net_ring_buffer.h \
+    net_packet_header.h \
+    net_waiting_table.h \
+    net_codec.h \
+    net_crc32c.h \
+    net_gap_tracker.h \
+    net_mapped_file.h \
+    net_message_pool.h \
+    net_timing_wheel.h \
+    net_rtt_estimator.h \
+    net_protocol_stats.h \
+    net_send_scheduler.h \
+    net_fragment_stream.h \
+    net_emulator.h \
+    net_fec.h
 
 LIBS += -lHelpzBase
 
+CONFIG += link_pkgconfig
+packagesExist(liblz4) {
+    DEFINES += HELPZ_WITH_LZ4
+    PKGCONFIG += liblz4
+}
+packagesExist(libzstd) {
+    DEFINES += HELPZ_WITH_ZSTD
+    PKGCONFIG += libzstd
+}
+
 VER_MAJ = 1
 VER_MIN = 4
 include(../helpz_install.pri)
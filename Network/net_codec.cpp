@@ -0,0 +1,255 @@
+#include <stdexcept>
+
+#include <QtEndian>
+
+#ifdef HELPZ_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HELPZ_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "net_defs.h"
+#include "net_codec.h"
+
+namespace Helpz {
+namespace Net {
+
+// Packet data can't be bigger than UDP packet, so it's limit for uncompressed size too.
+static const uint32_t max_uncompressed_size = HELPZ_MAX_UDP_PACKET_SIZE;
+
+Zlib_Codec::Zlib_Codec(int level) : level_(level) {}
+
+uint8_t Zlib_Codec::type() const { return ZLIB; }
+
+QByteArray Zlib_Codec::compress(uint8_t /*cmd*/, const QByteArray &data) const
+{
+    return qCompress(data, level_);
+}
+
+QByteArray Zlib_Codec::uncompress(uint8_t /*cmd*/, const char *data, uint32_t size) const
+{
+    QByteArray result = qUncompress(reinterpret_cast<const uchar*>(data), static_cast<int>(size));
+    if (result.isEmpty())
+        throw std::runtime_error("Failed uncompress");
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+
+#ifdef HELPZ_WITH_LZ4
+
+bool LZ4_Codec::is_available() { return true; }
+
+uint8_t LZ4_Codec::type() const { return LZ4; }
+
+QByteArray LZ4_Codec::compress(uint8_t /*cmd*/, const QByteArray &data) const
+{
+    QByteArray result;
+    result.resize(4 + LZ4_compressBound(data.size()));
+    qToBigEndian<quint32>(static_cast<quint32>(data.size()), result.data());
+
+    const int size = LZ4_compress_default(data.constData(), result.data() + 4, data.size(), result.size() - 4);
+    if (size <= 0)
+        throw std::runtime_error("Failed LZ4 compress");
+
+    result.resize(4 + size);
+    return result;
+}
+
+QByteArray LZ4_Codec::uncompress(uint8_t /*cmd*/, const char *data, uint32_t size) const
+{
+    if (size < 4)
+        throw std::runtime_error("Failed LZ4 uncompress: too small");
+
+    const uint32_t full_size = qFromBigEndian<quint32>(data);
+    if (full_size == 0 || full_size > max_uncompressed_size)
+        throw std::runtime_error("Failed LZ4 uncompress: bad size");
+
+    QByteArray result;
+    result.resize(static_cast<int>(full_size));
+    const int res = LZ4_decompress_safe(data + 4, result.data(), static_cast<int>(size - 4), result.size());
+    if (res != result.size())
+        throw std::runtime_error("Failed LZ4 uncompress");
+    return result;
+}
+
+#else
+
+bool LZ4_Codec::is_available() { return false; }
+
+uint8_t LZ4_Codec::type() const { return LZ4; }
+
+QByteArray LZ4_Codec::compress(uint8_t /*cmd*/, const QByteArray &/*data*/) const
+{
+    throw std::runtime_error("LZ4 support is not compiled");
+}
+
+QByteArray LZ4_Codec::uncompress(uint8_t /*cmd*/, const char */*data*/, uint32_t /*size*/) const
+{
+    throw std::runtime_error("LZ4 support is not compiled");
+}
+
+#endif // HELPZ_WITH_LZ4
+
+// ---------------------------------------------------------------------------
+
+#ifdef HELPZ_WITH_ZSTD
+
+namespace {
+
+struct Zstd_Context_Deleter
+{
+    void operator ()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    void operator ()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+// Contexts are reused by record thread, creating them for each message is expensive.
+ZSTD_CCtx* zstd_compress_context()
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, Zstd_Context_Deleter> ctx{ZSTD_createCCtx()};
+    return ctx.get();
+}
+
+ZSTD_DCtx* zstd_uncompress_context()
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, Zstd_Context_Deleter> ctx{ZSTD_createDCtx()};
+    return ctx.get();
+}
+
+} // namespace
+
+bool Zstd_Codec::is_available() { return true; }
+
+Zstd_Codec::Zstd_Codec(int level) : level_(level) {}
+
+bool Zstd_Codec::add_dictionary(uint8_t cmd, const QByteArray &dictionary)
+{
+    std::shared_ptr<ZSTD_CDict> cdict{ZSTD_createCDict(dictionary.constData(), dictionary.size(), level_), ZSTD_freeCDict};
+    std::shared_ptr<ZSTD_DDict> ddict{ZSTD_createDDict(dictionary.constData(), dictionary.size()), ZSTD_freeDDict};
+    if (!cdict || !ddict)
+        return false;
+
+    const unsigned dict_id = ZSTD_getDictID_fromDDict(ddict.get());
+    if (dict_id == 0) // Raw content dictionary can't be found by frame
+        return false;
+
+    compress_dicts_[cmd] = std::move(cdict);
+    uncompress_dicts_[dict_id] = std::move(ddict);
+    return true;
+}
+
+uint8_t Zstd_Codec::type() const { return ZSTD; }
+
+QByteArray Zstd_Codec::compress(uint8_t cmd, const QByteArray &data) const
+{
+    QByteArray result;
+    result.resize(static_cast<int>(ZSTD_compressBound(data.size())));
+
+    ZSTD_CCtx* ctx = zstd_compress_context();
+    auto it = compress_dicts_.find(cmd);
+    const std::size_t size = it != compress_dicts_.cend() ?
+                ZSTD_compress_usingCDict(ctx, result.data(), result.size(), data.constData(), data.size(), it->second.get()) :
+                ZSTD_compressCCtx(ctx, result.data(), result.size(), data.constData(), data.size(), level_);
+    if (ZSTD_isError(size))
+        throw std::runtime_error(std::string("Failed Zstd compress: ") + ZSTD_getErrorName(size));
+
+    result.resize(static_cast<int>(size));
+    return result;
+}
+
+QByteArray Zstd_Codec::uncompress(uint8_t /*cmd*/, const char *data, uint32_t size) const
+{
+    const unsigned long long full_size = ZSTD_getFrameContentSize(data, size);
+    if (full_size == ZSTD_CONTENTSIZE_ERROR || full_size == ZSTD_CONTENTSIZE_UNKNOWN
+        || full_size == 0 || full_size > max_uncompressed_size)
+        throw std::runtime_error("Failed Zstd uncompress: bad size");
+
+    const ZSTD_DDict* ddict = nullptr;
+    const unsigned dict_id = ZSTD_getDictID_fromFrame(data, size);
+    if (dict_id)
+    {
+        auto it = uncompress_dicts_.find(dict_id);
+        if (it == uncompress_dicts_.cend())
+            throw std::runtime_error("Failed Zstd uncompress: unknown dictionary " + std::to_string(dict_id));
+        ddict = it->second.get();
+    }
+
+    QByteArray result;
+    result.resize(static_cast<int>(full_size));
+
+    ZSTD_DCtx* ctx = zstd_uncompress_context();
+    const std::size_t res = ddict ?
+                ZSTD_decompress_usingDDict(ctx, result.data(), result.size(), data, size, ddict) :
+                ZSTD_decompressDCtx(ctx, result.data(), result.size(), data, size);
+    if (ZSTD_isError(res) || res != full_size)
+        throw std::runtime_error("Failed Zstd uncompress");
+    return result;
+}
+
+#else
+
+bool Zstd_Codec::is_available() { return false; }
+
+Zstd_Codec::Zstd_Codec(int level) : level_(level) {}
+
+bool Zstd_Codec::add_dictionary(uint8_t /*cmd*/, const QByteArray &/*dictionary*/) { return false; }
+
+uint8_t Zstd_Codec::type() const { return ZSTD; }
+
+QByteArray Zstd_Codec::compress(uint8_t /*cmd*/, const QByteArray &/*data*/) const
+{
+    throw std::runtime_error("Zstd support is not compiled");
+}
+
+QByteArray Zstd_Codec::uncompress(uint8_t /*cmd*/, const char */*data*/, uint32_t /*size*/) const
+{
+    throw std::runtime_error("Zstd support is not compiled");
+}
+
+#endif // HELPZ_WITH_ZSTD
+
+// ---------------------------------------------------------------------------
+
+Codec_Registry::Codec_Registry()
+{
+    add(std::make_shared<Zlib_Codec>());
+}
+
+/*static*/ std::shared_ptr<Codec_Registry> Codec_Registry::default_registry()
+{
+    static std::shared_ptr<Codec_Registry> registry = []()
+    {
+        auto reg = std::make_shared<Codec_Registry>();
+        if (LZ4_Codec::is_available())
+            reg->add(std::make_shared<LZ4_Codec>());
+        if (Zstd_Codec::is_available())
+            reg->add(std::make_shared<Zstd_Codec>());
+        return reg;
+    }();
+    return registry;
+}
+
+void Codec_Registry::add(std::shared_ptr<Codec> codec)
+{
+    if (codec && codec->type() <= Codec::MAX_TYPE)
+        codecs_[codec->type()] = std::move(codec);
+}
+
+const Codec *Codec_Registry::get(uint8_t type) const
+{
+    return type <= Codec::MAX_TYPE ? codecs_[type].get() : nullptr;
+}
+
+uint8_t Codec_Registry::mask() const
+{
+    uint8_t mask = 0;
+    for (uint8_t type = 0; type <= Codec::MAX_TYPE; ++type)
+        if (codecs_[type])
+            mask |= 1 << type;
+    return mask;
+}
+
+} // namespace Net
+} // namespace Helpz
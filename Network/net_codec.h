@@ -0,0 +1,137 @@
+#ifndef HELPZ_NETWORK_CODEC_H
+#define HELPZ_NETWORK_CODEC_H
+
+#include <map>
+#include <memory>
+#include <cstdint>
+
+#include <QByteArray>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Codec class
+ *
+ * Payload compression algorithm. Codec type is sent in extended header,
+ * so it must be the same on both sides and fit in 3 bits.
+ * Codec must be thread safe, it's shared between connections.
+ */
+class Codec
+{
+public:
+    enum Type : uint8_t {
+        ZLIB = 0,
+        LZ4,
+        ZSTD,
+
+        MAX_TYPE = 7
+    };
+
+    virtual ~Codec() = default;
+
+    virtual uint8_t type() const = 0;
+    virtual QByteArray compress(uint8_t cmd, const QByteArray& data) const = 0;
+
+    /**
+     * @brief uncompress
+     * Throws std::runtime_error if data is corrupt.
+     */
+    virtual QByteArray uncompress(uint8_t cmd, const char* data, uint32_t size) const = 0;
+};
+
+/**
+ * @brief The Zlib_Codec class
+ * qCompress format, used by version 1 packets and when peer doesn't support selected codec.
+ */
+class Zlib_Codec : public Codec
+{
+public:
+    explicit Zlib_Codec(int level = -1);
+
+    uint8_t type() const override;
+    QByteArray compress(uint8_t cmd, const QByteArray& data) const override;
+    QByteArray uncompress(uint8_t cmd, const char* data, uint32_t size) const override;
+private:
+    int level_;
+};
+
+/**
+ * @brief The LZ4_Codec class
+ * [4bytes uncompressed size][LZ4 block]
+ * Fast, for latency sensitive commands. Available if built with HELPZ_WITH_LZ4.
+ */
+class LZ4_Codec : public Codec
+{
+public:
+    static bool is_available();
+
+    uint8_t type() const override;
+    QByteArray compress(uint8_t cmd, const QByteArray& data) const override;
+    QByteArray uncompress(uint8_t cmd, const char* data, uint32_t size) const override;
+};
+
+/**
+ * @brief The Zstd_Codec class
+ * Zstandard frame. Message is compressed with dictionary of it's command if it is added.
+ * Dictionary is found by id from frame on receive, so both sides must add the same dictionaries.
+ * Available if built with HELPZ_WITH_ZSTD.
+ */
+class Zstd_Codec : public Codec
+{
+public:
+    static bool is_available();
+
+    explicit Zstd_Codec(int level = 3);
+
+    /**
+     * @brief add_dictionary
+     * Dictionary trained by "zstd --train". Not thread safe, call before codec is used.
+     * @return false if dictionary is invalid
+     */
+    bool add_dictionary(uint8_t cmd, const QByteArray& dictionary);
+
+    uint8_t type() const override;
+    QByteArray compress(uint8_t cmd, const QByteArray& data) const override;
+    QByteArray uncompress(uint8_t cmd, const char* data, uint32_t size) const override;
+private:
+    int level_;
+    std::map<uint8_t, std::shared_ptr<ZSTD_CDict_s>> compress_dicts_;
+    std::map<unsigned, std::shared_ptr<ZSTD_DDict_s>> uncompress_dicts_;
+};
+
+/**
+ * @brief The Codec_Registry class
+ * Set of codecs which Protocol can use. Zlib is always present.
+ * Not thread safe for changes, fill it before connections use it.
+ */
+class Codec_Registry
+{
+public:
+    Codec_Registry();
+
+    /**
+     * @brief default_registry
+     * Zlib and all compiled in codecs without dictionaries.
+     */
+    static std::shared_ptr<Codec_Registry> default_registry();
+
+    void add(std::shared_ptr<Codec> codec);
+    const Codec* get(uint8_t type) const;
+
+    /**
+     * @brief mask
+     * Bit per codec type, sent to peer when connection is negotiated.
+     */
+    uint8_t mask() const;
+private:
+    std::shared_ptr<Codec> codecs_[Codec::MAX_TYPE + 1];
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_CODEC_H
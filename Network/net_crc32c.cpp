@@ -0,0 +1,121 @@
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define HELPZ_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HELPZ_CRC32C_ARM
+#endif
+
+#include "net_crc32c.h"
+
+namespace Helpz {
+namespace Net {
+
+namespace {
+
+struct Crc32c_Table
+{
+    uint32_t data_[8][256];
+
+    Crc32c_Table()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j)
+                crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+            data_[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; ++i)
+            for (int k = 1; k < 8; ++k)
+                data_[k][i] = (data_[k - 1][i] >> 8) ^ data_[0][data_[k - 1][i] & 0xff];
+    }
+};
+
+const Crc32c_Table& crc32c_table()
+{
+    static const Crc32c_Table table;
+    return table;
+}
+
+#ifdef HELPZ_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hardware(const uint8_t* data, std::size_t size, uint32_t crc)
+{
+    uint64_t crc64 = ~crc;
+    uint64_t value;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+
+    uint32_t crc32 = static_cast<uint32_t>(crc64);
+    for (; size; --size, ++data)
+        crc32 = _mm_crc32_u8(crc32, *data);
+    return ~crc32;
+}
+
+bool check_hardware() { return __builtin_cpu_supports("sse4.2"); }
+#elif defined(HELPZ_CRC32C_ARM)
+uint32_t crc32c_hardware(const uint8_t* data, std::size_t size, uint32_t crc)
+{
+    crc = ~crc;
+    uint64_t value;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        memcpy(&value, data, 8);
+        crc = __crc32cd(crc, value);
+    }
+
+    for (; size; --size, ++data)
+        crc = __crc32cb(crc, *data);
+    return ~crc;
+}
+
+bool check_hardware() { return true; }
+#else
+uint32_t crc32c_hardware(const uint8_t* data, std::size_t size, uint32_t crc)
+{
+    return crc32c_software(data, size, crc);
+}
+
+bool check_hardware() { return false; }
+#endif
+
+} // namespace
+
+uint32_t crc32c_software(const uint8_t *data, std::size_t size, uint32_t crc)
+{
+    const uint32_t (&t)[8][256] = crc32c_table().data_;
+    crc = ~crc;
+
+    // Slicing-by-8, lower word is xored with crc in little endian order
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        const uint32_t low = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+
+    for (; size; --size, ++data)
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+    return ~crc;
+}
+
+bool is_crc32c_hardware()
+{
+    static const bool is_hardware = check_hardware();
+    return is_hardware;
+}
+
+uint32_t crc32c(const uint8_t *data, std::size_t size, uint32_t crc)
+{
+    return is_crc32c_hardware() ? crc32c_hardware(data, size, crc) : crc32c_software(data, size, crc);
+}
+
+} // namespace Net
+} // namespace Helpz
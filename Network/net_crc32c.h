@@ -0,0 +1,29 @@
+#ifndef HELPZ_NETWORK_CRC32C_H
+#define HELPZ_NETWORK_CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief crc32c
+ * CRC-32C (Castagnoli). Uses SSE4.2 or ARMv8 crc instructions when available,
+ * else slicing-by-8 tables.
+ * @param crc result of previous call to continue calculation
+ */
+uint32_t crc32c(const uint8_t* data, std::size_t size, uint32_t crc = 0);
+
+/**
+ * @brief crc32c_software
+ * Table implementation, for tests and benchmark.
+ */
+uint32_t crc32c_software(const uint8_t* data, std::size_t size, uint32_t crc = 0);
+
+bool is_crc32c_hardware();
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_CRC32C_H
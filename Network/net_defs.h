@@ -8,4 +8,45 @@
 
 #define HELPZ_PROTOCOL_MAX_MESSAGE_SIZE 2147483648
 
+#define HELPZ_PROTOCOL_RECEIVE_BUFFER_SIZE (HELPZ_MAX_UDP_PACKET_SIZE * 2)
+
+#define HELPZ_PROTOCOL_WINDOW_SIZE 1024
+#define HELPZ_PROTOCOL_FIRST_EXTENDED_ID 256
+#define HELPZ_PROTOCOL_MAX_ACK_RANGES 32
+#define HELPZ_PROTOCOL_MAX_FRAGMENT_WINDOW 64
+#define HELPZ_PROTOCOL_STREAM_SHIFT 24
+#define HELPZ_PROTOCOL_FEC_MAX_GROUP 32
+#define HELPZ_PROTOCOL_FEC_MIN_LOSS 0.005
+
+#define HELPZ_PROTOCOL_COALESCE_SIZE 1200
+
+#define HELPZ_PROTOCOL_TIMER_TICK 10
+#define HELPZ_PROTOCOL_INITIAL_RTO 3000
+#define HELPZ_PROTOCOL_MIN_RTO 200
+#define HELPZ_PROTOCOL_MAX_RTO 60000
+
+#define HELPZ_PROTOCOL_POOL_SIZE 256
+#define HELPZ_PROTOCOL_POOL_BUFFER_SIZE 512
+#define HELPZ_PROTOCOL_POOL_MAX_BUFFER_SIZE 65536
+
+#define HELPZ_PROTOCOL_INTERACTIVE_WEIGHT 16
+#define HELPZ_PROTOCOL_NORMAL_WEIGHT 4
+#define HELPZ_PROTOCOL_BULK_WEIGHT 1
+#define HELPZ_PROTOCOL_BUSY_FRAGMENT_SIZE 1200
+
+#define HELPZ_SOCKET_BUFFER_SIZE 2048
+#define HELPZ_SOCKET_SLAB_SIZE 64
+#define HELPZ_SOCKET_LARGE_POOL_SIZE 32
+#define HELPZ_SOCKET_RECORD_BUFFER_SIZE (16 * 1024 + 256)
+#define HELPZ_SOCKET_RECORD_POOL_SIZE 256
+#define HELPZ_SOCKET_BATCH_SIZE 16
+
+#define HELPZ_SERVER_CLIENT_SHARD_COUNT 64
+#define HELPZ_SERVER_RECORD_BUDGET 16
+
+#define HELPZ_SERVER_COOKIE_ROTATE_SEC 60
+#define HELPZ_SERVER_NEW_CLIENT_RATE 20
+#define HELPZ_SERVER_NEW_CLIENT_BURST 40
+#define HELPZ_SERVER_RATE_SLOT_COUNT 4096
+
 #endif // HELPZ_NET_DEFS_H
@@ -0,0 +1,200 @@
+#include <algorithm>
+
+#include "net_emulator.h"
+
+namespace Helpz {
+namespace Net {
+
+Emulator::Link::Link(Emulator *emulator, const Link_Config &config) :
+    emulator_(emulator), config_(config), busy_until_(emulator->now())
+{
+}
+
+const Emulator::Link_Config &Emulator::Link::config() const { return config_; }
+void Emulator::Link::set_config(const Link_Config &config) { config_ = config; }
+const Emulator::Link_Stats &Emulator::Link::stats() const { return stats_; }
+
+void Emulator::Link::write(const QByteArray &data)
+{
+    transmit(data);
+}
+
+void Emulator::Link::write(std::shared_ptr<Message_Item> message)
+{
+    std::shared_ptr<Protocol> proto = protocol();
+    if (!proto)
+        return;
+
+    buffer_.resize(0);
+    if (proto->prepare_packet_to_send(std::move(message), buffer_))
+        transmit(buffer_);
+}
+
+void Emulator::Link::add_timeout_at(std::chrono::system_clock::time_point time_point, void *data)
+{
+    auto it = timers_.find(data);
+    if (it != timers_.end())
+    {
+        if (it->second <= time_point)
+            return;
+        it->second = time_point;
+    }
+    else
+        timers_.emplace(data, time_point);
+
+    std::weak_ptr<Link> weak = weak_from_this();
+    emulator_->schedule(time_point, [weak, time_point, data]()
+    {
+        if (std::shared_ptr<Link> link = weak.lock())
+            link->on_timeout(time_point, data);
+    });
+}
+
+std::shared_ptr<Protocol> Emulator::Link::protocol() { return protocol_.lock(); }
+
+void Emulator::Link::transmit(const QByteArray &data)
+{
+    ++stats_.packets_;
+    stats_.bytes_ += data.size();
+
+    // Link is busy while previous packets are serialized, lost packets take it too
+    Time_Point send_time = std::max(emulator_->now(), busy_until_);
+    if (config_.bandwidth_)
+        send_time += std::chrono::duration_cast<Duration>(std::chrono::microseconds(data.size() * 1000000 / config_.bandwidth_));
+    busy_until_ = send_time;
+
+    if (config_.loss_ > 0. && emulator_->random() < config_.loss_)
+    {
+        ++stats_.dropped_;
+        return;
+    }
+
+    int count = 1;
+    if (config_.duplicate_ > 0. && emulator_->random() < config_.duplicate_)
+    {
+        ++stats_.duplicated_;
+        ++count;
+    }
+
+    std::weak_ptr<Link> weak = weak_from_this();
+    for (int i = 0; i < count; ++i)
+    {
+        Duration delay = config_.latency_;
+        if (config_.jitter_.count() > 0)
+            delay += std::chrono::duration_cast<Duration>(config_.jitter_ * emulator_->random());
+        if (config_.reorder_ > 0. && emulator_->random() < config_.reorder_)
+        {
+            ++stats_.reordered_;
+            delay += std::max<Duration>(config_.latency_, std::chrono::milliseconds(1));
+        }
+
+        emulator_->schedule(send_time + delay, [weak, data]()
+        {
+            if (std::shared_ptr<Link> link = weak.lock())
+                link->deliver(data);
+        });
+    }
+}
+
+void Emulator::Link::deliver(const QByteArray &data)
+{
+    if (std::shared_ptr<Protocol> peer = peer_.lock())
+        peer->process_bytes(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+}
+
+void Emulator::Link::on_timeout(Time_Point time_point, void *data)
+{
+    // Timer was moved to earlier time and this event is stale
+    auto it = timers_.find(data);
+    if (it == timers_.end() || it->second != time_point)
+        return;
+    timers_.erase(it);
+
+    if (std::shared_ptr<Protocol> proto = protocol())
+        proto->process_wait_list(data);
+}
+
+bool Emulator::Event::operator >(const Event &other) const
+{
+    return time_point_ != other.time_point_ ? time_point_ > other.time_point_ : seq_ > other.seq_;
+}
+
+Emulator::Emulator(uint32_t seed) :
+    now_(std::chrono::hours(24)), next_seq_(0), random_(seed)
+{
+}
+
+Emulator::Time_Point Emulator::now() const { return now_; }
+
+std::pair<std::shared_ptr<Emulator::Link>, std::shared_ptr<Emulator::Link>> Emulator::connect(
+        std::shared_ptr<Protocol> a, std::shared_ptr<Protocol> b, const Link_Config &a_to_b, const Link_Config &b_to_a)
+{
+    auto a_link = std::make_shared<Link>(this, a_to_b);
+    auto b_link = std::make_shared<Link>(this, b_to_a);
+    a_link->protocol_ = a;
+    a_link->peer_ = b;
+    b_link->protocol_ = b;
+    b_link->peer_ = a;
+
+    a_link->set_title("emulator_a");
+    b_link->set_title("emulator_b");
+
+    auto clock = [this]() { return now_; };
+    a->set_clock(clock);
+    b->set_clock(clock);
+    a->set_writer(a_link);
+    b->set_writer(b_link);
+    return {a_link, b_link};
+}
+
+void Emulator::schedule(Time_Point time_point, std::function<void()> func)
+{
+    events_.push(Event{std::max(time_point, now_), next_seq_++, std::move(func)});
+}
+
+bool Emulator::run_once()
+{
+    if (events_.empty())
+        return false;
+
+    Event event = events_.top();
+    events_.pop();
+    now_ = event.time_point_;
+    event.func_();
+    return true;
+}
+
+void Emulator::run_until(Time_Point time_point)
+{
+    while (!events_.empty() && events_.top().time_point_ <= time_point)
+        run_once();
+    now_ = std::max(now_, time_point);
+}
+
+void Emulator::run_for(Duration duration)
+{
+    run_until(now_ + duration);
+}
+
+bool Emulator::run_while(std::function<bool()> condition, Duration limit)
+{
+    const Time_Point end_time = now_ + limit;
+    while (condition())
+    {
+        if (events_.empty() || events_.top().time_point_ > end_time)
+            return false;
+        run_once();
+    }
+    return true;
+}
+
+std::size_t Emulator::pending_events() const { return events_.size(); }
+
+double Emulator::random()
+{
+    // Own conversion instead of std distributions, their results differ between standard libraries
+    return (random_() >> 11) * (1. / 9007199254740992.);
+}
+
+} // namespace Net
+} // namespace Helpz
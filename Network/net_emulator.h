@@ -0,0 +1,154 @@
+#ifndef HELPZ_NETWORK_EMULATOR_H
+#define HELPZ_NETWORK_EMULATOR_H
+
+#include <map>
+#include <queue>
+#include <random>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <Helpz/net_protocol.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Emulator class
+ *
+ * Deterministic in-process network for Protocol. Time is virtual: it moves only when
+ * next event is processed, so long transfers with losses are emulated in milliseconds
+ * and same seed always gives same result. Not thread safe, everything runs in caller thread.
+ * Connected protocols use its clock, so emulator must live longer than they are used.
+ */
+class Emulator
+{
+public:
+    typedef Protocol::Time_Point Time_Point;
+    typedef Time_Point::duration Duration;
+
+    struct Link_Config
+    {
+        double loss_ = 0.;
+        double duplicate_ = 0.;
+
+        /**
+         * Part of packets which get one more latency, so they come after next ones.
+         */
+        double reorder_ = 0.;
+
+        std::chrono::microseconds latency_{0};
+
+        /**
+         * Uniform random delay from zero to jitter is added to latency.
+         */
+        std::chrono::microseconds jitter_{0};
+
+        /**
+         * Bytes per second, zero is unlimited. Packets wait in queue while link is busy.
+         */
+        uint64_t bandwidth_ = 0;
+    };
+
+    struct Link_Stats
+    {
+        uint64_t packets_ = 0, bytes_ = 0;
+        uint64_t dropped_ = 0, duplicated_ = 0, reordered_ = 0;
+    };
+
+    /**
+     * @brief The Link class
+     * Writer of one direction, it's set to sending protocol by connect.
+     */
+    class Link : public Protocol_Writer, public std::enable_shared_from_this<Link>
+    {
+    public:
+        Link(Emulator* emulator, const Link_Config& config);
+
+        const Link_Config& config() const;
+        void set_config(const Link_Config& config);
+        const Link_Stats& stats() const;
+
+        void write(const QByteArray& data) override;
+        void write(std::shared_ptr<Message_Item> message) override;
+        void add_timeout_at(std::chrono::system_clock::time_point time_point, void* data = nullptr) override;
+        std::shared_ptr<Protocol> protocol() override;
+
+    private:
+        void transmit(const QByteArray& data);
+        void deliver(const QByteArray& data);
+        void on_timeout(Time_Point time_point, void* data);
+
+        Emulator* emulator_;
+        Link_Config config_;
+        Link_Stats stats_;
+        Time_Point busy_until_;
+        QByteArray buffer_;
+
+        // Timer is unique by data and keeps earlier time point, same as Protocol_Timer
+        std::map<void*, Time_Point> timers_;
+
+        std::weak_ptr<Protocol> protocol_, peer_;
+        friend class Emulator;
+    };
+
+    explicit Emulator(uint32_t seed = 1);
+    Emulator(const Emulator&) = delete;
+    Emulator& operator =(const Emulator&) = delete;
+
+    Time_Point now() const;
+
+    /**
+     * @brief connect
+     * Set writers and virtual clock to both protocols.
+     * @return links from a to b and from b to a
+     */
+    std::pair<std::shared_ptr<Link>, std::shared_ptr<Link>> connect(std::shared_ptr<Protocol> a, std::shared_ptr<Protocol> b,
+                                                                     const Link_Config& a_to_b, const Link_Config& b_to_a);
+
+    /**
+     * @brief schedule
+     * Call func at virtual time point, events of same time are called in order of scheduling.
+     */
+    void schedule(Time_Point time_point, std::function<void()> func);
+
+    /**
+     * @brief run_once
+     * Move time to next event and process it.
+     * @return false if there are no events
+     */
+    bool run_once();
+    void run_until(Time_Point time_point);
+    void run_for(Duration duration);
+
+    /**
+     * @brief run_while
+     * Process events while condition is true and time is less than limit.
+     * @return true if condition became false
+     */
+    bool run_while(std::function<bool()> condition, Duration limit);
+
+    std::size_t pending_events() const;
+
+    double random();
+
+private:
+    struct Event
+    {
+        Time_Point time_point_;
+        uint64_t seq_;
+        std::function<void()> func_;
+
+        bool operator >(const Event& other) const;
+    };
+
+    Time_Point now_;
+    uint64_t next_seq_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+    std::mt19937_64 random_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_EMULATOR_H
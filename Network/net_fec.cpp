@@ -0,0 +1,44 @@
+#include <algorithm>
+
+#include "net_fec.h"
+
+namespace Helpz {
+namespace Net {
+
+Fec_Estimator::Fec_Estimator() :
+    loss_(0.)
+{
+}
+
+void Fec_Estimator::add(bool is_lost, uint32_t count)
+{
+    const double sample = is_lost ? 1. : 0.;
+    for (uint32_t i = 0; i < count; ++i)
+        loss_ += (sample - loss_) / 64.;
+}
+
+void Fec_Estimator::reset() { loss_ = 0.; }
+
+double Fec_Estimator::loss() const { return loss_; }
+
+uint8_t Fec_Estimator::group_size() const
+{
+    if (loss_ < HELPZ_PROTOCOL_FEC_MIN_LOSS)
+        return 0;
+
+    const double group = 1. / (4. * loss_);
+    return static_cast<uint8_t>(std::clamp<double>(group, 2., HELPZ_PROTOCOL_FEC_MAX_GROUP));
+}
+
+void fec_xor(QByteArray &parity, const char *data, uint32_t size)
+{
+    if (static_cast<uint32_t>(parity.size()) < size)
+        parity.append(QByteArray(size - parity.size(), '\0'));
+
+    char* parity_data = parity.data();
+    for (uint32_t i = 0; i < size; ++i)
+        parity_data[i] ^= data[i];
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,52 @@
+#ifndef HELPZ_NETWORK_FEC_H
+#define HELPZ_NETWORK_FEC_H
+
+#include <cstdint>
+
+#include <QByteArray>
+
+#include <Helpz/net_defs.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Fec_Estimator class
+ *
+ * Loss of requested fragment parts seen by receiver and size of parity group chosen from it.
+ * Loss is moving average with weight 1/64 of each part. One XOR parity part restores
+ * one lost part of group, so group of N = 1 / (4 * loss) parts loses about quarter of part,
+ * it's limited by 2 and HELPZ_PROTOCOL_FEC_MAX_GROUP. While loss is less than
+ * HELPZ_PROTOCOL_FEC_MIN_LOSS parity isn't requested.
+ * Not thread safe, it's used from receive path of Protocol.
+ */
+class Fec_Estimator
+{
+public:
+    Fec_Estimator();
+
+    void add(bool is_lost, uint32_t count = 1);
+    void reset();
+
+    double loss() const;
+
+    /**
+     * @brief group_size
+     * @return count of data parts for one parity part, zero if parity isn't needed
+     */
+    uint8_t group_size() const;
+
+private:
+    double loss_;
+};
+
+/**
+ * @brief fec_xor
+ * XOR data into parity, parity is padded by zeroes up to size.
+ */
+void fec_xor(QByteArray& parity, const char* data, uint32_t size);
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_FEC_H
@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "net_fragment_stream.h"
+
+namespace Helpz {
+namespace Net {
+
+Fragment_Stream::Fragment_Stream(uint32_t full_size) :
+    source_(nullptr), full_size_(full_size), received_size_(0), read_pos_(0)
+{
+    // Without buffer bytesAvailable is exactly not read part of received data
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+uint32_t Fragment_Stream::full_size() const { return full_size_; }
+uint32_t Fragment_Stream::received_size() const { return received_size_; }
+bool Fragment_Stream::is_finished() const { return received_size_ >= full_size_; }
+
+bool Fragment_Stream::isSequential() const { return true; }
+
+qint64 Fragment_Stream::bytesAvailable() const
+{
+    return received_size_ - read_pos_;
+}
+
+bool Fragment_Stream::atEnd() const
+{
+    return read_pos_ >= full_size_;
+}
+
+bool Fragment_Stream::set_received(QIODevice *source, uint32_t received_size)
+{
+    source_ = source;
+    if (received_size <= received_size_)
+        return false;
+
+    received_size_ = std::min(received_size, full_size_);
+    return true;
+}
+
+qint64 Fragment_Stream::readData(char *data, qint64 max_size)
+{
+    const qint64 size = std::min<qint64>(max_size, received_size_ - read_pos_);
+    if (size <= 0 || !source_)
+        return 0;
+
+    if (!source_->seek(read_pos_))
+        return -1;
+
+    const qint64 read_size = source_->read(data, size);
+    if (read_size > 0)
+        read_pos_ += static_cast<uint32_t>(read_size);
+    return read_size;
+}
+
+qint64 Fragment_Stream::writeData(const char */*data*/, qint64 /*max_size*/)
+{
+    return -1;
+}
+
+} // namespace Net
+} // namespace Helpz
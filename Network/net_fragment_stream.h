@@ -0,0 +1,48 @@
+#ifndef HELPZ_NETWORK_FRAGMENT_STREAM_H
+#define HELPZ_NETWORK_FRAGMENT_STREAM_H
+
+#include <QIODevice>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Fragment_Stream class
+ *
+ * Sequential read only view of fragmented message which is still received.
+ * Only received data from the beginning can be read, bytesAvailable() grows as gaps are filled.
+ * Device is valid only in Protocol::process_stream_message call.
+ */
+class Fragment_Stream : public QIODevice
+{
+public:
+    explicit Fragment_Stream(uint32_t full_size);
+
+    uint32_t full_size() const;
+    uint32_t received_size() const;
+    bool is_finished() const;
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    bool atEnd() const override;
+
+    /**
+     * @brief set_received
+     * Used by Protocol: source has all data before received_size.
+     * @return true if there is new data
+     */
+    bool set_received(QIODevice* source, uint32_t received_size);
+
+protected:
+    qint64 readData(char* data, qint64 max_size) override;
+    qint64 writeData(const char* data, qint64 max_size) override;
+
+private:
+    QIODevice* source_;
+    uint32_t full_size_, received_size_, read_pos_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_FRAGMENT_STREAM_H
@@ -1,15 +1,20 @@
+#include <algorithm>
+#include <cstring>
+
 #include <QDir>
 #include <QDateTime>
 #include <QBuffer>
 
 #include "net_protocol.h"
+#include "net_fec.h"
 #include "net_fragmented_message.h"
 
 namespace Helpz {
 namespace Net {
 
-Fragmented_Message::Fragmented_Message(uint8_t id, uint8_t cmd, uint32_t max_fragment_size, uint32_t full_size) :
-    id_(id), cmd_(cmd), max_fragment_size_(max_fragment_size)
+Fragmented_Message::Fragmented_Message(uint32_t id, uint8_t cmd, uint32_t max_fragment_size, uint32_t full_size) :
+    id_(id), cmd_(cmd), is_extended_(false), max_fragment_size_(max_fragment_size), full_size_(full_size),
+    window_(2), in_flight_(0), requested_pos_(0), parts_(full_size)
 {
     if (full_size < 1000000)
     {
@@ -17,18 +22,27 @@ Fragmented_Message::Fragmented_Message(uint8_t id, uint8_t cmd, uint32_t max_fra
     }
     else
     {
-        QString file_name = QDir::tempPath() + "/helpz_net_proto_" + QString::number(QDateTime::currentMSecsSinceEpoch()) + '_' + QString::number(id) + ".dat";
-        auto file = new QFile(file_name);
-        file->setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
-        data_device_ = file;
+        const QString name = "helpz_net_proto_" + QString::number(QDateTime::currentMSecsSinceEpoch()) + '_' + QString::number(id);
+        mapped_file_ = Mapped_File::create(full_size, name);
+        if (mapped_file_)
+        {
+            QBuffer* buffer = new QBuffer;
+            buffer->setData(QByteArray::fromRawData(mapped_file_->data(), static_cast<int>(mapped_file_->size())));
+            data_device_ = buffer;
+        }
+        else
+        {
+            auto file = new QFile(QDir::tempPath() + '/' + name + ".dat");
+            file->setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+            data_device_ = file;
+        }
     }
-
-    part_vect_.push_back(std::pair<uint32_t,uint32_t>(0, full_size));
 }
 
 Fragmented_Message::Fragmented_Message(Fragmented_Message&& o) :
-    id_(std::move(o.id_)), cmd_(std::move(o.cmd_)), max_fragment_size_(std::move(o.max_fragment_size_)),
-    data_device_(std::move(o.data_device_)), last_part_time_(std::move(o.last_part_time_)), part_vect_(std::move(o.part_vect_))
+    id_(std::move(o.id_)), cmd_(std::move(o.cmd_)), is_extended_(o.is_extended_), max_fragment_size_(std::move(o.max_fragment_size_)), full_size_(o.full_size_),
+    mapped_file_(std::move(o.mapped_file_)), data_device_(std::move(o.data_device_)), stream_(std::move(o.stream_)),
+    window_(o.window_), in_flight_(o.in_flight_), requested_pos_(o.requested_pos_), last_part_time_(std::move(o.last_part_time_)), parts_(std::move(o.parts_))
 {
     o.data_device_ = nullptr;
 }
@@ -37,16 +51,24 @@ Fragmented_Message& Fragmented_Message::operator =(Fragmented_Message&& o)
 {
     id_ = std::move(o.id_);
     cmd_ = std::move(o.cmd_);
+    is_extended_ = o.is_extended_;
     max_fragment_size_ = std::move(o.max_fragment_size_);
-    data_device_ = std::move(o.data_device_);
-    o.data_device_ = nullptr;
+    full_size_ = o.full_size_;
+    std::swap(mapped_file_, o.mapped_file_);
+    std::swap(data_device_, o.data_device_);
+    std::swap(stream_, o.stream_);
+    window_ = o.window_;
+    in_flight_ = o.in_flight_;
+    requested_pos_ = o.requested_pos_;
     last_part_time_ = std::move(o.last_part_time_);
-    part_vect_ = std::move(o.part_vect_);
+    parts_ = std::move(o.parts_);
     return *this;
 }
 
 Fragmented_Message::~Fragmented_Message()
 {
+    stream_.reset();
+
     if (data_device_)
     {
         data_device_->close();
@@ -60,136 +82,86 @@ Fragmented_Message::~Fragmented_Message()
 }
 
 bool Fragmented_Message::operator <(const Fragmented_Message &o) const { return id_ < o.id_; }
-bool Fragmented_Message::operator <(uint8_t id) const { return id_ < id; }
-bool Fragmented_Message::operator ==(uint8_t id) const { return id_ == id; }
+bool Fragmented_Message::operator <(uint32_t id) const { return id_ < id; }
+bool Fragmented_Message::operator ==(uint32_t id) const { return id_ == id; }
 
 void Fragmented_Message::add_data(uint32_t pos, const char *data, uint32_t len)
 {
-    remove_from_part_vect(pos, pos + len);
+    parts_.remove(pos, pos + len);
 
-    data_device_->seek(pos);
-    data_device_->write(data, len);
+    if (mapped_file_)
+    {
+        if (pos < mapped_file_->size())
+            memcpy(mapped_file_->data() + pos, data, std::min(len, mapped_file_->size() - pos));
+    }
+    else
+    {
+        data_device_->seek(pos);
+        data_device_->write(data, len);
+    }
 }
 
-void Fragmented_Message::remove_from_part_vect(uint32_t new_part_start, uint32_t new_part_end)
+bool Fragmented_Message::add_parity(const std::vector<QPair<uint32_t, uint32_t>> &parts, const char *parity, uint32_t parity_size)
 {
-    for (auto it = part_vect_.begin(); it != part_vect_.end(); )
+    const QPair<uint32_t, uint32_t>* lost_part = nullptr;
+    for (const QPair<uint32_t, uint32_t>& part: parts)
     {
-        // Если вся часть до текущей в списке
-        if (new_part_end <= it->first)
-            break;
+        if (part.first >= full_size_ || part.second > full_size_ - part.first || part.second > parity_size)
+            return false;
 
-        // Если часть после текущей в списке
-        if (new_part_start > it->second)
+        if (!parts_.is_received(part.first, part.first + part.second))
         {
-            // То переходим дальше по списку
-            ++it;
-            continue;
+            if (lost_part)
+                return false;
+            lost_part = &part;
         }
+    }
 
-        // Если начало новой части до текущей в списке
-        if (new_part_start < it->first)
-        {
-            // Если новая часть больше текущей в списке
-            if (new_part_end > it->second)
-            {
-                // То у новой части отрезаем спереди до конца текущей в списке
-                new_part_start = std::move(it->second);
-
-                // И удаляем пустую часть из списка
-                it = part_vect_.erase(it);
-            }
-            else
-            {
-                // Если новая часть меньше текущей в списке
-                // То отрезаем у текущей в списке до конца новой части
-                it->first = std::move(new_part_end);
-
-                // Если часть из списка пустая то удаляем её
-                if (it->first == it->second)
-                    it = part_vect_.erase(it);
-                break;
-            }
-        }
-        // Если начало новой части за текущей в списке
-        else if (new_part_start > it->first)
-        {
-            uint32_t current_end = std::move(it->second);
-
-            // То текущая часть теперь заканчивается началом новой
-            it->second = std::move(new_part_start);
-
-            // Если новая часть выходит за текущую в списке
-            if (new_part_end > current_end)
-            {
-                // То у новой части отрезаем спереди до конца текущей в списке
-                new_part_start = std::move(current_end);
-
-                // И переходим дальше по списку
-                ++it;
-            }
-            else
-            {
-                // Если новая часть меньше текущей в списке
-                if (new_part_end < current_end)
-                {
-                    // То добавляем часть в список которая
-                    // Начинается с конца новой и заканчивается концом текущей
-
-                    std::pair<uint32_t, uint32_t> new_part(std::move(new_part_end), std::move(current_end));
-                    part_vect_.insert(++it, std::move(new_part));
-                }
-                break;
-            }
-        }
-        // Если начало новой части совпадает с началом текущей в списке
-        else // ==
-        {
-            // Если новая часть выходит за текущую в списке
-            if (new_part_end > it->second)
-            {
-                // То у новой части отрезаем спереди до конца текущей в списке
-                new_part_start = std::move(it->second);
-
-                // Удаляем пустую и переходим дальше по списку
-                it = part_vect_.erase(it);
-            }
-            // Если новая часть меньше текущей в списке
-            else if (new_part_end < it->second)
-            {
-                // То текущая часть теперь начинается с конца новой
-                it->first = std::move(new_part_end);
-                break;
-            }
-            // Если новая часть совпадает с текущей в списке
-            else
-            {
-                // То удаляем её
-                part_vect_.erase(it);
-                break;
-            }
-        }
+    if (!lost_part)
+        return false;
+
+    QByteArray data(parity, static_cast<int>(lost_part->second));
+    QByteArray other;
+    for (const QPair<uint32_t, uint32_t>& part: parts)
+    {
+        if (&part == lost_part)
+            continue;
+
+        other.resize(static_cast<int>(part.second));
+        data_device_->seek(part.first);
+        if (data_device_->read(other.data(), part.second) != static_cast<qint64>(part.second))
+            return false;
+        fec_xor(data, other.constData(), std::min(part.second, lost_part->second));
     }
+
+    add_data(lost_part->first, data.constData(), lost_part->second);
+    return true;
 }
 
 bool Fragmented_Message::is_parts_empty() const
 {
-    return part_vect_.empty();
+    return parts_.empty();
 }
 
 QPair<uint32_t, uint32_t> Fragmented_Message::get_next_part() const
 {
-    if (part_vect_.empty())
+    const std::vector<Gap_Tracker::Range> parts = parts_.next(0, 1, max_fragment_size_);
+    if (parts.empty())
         return {0, 0};
+    return qMakePair(parts.front().first, parts.front().second);
+}
 
-    const std::pair<uint32_t, uint32_t>& part = part_vect_.front();
-    if (part.second - part.first > max_fragment_size_)
-        return {part.first, max_fragment_size_};
-//        part.second = max_fragment_size_;
-    else
-        return {part.first, part.second - part.first};
-//        part.second = part.second - part.first;
-//    return part;
+std::vector<QPair<uint32_t, uint32_t>> Fragmented_Message::get_next_parts(uint32_t pos, uint32_t count) const
+{
+    std::vector<QPair<uint32_t, uint32_t>> parts;
+    for (const Gap_Tracker::Range& part: parts_.next(pos, count, max_fragment_size_))
+        parts.push_back(qMakePair(part.first, part.second));
+    return parts;
+}
+
+bool Fragmented_Message::update_stream()
+{
+    return stream_ && stream_->set_received(data_device_, parts_.received_prefix(full_size_));
 }
 
 } // namespace Net
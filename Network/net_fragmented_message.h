@@ -5,12 +5,16 @@
 
 #include <QIODevice>
 
+#include <Helpz/net_gap_tracker.h>
+#include <Helpz/net_mapped_file.h>
+#include <Helpz/net_fragment_stream.h>
+
 namespace Helpz {
 namespace Net {
 
 struct Fragmented_Message
 {
-    Fragmented_Message(uint8_t id, uint8_t cmd, uint32_t max_fragment_size, uint32_t full_size);
+    Fragmented_Message(uint32_t id, uint8_t cmd, uint32_t max_fragment_size, uint32_t full_size);
 
     Fragmented_Message(Fragmented_Message&& o);
     Fragmented_Message& operator =(Fragmented_Message&& o);
@@ -21,21 +25,52 @@ struct Fragmented_Message
     ~Fragmented_Message();
 
     bool operator <(const Fragmented_Message& o) const;
-    bool operator <(uint8_t id) const;
-    bool operator ==(uint8_t id) const;
+    bool operator <(uint32_t id) const;
+    bool operator ==(uint32_t id) const;
 
     void add_data(uint32_t pos, const char *data, uint32_t len);
-    void remove_from_part_vect(uint32_t new_part_start, uint32_t new_part_end);
+
+    /**
+     * @brief add_parity
+     * Restore part from XOR parity of parts if only it is not received.
+     * @return true if part is restored
+     */
+    bool add_parity(const std::vector<QPair<uint32_t, uint32_t>>& parts, const char* parity, uint32_t parity_size);
     bool is_parts_empty() const;
     QPair<uint32_t, uint32_t> get_next_part() const;
 
-    uint8_t id_, cmd_;
-    uint32_t max_fragment_size_;
+    /**
+     * @brief get_next_parts
+     * Up to count not received parts which begins from pos or later, each not bigger than max_fragment_size_.
+     */
+    std::vector<QPair<uint32_t, uint32_t>> get_next_parts(uint32_t pos, uint32_t count) const;
+
+    /**
+     * @brief update_stream
+     * @return true if stream is set and more data from the beginning is received
+     */
+    bool update_stream();
+
+    uint32_t id_;
+    uint8_t cmd_;
+    bool is_extended_;
+    uint32_t max_fragment_size_, full_size_;
+
+    /* Big message is written straight into mapped file,
+     * data_device_ is read only view of it, so handler gets it without copy.
+     */
+    std::unique_ptr<Mapped_File> mapped_file_;
     QIODevice* data_device_;
 
+    // Set if command is received in stream mode, handler reads data as it's received
+    std::unique_ptr<Fragment_Stream> stream_;
+
+    // Windowed transfer state, used by version 2 messages only
+    uint32_t window_, in_flight_, requested_pos_;
+
     std::chrono::system_clock::time_point last_part_time_;
 
-    std::vector<std::pair<uint32_t, uint32_t>> part_vect_;
+    Gap_Tracker parts_;
 };
 
 } // namespace Net
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <iterator>
+
+#include "net_gap_tracker.h"
+
+namespace Helpz {
+namespace Net {
+
+Gap_Tracker::Gap_Tracker(uint32_t size)
+{
+    if (size)
+        gaps_.emplace(0, size);
+}
+
+bool Gap_Tracker::empty() const { return gaps_.empty(); }
+std::size_t Gap_Tracker::count() const { return gaps_.size(); }
+
+uint32_t Gap_Tracker::received_prefix(uint32_t size) const
+{
+    return gaps_.empty() ? size : std::min(gaps_.begin()->first, size);
+}
+
+bool Gap_Tracker::is_received(uint32_t start, uint32_t end) const
+{
+    auto it = gaps_.upper_bound(start);
+    if (it != gaps_.begin() && std::prev(it)->second > start)
+        return false;
+    return it == gaps_.end() || it->first >= end;
+}
+
+void Gap_Tracker::remove(uint32_t start, uint32_t end)
+{
+    if (start >= end)
+        return;
+
+    auto it = gaps_.upper_bound(start);
+
+    // Gap which begins before the range may be cut or split by it
+    if (it != gaps_.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->second > start)
+        {
+            const uint32_t gap_end = prev->second;
+            prev->second = start;
+            if (prev->first == prev->second)
+                gaps_.erase(prev);
+
+            if (gap_end > end)
+            {
+                gaps_.emplace_hint(it, end, gap_end);
+                return;
+            }
+        }
+    }
+
+    // Gaps which begins inside the range are removed, last one may be cut
+    while (it != gaps_.end() && it->first < end)
+    {
+        if (it->second > end)
+        {
+            const uint32_t gap_end = it->second;
+            it = gaps_.erase(it);
+            gaps_.emplace_hint(it, end, gap_end);
+            return;
+        }
+        it = gaps_.erase(it);
+    }
+}
+
+std::vector<Gap_Tracker::Range> Gap_Tracker::next(uint32_t pos, uint32_t count, uint32_t max_size) const
+{
+    std::vector<Range> parts;
+    if (!max_size)
+        return parts;
+
+    auto it = gaps_.upper_bound(pos);
+    if (it != gaps_.begin() && std::prev(it)->second > pos)
+        --it;
+
+    for (; it != gaps_.end() && parts.size() < count; ++it)
+    {
+        for (uint32_t start = std::max(it->first, pos); start < it->second && parts.size() < count; start += max_size)
+            parts.emplace_back(start, std::min(max_size, it->second - start));
+    }
+    return parts;
+}
+
+std::vector<Gap_Tracker::Range> Gap_Tracker::ranges() const
+{
+    return std::vector<Range>(gaps_.cbegin(), gaps_.cend());
+}
+
+} // namespace Net
+} // namespace Helpz
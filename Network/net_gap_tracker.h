@@ -0,0 +1,66 @@
+#ifndef HELPZ_NETWORK_GAP_TRACKER_H
+#define HELPZ_NETWORK_GAP_TRACKER_H
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Gap_Tracker class
+ *
+ * Not received ranges [start, end) of fragmented message.
+ * Ranges are kept in ordered map by start, so receiving a part is logarithmic
+ * for any arrival order and next ranges are found without a walk from the beginning.
+ */
+class Gap_Tracker
+{
+public:
+    typedef std::pair<uint32_t, uint32_t> Range;
+
+    explicit Gap_Tracker(uint32_t size = 0);
+
+    bool empty() const;
+    std::size_t count() const;
+
+    /**
+     * @brief remove
+     * Mark range [start, end) as received.
+     */
+    void remove(uint32_t start, uint32_t end);
+
+    /**
+     * @brief next
+     * Up to count not received parts which begins from pos or later, each not bigger than max_size.
+     * @return pairs of [start, size]
+     */
+    std::vector<Range> next(uint32_t pos, uint32_t count, uint32_t max_size) const;
+
+    /**
+     * @brief ranges
+     * All not received ranges as [start, end) pairs.
+     */
+    std::vector<Range> ranges() const;
+
+    /**
+     * @brief received_prefix
+     * End of received data from the beginning, size if all is received.
+     */
+    uint32_t received_prefix(uint32_t size) const;
+
+    /**
+     * @brief is_received
+     * True if there are no gaps in range [start, end).
+     */
+    bool is_received(uint32_t start, uint32_t end) const;
+
+private:
+    std::map<uint32_t, uint32_t> gaps_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_GAP_TRACKER_H
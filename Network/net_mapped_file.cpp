@@ -0,0 +1,78 @@
+#include <QDir>
+#include <QTemporaryFile>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "net_mapped_file.h"
+
+namespace Helpz {
+namespace Net {
+
+Mapped_File::Mapped_File() :
+    data_(nullptr), size_(0), fd_(-1)
+{
+}
+
+/*static*/ std::unique_ptr<Mapped_File> Mapped_File::create(uint32_t size, const QString &name)
+{
+    if (size == 0)
+        return nullptr;
+
+    std::unique_ptr<Mapped_File> mapped{new Mapped_File};
+
+#ifdef Q_OS_LINUX
+    mapped->fd_ = memfd_create(name.toLocal8Bit().constData(), MFD_CLOEXEC);
+    if (mapped->fd_ != -1)
+    {
+        if (ftruncate(mapped->fd_, size) == 0)
+        {
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mapped->fd_, 0);
+            if (data != MAP_FAILED)
+            {
+                mapped->data_ = static_cast<char*>(data);
+                mapped->size_ = size;
+                return mapped;
+            }
+        }
+
+        ::close(mapped->fd_);
+        mapped->fd_ = -1;
+    }
+#endif
+
+    mapped->file_.reset(new QTemporaryFile(QDir::tempPath() + '/' + name + "_XXXXXX.dat"));
+    if (!mapped->file_->open() || !mapped->file_->resize(size))
+        return nullptr;
+
+    mapped->data_ = reinterpret_cast<char*>(mapped->file_->map(0, size));
+    if (!mapped->data_)
+        return nullptr;
+
+    mapped->size_ = size;
+    return mapped;
+}
+
+Mapped_File::~Mapped_File()
+{
+#ifdef Q_OS_LINUX
+    if (fd_ != -1)
+    {
+        if (data_)
+            munmap(data_, size_);
+        ::close(fd_);
+        return;
+    }
+#endif
+
+    if (file_ && data_)
+        file_->unmap(reinterpret_cast<uchar*>(data_));
+}
+
+char *Mapped_File::data() { return data_; }
+uint32_t Mapped_File::size() const { return size_; }
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,49 @@
+#ifndef HELPZ_NETWORK_MAPPED_FILE_H
+#define HELPZ_NETWORK_MAPPED_FILE_H
+
+#include <memory>
+#include <cstdint>
+
+#include <QString>
+
+class QTemporaryFile;
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Mapped_File class
+ *
+ * Writable memory mapping for reassembly of big messages.
+ * On Linux it's memfd, so pages live in page cache and are never written to disk,
+ * else it's sparse temporary file.
+ */
+class Mapped_File
+{
+public:
+    /**
+     * @brief create
+     * @return nullptr if mapping failed
+     */
+    static std::unique_ptr<Mapped_File> create(uint32_t size, const QString& name);
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator =(const Mapped_File&) = delete;
+    ~Mapped_File();
+
+    char* data();
+    uint32_t size() const;
+
+private:
+    Mapped_File();
+
+    char* data_;
+    uint32_t size_;
+    int fd_;
+    std::unique_ptr<QTemporaryFile> file_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_MAPPED_FILE_H
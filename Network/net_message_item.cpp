@@ -1,17 +1,20 @@
+#include "net_message_pool.h"
 #include "net_message_item.h"
 
 namespace Helpz {
 namespace Net {
 
 Message_Item::Message_Item() :
-    cmd_(0), flags_(0), fragment_size_(HELPZ_MAX_MESSAGE_DATA_SIZE), min_compress_size_(512)
+    resend_timeout_(0), resend_count_(0), is_fragment_window_(false), fec_group_(0), cmd_(0), flags_(0), codec_type_(0), stream_(0), priority_(NORMAL_PRIORITY),
+    fragment_size_(HELPZ_MAX_MESSAGE_DATA_SIZE), min_compress_size_(512)
 {
 }
 
-Message_Item::Message_Item(uint8_t command, std::optional<uint8_t> answer_id, std::unique_ptr<QIODevice> &&device_ptr,
+Message_Item::Message_Item(uint8_t command, std::optional<uint32_t> answer_id, std::unique_ptr<QIODevice> &&device_ptr,
                            std::chrono::milliseconds resend_timeout) :
     answer_id_{std::move(answer_id)}, resend_timeout_(resend_timeout),
-    data_device_{std::move(device_ptr)}, cmd_(command), flags_(0), fragment_size_(HELPZ_MAX_MESSAGE_DATA_SIZE), min_compress_size_(512)
+    resend_count_(0), data_device_{std::move(device_ptr)}, is_fragment_window_(false), fec_group_(0), cmd_(command), flags_(0), codec_type_(0), stream_(0), priority_(NORMAL_PRIORITY),
+    fragment_size_(HELPZ_MAX_MESSAGE_DATA_SIZE), min_compress_size_(512)
 {
 }
 
@@ -22,6 +25,9 @@ Message_Item::~Message_Item()
         bool is_state_ok = !answer_func_;
         finally_func_(is_state_ok);
     }
+
+    if (pool_ && data_device_)
+        pool_->give_buffer(std::move(data_device_));
 }
 
 uint8_t Message_Item::cmd() const { return cmd_; }
@@ -44,5 +50,14 @@ void Message_Item::set_fragment_size(uint32_t size)
 uint32_t Message_Item::min_compress_size() const { return min_compress_size_; }
 void Message_Item::set_min_compress_size(uint32_t min_compress_size) { min_compress_size_ = min_compress_size; }
 
+uint8_t Message_Item::codec_type() const { return codec_type_; }
+void Message_Item::set_codec_type(uint8_t codec_type) { codec_type_ = codec_type; }
+
+Message_Priority Message_Item::priority() const { return priority_; }
+void Message_Item::set_priority(Message_Priority priority) { priority_ = priority < PRIORITY_COUNT ? priority : BULK_PRIORITY; }
+
+uint8_t Message_Item::stream() const { return stream_; }
+void Message_Item::set_stream(uint8_t stream) { stream_ = stream; }
+
 } // namespace Net
 } // namespace Helpz
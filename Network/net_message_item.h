@@ -1,6 +1,8 @@
 #ifndef HELPZ_NETWORK_MESSAGE_ITEM_H
 #define HELPZ_NETWORK_MESSAGE_ITEM_H
 
+#include <deque>
+#include <vector>
 #include <memory>
 #include <chrono>
 #include <functional>
@@ -13,25 +15,73 @@
 namespace Helpz {
 namespace Net {
 
+class Message_Pool;
+
+/**
+ * @brief The Message_Priority enum
+ * Class of message for send scheduler of writer. Service commands of protocol are interactive.
+ */
+enum Message_Priority : uint8_t
+{
+    INTERACTIVE_PRIORITY = 0,
+    NORMAL_PRIORITY,
+    BULK_PRIORITY,
+
+    PRIORITY_COUNT
+};
+
 struct Message_Item
 {
     Message_Item();
-    Message_Item(uint8_t command, std::optional<uint8_t> answer_id, std::unique_ptr<QIODevice>&& device_ptr,
-                 std::chrono::milliseconds resend_timeout = std::chrono::milliseconds{3000});
+    Message_Item(uint8_t command, std::optional<uint32_t> answer_id, std::unique_ptr<QIODevice>&& device_ptr,
+                 std::chrono::milliseconds resend_timeout = std::chrono::milliseconds::zero());
     virtual ~Message_Item();
     Message_Item(Message_Item&&) = default;
     Message_Item& operator =(Message_Item&&) = default;
     Message_Item(const Message_Item&) = delete;
     Message_Item& operator =(const Message_Item&) = delete;
 
-    std::optional<uint8_t> id_, answer_id_;
+    std::optional<uint32_t> id_, answer_id_;
+
+    /**
+     * Zero is adaptive timeout of Protocol, it's doubled on each resend.
+     */
     std::chrono::milliseconds resend_timeout_;
     std::chrono::time_point<std::chrono::system_clock> begin_time_, end_time_;
+
+    /**
+     * Time of last write, round trip is measured from it if message isn't repeated.
+     */
+    std::chrono::time_point<std::chrono::system_clock> send_time_;
+    uint8_t resend_count_;
     std::unique_ptr<QIODevice> data_device_;
     std::function<void(QIODevice&)> answer_func_;
     std::function<void()> timeout_func_;
     std::function<void(bool)> finally_func_;
 
+    /**
+     * Parts requested by windowed fragment query, each write of message sends the next one.
+     * Write without part is skipped if is_fragment_window_ is set.
+     * Guarded by mutex_ of Protocol, because posted writes may run while next query refills parts.
+     */
+    std::deque<std::pair<uint32_t, uint32_t>> fragment_parts_;
+    bool is_fragment_window_;
+
+    /**
+     * Receiver may ask for parity part after each fec_group_ parts, zero is off.
+     * Parity is queued in fragment_parts_ as FEC_PARITY_PART and is XOR of fec_parts_ sent after previous one.
+     * Guarded by same mutex_ as fragment_parts_, part is added to parity by write which sends it.
+     */
+    enum : uint32_t { FEC_PARITY_PART = 0xFFFFFFFF };
+    uint8_t fec_group_;
+    std::vector<std::pair<uint32_t, uint32_t>> fec_parts_;
+    QByteArray fec_parity_;
+
+    /**
+     * Set if message is created by Message_Pool, data device returns there when message is destroyed.
+     */
+    std::shared_ptr<Message_Pool> pool_;
+
     uint8_t cmd() const;
 
     class Only_Protocol { explicit Only_Protocol() = default; friend class Protocol; };
@@ -44,8 +94,26 @@ struct Message_Item
     uint32_t min_compress_size() const;
     void set_min_compress_size(uint32_t min_compress_size);
 
+    /**
+     * @brief codec_type
+     * Preferred Codec::Type, zlib is used if peer doesn't support it.
+     */
+    uint8_t codec_type() const;
+    void set_codec_type(uint8_t codec_type);
+
+    Message_Priority priority() const;
+    void set_priority(Message_Priority priority);
+
+    /**
+     * @brief stream
+     * Stream with own id sequence, used if peer supports streams.
+     */
+    uint8_t stream() const;
+    void set_stream(uint8_t stream);
+
 private:
-    uint8_t cmd_, flags_;
+    uint8_t cmd_, flags_, codec_type_, stream_;
+    Message_Priority priority_;
     uint32_t fragment_size_, min_compress_size_;
 };
 
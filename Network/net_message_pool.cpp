@@ -0,0 +1,118 @@
+#include "net_message_pool.h"
+
+namespace Helpz {
+namespace Net {
+
+namespace {
+
+class Pooled_Buffer : public QBuffer
+{
+public:
+    Pooled_Buffer()
+    {
+        buffer().reserve(HELPZ_PROTOCOL_POOL_BUFFER_SIZE);
+        open(QIODevice::ReadWrite);
+    }
+};
+
+} // namespace
+
+Message_Pool::Message_Pool(std::size_t max_cached) :
+    max_cached_(max_cached), block_size_(0)
+{
+    blocks_.reserve(max_cached_);
+    buffers_.reserve(max_cached_);
+}
+
+Message_Pool::~Message_Pool()
+{
+    for (void* block: blocks_)
+        ::operator delete(block);
+}
+
+std::shared_ptr<Message_Item> Message_Pool::make(Message_Item &&item)
+{
+    auto msg = std::allocate_shared<Message_Item>(Message_Pool_Allocator<Message_Item>(shared_from_this()), std::move(item));
+    msg->pool_ = shared_from_this();
+    return msg;
+}
+
+std::unique_ptr<QIODevice> Message_Pool::take_buffer()
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (!buffers_.empty())
+        {
+            std::unique_ptr<QIODevice> device = std::move(buffers_.back());
+            buffers_.pop_back();
+            return device;
+        }
+    }
+
+    return std::unique_ptr<QIODevice>(new Pooled_Buffer);
+}
+
+void Message_Pool::give_buffer(std::unique_ptr<QIODevice> &&device)
+{
+    Pooled_Buffer* buffer = dynamic_cast<Pooled_Buffer*>(device.get());
+    if (!buffer || !buffer->isOpen()
+        || buffer->buffer().capacity() > HELPZ_PROTOCOL_POOL_MAX_BUFFER_SIZE)
+        return;
+
+    // Capacity is reserved, so resize doesn't free it
+    buffer->seek(0);
+    buffer->buffer().resize(0);
+
+    std::lock_guard lock(mutex_);
+    if (buffers_.size() < max_cached_)
+    {
+        device.release();
+        buffers_.emplace_back(buffer);
+    }
+}
+
+std::size_t Message_Pool::cached_blocks() const
+{
+    std::lock_guard lock(mutex_);
+    return blocks_.size();
+}
+
+std::size_t Message_Pool::cached_buffers() const
+{
+    std::lock_guard lock(mutex_);
+    return buffers_.size();
+}
+
+void *Message_Pool::allocate(std::size_t size)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (!block_size_)
+            block_size_ = size;
+        else if (size == block_size_ && !blocks_.empty())
+        {
+            void* block = blocks_.back();
+            blocks_.pop_back();
+            return block;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+void Message_Pool::deallocate(void *ptr, std::size_t size)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (size == block_size_ && blocks_.size() < max_cached_)
+        {
+            blocks_.push_back(ptr);
+            return;
+        }
+    }
+
+    ::operator delete(ptr);
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,83 @@
+#ifndef HELPZ_NETWORK_MESSAGE_POOL_H
+#define HELPZ_NETWORK_MESSAGE_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QBuffer>
+
+#include <Helpz/net_message_item.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Message_Pool class
+ *
+ * Cache of memory blocks for Message_Item with its shared_ptr control block
+ * and of opened data buffers with reserved capacity.
+ * Message returns both to the pool when it's destroyed, so Message_Item block and payload QBuffer are reused
+ * by next message. Packet, callbacks and queue nodes of protocol are still allocated on send.
+ * Messages may be created and destroyed in different threads.
+ */
+class Message_Pool : public std::enable_shared_from_this<Message_Pool>
+{
+public:
+    explicit Message_Pool(std::size_t max_cached = HELPZ_PROTOCOL_POOL_SIZE);
+    Message_Pool(const Message_Pool&) = delete;
+    Message_Pool& operator =(const Message_Pool&) = delete;
+    ~Message_Pool();
+
+    /**
+     * @brief make
+     * Same as std::make_shared but memory is taken from the pool.
+     * Data device of message is returned to the pool too if it's pooled buffer.
+     */
+    std::shared_ptr<Message_Item> make(Message_Item&& item);
+
+    /**
+     * @brief take_buffer
+     * Empty opened buffer for message data.
+     */
+    std::unique_ptr<QIODevice> take_buffer();
+    void give_buffer(std::unique_ptr<QIODevice>&& device);
+
+    std::size_t cached_blocks() const;
+    std::size_t cached_buffers() const;
+
+    void* allocate(std::size_t size);
+    void deallocate(void* ptr, std::size_t size);
+
+private:
+    const std::size_t max_cached_;
+    std::size_t block_size_;
+    std::vector<void*> blocks_;
+    std::vector<std::unique_ptr<QBuffer>> buffers_;
+    mutable std::mutex mutex_;
+};
+
+template<typename T>
+struct Message_Pool_Allocator
+{
+    typedef T value_type;
+
+    explicit Message_Pool_Allocator(std::shared_ptr<Message_Pool> pool) : pool_(std::move(pool)) {}
+    template<typename U>
+    Message_Pool_Allocator(const Message_Pool_Allocator<U>& obj) : pool_(obj.pool_) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(pool_->allocate(n * sizeof(T))); }
+    void deallocate(T* ptr, std::size_t n) { pool_->deallocate(ptr, n * sizeof(T)); }
+
+    template<typename U>
+    bool operator ==(const Message_Pool_Allocator<U>& obj) const { return pool_ == obj.pool_; }
+    template<typename U>
+    bool operator !=(const Message_Pool_Allocator<U>& obj) const { return pool_ != obj.pool_; }
+
+    std::shared_ptr<Message_Pool> pool_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_MESSAGE_POOL_H
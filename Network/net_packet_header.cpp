@@ -0,0 +1,50 @@
+#include <QByteArray>
+#include <QtEndian>
+
+#include "net_packet_header.h"
+
+namespace Helpz {
+namespace Net {
+
+bool Packet_Header::is_extended() const { return flags_ & EXTENDED_FLAG; }
+std::size_t Packet_Header::size() const { return is_extended() ? EXTENDED_SIZE : SIZE; }
+uint8_t Packet_Header::codec_type() const { return (ext_flags_ & CODEC_MASK) >> CODEC_SHIFT; }
+
+void Packet_Header::parse(const uint8_t *data)
+{
+    checksum_ = qFromBigEndian<quint16>(data);
+    id_ = data[2];
+    cmd_ = data[3];
+    flags_ = data[FLAGS_POS];
+    data_size_ = qFromBigEndian<quint32>(data + 5);
+
+    // QDataStream writes null QByteArray size as 0xffffffff
+    if (data_size_ == 0xffffffff)
+        data_size_ = 0;
+
+    if (is_extended())
+    {
+        id_ |= (static_cast<uint32_t>(data[9]) << 24) | (static_cast<uint32_t>(data[10]) << 16) | (static_cast<uint32_t>(data[11]) << 8);
+        ext_flags_ = data[12];
+    }
+    else
+        ext_flags_ = 0;
+}
+
+bool Packet_Header::is_checksum_valid(const uint8_t *data) const
+{
+    return checksum_ == calc_checksum(data);
+}
+
+/*static*/ std::size_t Packet_Header::size_of(const uint8_t *data)
+{
+    return data[FLAGS_POS] & EXTENDED_FLAG ? EXTENDED_SIZE : SIZE;
+}
+
+/*static*/ uint16_t Packet_Header::calc_checksum(const uint8_t *data)
+{
+    return qChecksum(reinterpret_cast<const char*>(data) + 2, static_cast<uint>(size_of(data) - 2));
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,61 @@
+#ifndef HELPZ_NETWORK_PACKET_HEADER_H
+#define HELPZ_NETWORK_PACKET_HEADER_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Packet_Header struct
+ *
+ * Decodes protocol header straight from received bytes without QDataStream.
+ * [2bytes Checksum][1byte id][1byte cmd][1byte flags][4bytes data size]
+ * If EXTENDED_FLAG is set in flags, header continues with
+ * [3bytes high part of id][1byte ext flags]
+ * Ext flags has [2bits reserved][1bit fec parity][1bit body checksum][3bits codec type][1bit ack request].
+ * All fields are big endian, same as QDataStream writes them.
+ * Checksum covers all header bytes after itself.
+ */
+struct Packet_Header
+{
+    enum { SIZE = 9, EXTENDED_SIZE = 13, MAX_SIZE = EXTENDED_SIZE };
+    enum { FLAGS_POS = 4, EXTENDED_FLAG = 0x04 };
+
+    enum Ext_Flags {
+        ACK_REQUEST = 0x01,
+        CODEC_MASK = 0x0E,
+        BODY_CHECKSUM = 0x10,
+        FEC_PARITY = 0x20
+    };
+    enum { CODEC_SHIFT = 1 };
+
+    uint16_t checksum_;
+    uint32_t id_;
+    uint8_t cmd_, flags_, ext_flags_;
+    uint32_t data_size_;
+
+    bool is_extended() const;
+    std::size_t size() const;
+    uint8_t codec_type() const;
+
+    /**
+     * @brief parse
+     * Data must contain at least size_of(data) bytes.
+     */
+    void parse(const uint8_t* data);
+    bool is_checksum_valid(const uint8_t* data) const;
+
+    /**
+     * @brief size_of
+     * Header size by flags byte, data must contain at least SIZE bytes.
+     */
+    static std::size_t size_of(const uint8_t* data);
+    static uint16_t calc_checksum(const uint8_t* data);
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_PACKET_HEADER_H
@@ -1,4 +1,5 @@
 #include <QDebug>
+#include <QtEndian>
 
 #include "net_protocol.h"
 
@@ -8,13 +9,56 @@ namespace Net {
 Q_LOGGING_CATEGORY(Log, "net")
 Q_LOGGING_CATEGORY(DetailLog, "net.detail", QtInfoMsg)
 
+Protocol::Receive_Sequence::Receive_Sequence(uint32_t id_mask, uint32_t window, uint32_t first_id, uint32_t base) :
+    id_mask_(id_mask), first_id_(first_id), base_(base), window_(window), next_id_(base | first_id)
+{
+}
+
+uint32_t Protocol::Receive_Sequence::distance(uint32_t from_id, uint32_t to_id) const
+{
+    const uint64_t span = uint64_t(id_mask_) + 1 - first_id_;
+    return static_cast<uint32_t>((uint64_t(to_id & id_mask_) + span - (from_id & id_mask_)) % span);
+}
+
+uint32_t Protocol::Receive_Sequence::next_after(uint32_t id) const
+{
+    const uint32_t next = (id + 1) & id_mask_;
+    return base_ | (next < first_id_ ? first_id_ : next);
+}
+
+uint32_t Protocol::Receive_Sequence::before(uint32_t id, uint32_t count) const
+{
+    const uint64_t span = uint64_t(id_mask_) + 1 - first_id_;
+    const uint64_t pos = uint64_t(id & id_mask_) - first_id_;
+    return base_ | static_cast<uint32_t>(first_id_ + (pos + span - count % span) % span);
+}
+
+namespace {
+
+template<typename T>
+void append_big_endian(QByteArray& buffer, T value)
+{
+    const int pos = buffer.size();
+    buffer.resize(pos + static_cast<int>(sizeof(T)));
+    qToBigEndian<T>(value, buffer.data() + pos);
+}
+
+} // namespace
+
+// Extended ids start after 8bit ids and skip them on wrap, so waiting answers with old and new ids don't overlap.
 Protocol::Protocol() :
-    next_rx_msg_id_(0), next_tx_msg_id_(0),
+    max_version_(2), is_peer_extended_(false), window_size_(HELPZ_PROTOCOL_WINDOW_SIZE),
+    peer_codec_mask_(1 << Codec::ZLIB), default_codec_type_(Codec::ZLIB), is_body_checksum_(false), is_fec_(false),
+    coalesce_window_(std::chrono::milliseconds::zero()), coalesce_max_size_(HELPZ_PROTOCOL_COALESCE_SIZE),
+    codecs_(Codec_Registry::default_registry()), message_pool_(std::make_shared<Message_Pool>()),
+    next_tx_msg_id_(0), next_tx_ext_msg_id_(HELPZ_PROTOCOL_FIRST_EXTENDED_ID),
+    rx_sequence_(0xff, 100, 0), rx_ext_sequence_(0xffffffff, HELPZ_PROTOCOL_WINDOW_SIZE, HELPZ_PROTOCOL_FIRST_EXTENDED_ID),
+    is_peer_streams_(false),
+    recv_buffer_(HELPZ_PROTOCOL_RECEIVE_BUFFER_SIZE),
     last_msg_send_time_(Time_Point{})
 {
-    device_.open(QBuffer::ReadWrite);
-    msg_stream_.setDevice(&device_);
-    msg_stream_.setVersion(DATASTREAM_VERSION);
+    for (std::atomic<uint64_t>& mask: stream_cmd_mask_)
+        mask = 0;
 }
 
 QString Protocol::title() const
@@ -24,8 +68,110 @@ QString Protocol::title() const
 
 void Protocol::reset_msg_id()
 {
-    next_rx_msg_id_ = 0;
     next_tx_msg_id_ = 0;
+    next_tx_ext_msg_id_ = HELPZ_PROTOCOL_FIRST_EXTENDED_ID;
+    rx_sequence_.next_id_ = 0;
+    rx_sequence_.lost_msg_list_.clear();
+    rx_ext_sequence_.next_id_ = HELPZ_PROTOCOL_FIRST_EXTENDED_ID;
+    rx_ext_sequence_.lost_msg_list_.clear();
+    rx_ext_sequence_.id_mask_ = 0xffffffff;
+    rx_streams_.clear();
+    {
+        std::lock_guard lock(mutex_);
+        tx_stream_ids_.clear();
+    }
+    is_peer_streams_ = false;
+    is_peer_extended_ = false;
+    peer_codec_mask_ = 1 << Codec::ZLIB;
+    rtt_.reset();
+    fec_estimator_.reset();
+}
+
+void Protocol::set_max_version(uint8_t version) { max_version_ = version; }
+uint8_t Protocol::max_version() const { return max_version_; }
+uint8_t Protocol::version() const { return is_extended_tx() ? 2 : 1; }
+
+void Protocol::set_window_size(uint32_t size)
+{
+    if (size == 0)
+        size = 1;
+    window_size_ = size;
+    rx_ext_sequence_.window_ = size;
+    for (auto& it: rx_streams_)
+        it.second.window_ = size;
+}
+
+uint32_t Protocol::window_size() const { return window_size_; }
+
+void Protocol::set_codecs(std::shared_ptr<const Codec_Registry> codecs)
+{
+    if (codecs)
+        codecs_ = std::move(codecs);
+}
+
+std::shared_ptr<const Codec_Registry> Protocol::codecs() const { return codecs_; }
+
+void Protocol::set_default_codec_type(uint8_t codec_type) { default_codec_type_ = codec_type; }
+uint8_t Protocol::default_codec_type() const { return default_codec_type_; }
+
+void Protocol::set_body_checksum(bool state) { is_body_checksum_ = state; }
+bool Protocol::is_body_checksum() const { return is_body_checksum_; }
+
+void Protocol::set_fec(bool state) { is_fec_ = state; }
+bool Protocol::is_fec() const { return is_fec_; }
+
+void Protocol::set_coalescing(std::chrono::milliseconds window, std::size_t max_size)
+{
+    coalesce_window_ = window;
+    coalesce_max_size_ = max_size;
+}
+
+std::chrono::milliseconds Protocol::coalesce_window() const { return coalesce_window_; }
+std::size_t Protocol::coalesce_max_size() const { return coalesce_max_size_; }
+
+std::chrono::microseconds Protocol::rtt() const { return rtt_.srtt(); }
+std::chrono::microseconds Protocol::rtt_variation() const { return rtt_.rttvar(); }
+std::chrono::milliseconds Protocol::retransmission_timeout() const { return rtt_.rto(); }
+
+void Protocol::set_retransmission_timeout_limits(std::chrono::milliseconds min_rto, std::chrono::milliseconds max_rto)
+{
+    rtt_.set_limits(min_rto, max_rto);
+}
+
+std::shared_ptr<Message_Pool> Protocol::message_pool() const { return message_pool_; }
+
+void Protocol::set_stream_receive(uint8_t cmd, bool state)
+{
+    const uint64_t bit = uint64_t(1) << (cmd % 64);
+    if (state)
+        stream_cmd_mask_[cmd / 64] |= bit;
+    else
+        stream_cmd_mask_[cmd / 64] &= ~bit;
+}
+
+bool Protocol::is_stream_receive(uint8_t cmd) const
+{
+    return stream_cmd_mask_[cmd / 64] & (uint64_t(1) << (cmd % 64));
+}
+
+bool Protocol::is_streams_supported() const
+{
+    return is_extended_tx() && is_peer_streams_;
+}
+
+/*static*/ uint8_t Protocol::stream_of(uint32_t msg_id)
+{
+    return static_cast<uint8_t>(msg_id >> HELPZ_PROTOCOL_STREAM_SHIFT);
+}
+
+Protocol_Stats::Snapshot Protocol::stats() const
+{
+    Protocol_Stats::Snapshot snapshot = stats_.snapshot();
+
+    std::lock_guard lock(mutex_);
+    snapshot.waiting_count_ = waiting_messages_.size();
+    snapshot.pending_count_ = pending_messages_.size();
+    return snapshot;
 }
 
 std::shared_ptr<Protocol_Writer> Protocol::writer()
@@ -43,6 +189,16 @@ void Protocol::set_writer(std::shared_ptr<Protocol_Writer> protocol_writer)
     protocol_writer_ = std::move(protocol_writer);
 }
 
+Protocol::Time_Point Protocol::current_time() const
+{
+    return clock_ ? clock_() : std::chrono::system_clock::now();
+}
+
+void Protocol::set_clock(Clock_Func clock)
+{
+    clock_ = std::move(clock);
+}
+
 Protocol::Time_Point Protocol::last_msg_send_time() const
 {
     return last_msg_send_time_.load();
@@ -50,18 +206,12 @@ Protocol::Time_Point Protocol::last_msg_send_time() const
 
 Protocol_Sender Protocol::send(uint8_t cmd)
 {
-    auto ptr = writer();
-    if (ptr)
-        return Protocol_Sender(ptr->protocol(), cmd);
-    return Protocol_Sender(std::shared_ptr<Protocol>(), cmd);
+    return make_sender(cmd, std::nullopt);
 }
 
-Protocol_Sender Protocol::send_answer(uint8_t cmd, std::optional<uint8_t> msg_id)
+Protocol_Sender Protocol::send_answer(uint8_t cmd, std::optional<uint32_t> msg_id)
 {
-    auto ptr = writer();
-    if (ptr)
-        return Protocol_Sender(ptr->protocol(), cmd, msg_id);
-    return Protocol_Sender(std::shared_ptr<Protocol>(), cmd, msg_id);
+    return make_sender(cmd, std::move(msg_id));
 }
 
 void Protocol::send_byte(uint8_t cmd, char byte) { send(cmd) << byte; }
@@ -85,99 +235,222 @@ void Protocol::send_message(std::shared_ptr<Message_Item> msg)
 }
 
 QByteArray Protocol::prepare_packet_to_send(std::shared_ptr<Message_Item> msg_ptr)
+{
+    QByteArray packet;
+    prepare_packet_to_send(std::move(msg_ptr), packet);
+    return packet;
+}
+
+std::size_t Protocol::prepare_packet_to_send(std::shared_ptr<Message_Item> msg_ptr, QByteArray &buffer, uint32_t max_fragment_size)
 {
     if (!msg_ptr)
-        return {};
+        return 0;
 
     Message_Item& msg = *msg_ptr;
 
     if (!msg.data_device_)
     {
         qCWarning(Log).noquote() << title() << "Attempt to prepare packet without data device. cmd:" << int(msg.cmd());
-        return {};
+        return 0;
     }
 
     Time_Point tt = msg.end_time_;
+    Time_Point now = current_time();
+
+    // Message format is chosen when it is created, because data may contain message ids.
+    const bool is_extended = msg.flags() & EXTENDED_HEADER;
+    if (!msg.id_)
+    {
+        if (is_extended)
+        {
+            std::lock_guard lock(mutex_);
+            if (msg.end_time_ > now && waiting_messages_.unacked_count() >= window_size_)
+            {
+                qCDebug(DetailLog).noquote() << title() << "Send window is full, msg queued. cmd:" << int(msg.cmd());
+                pending_messages_.push_back(std::move(msg_ptr));
+                return 0;
+            }
+            msg.id_ = next_tx_ext_msg_id(msg.stream());
+        }
+        else
+            msg.id_ = next_tx_msg_id_++;
+    }
+
+    /* Fragment query may refill parts of message while writes posted for previous one are pending on other thread,
+     * so pop of part and read of its data are done under mutex_.
+     */
+    std::unique_lock fragment_lock(mutex_);
+    bool is_fec_parity = false;
+    if (!msg.fragment_parts_.empty())
+    {
+        const std::pair<uint32_t, uint32_t> part = msg.fragment_parts_.front();
+        msg.fragment_parts_.pop_front();
+        if (part.first == Message_Item::FEC_PARITY_PART)
+        {
+            if (msg.fec_parts_.empty())
+                return 0;
+            is_fec_parity = true;
+        }
+        else
+        {
+            msg.set_fragment_size(part.second);
+            msg.data_device_->seek(part.first);
+        }
+    }
+    else if (msg.is_fragment_window_)
+        return 0; // All requested parts is sent by previous writes
 
-    QByteArray packet, data;
     uint8_t flags = msg.flags();
+    if (!is_extended && max_version_ >= 2)
+        flags |= EXTENDED_SUPPORTED;
+
+    // Header place is reserved, body is written after it and header is filled at the end.
+    const int start = buffer.size();
+    const int body_start = start + (is_extended ? Packet_Header::EXTENDED_SIZE : Packet_Header::SIZE);
+    buffer.resize(body_start);
 
-    if (msg.answer_id_ || msg.data_device_->size() > msg.fragment_size())
+    if (msg.answer_id_)
     {
-        QDataStream ds(&data, QIODevice::WriteOnly);
-        ds.setVersion(DATASTREAM_VERSION);
+        flags |= ANSWER;
+        if (is_extended)
+            append_big_endian<uint32_t>(buffer, *msg.answer_id_);
+        else
+            append_big_endian<uint8_t>(buffer, *msg.answer_id_);
+    }
 
-        if (msg.answer_id_)
+    uint8_t ext_flags = 0;
+    if (is_fec_parity)
+    {
+        // Parity is [full size][count][parts as pos and size][XOR of parts padded by zeroes]
+        flags |= FRAGMENT;
+        ext_flags |= Packet_Header::FEC_PARITY;
+        append_big_endian<uint32_t>(buffer, msg.data_device_->size());
+        append_big_endian<uint8_t>(buffer, static_cast<uint8_t>(msg.fec_parts_.size()));
+        for (const std::pair<uint32_t, uint32_t>& part: msg.fec_parts_)
         {
-            flags |= ANSWER;
-            ds << *msg.answer_id_;
+            append_big_endian<uint32_t>(buffer, part.first);
+            append_big_endian<uint32_t>(buffer, part.second);
         }
+        buffer += msg.fec_parity_;
 
-        if (msg.data_device_->size() > msg.fragment_size())
-        {
-            flags |= FRAGMENT;
-            ds << static_cast<uint32_t>(msg.data_device_->size());
+        qCDebug(DetailLog).noquote() << title() << "Send fragment parity msg" << msg.id_.value_or(0) << "parts" << msg.fec_parts_.size();
 
-            qCDebug(DetailLog).noquote() << title() << "Send fragment msg" << msg.id_.value_or(0)
-                                         << "full" << msg.data_device_->size() << "pos" << msg.data_device_->pos() << "size" << msg.fragment_size();
+        msg.fec_parts_.clear();
+        msg.fec_parity_.clear();
+        msg.end_time_ = current_time() + std::chrono::seconds(10);
+        stats_.add_fec_parity_out();
+    }
+    else if (msg.data_device_->size() > msg.fragment_size())
+    {
+        flags |= FRAGMENT;
+        append_big_endian<uint32_t>(buffer, msg.data_device_->size());
 
-            ds << static_cast<uint32_t>(msg.data_device_->pos());
+        qCDebug(DetailLog).noquote() << title() << "Send fragment msg" << msg.id_.value_or(0)
+                                     << "full" << msg.data_device_->size() << "pos" << msg.data_device_->pos() << "size" << msg.fragment_size();
 
-            if (msg.data_device_->atEnd())
-                ds << msg.fragment_size();
-            else
-                add_raw_data_to_packet(data, msg.data_device_->pos(), msg.fragment_size(), msg.data_device_.get());
+        append_big_endian<uint32_t>(buffer, msg.data_device_->pos());
 
-            msg.end_time_ = std::chrono::system_clock::now() + std::chrono::seconds(10);
-        }
+        if (msg.data_device_->atEnd())
+            append_big_endian<uint32_t>(buffer, msg.fragment_size());
         else
         {
-            add_raw_data_to_packet(data, 0, msg.fragment_size(), msg.data_device_.get());
+            const uint32_t fragment_size = max_fragment_size ? std::min(msg.fragment_size(), max_fragment_size) : msg.fragment_size();
+            const uint32_t pos = msg.data_device_->pos();
+            const int data_start = buffer.size();
+            add_raw_data_to_packet(buffer, pos, fragment_size, msg.data_device_.get());
+
+            if (msg.is_fragment_window_ && msg.fec_group_)
+            {
+                const uint32_t size = buffer.size() - data_start;
+                msg.fec_parts_.emplace_back(pos, size);
+                fec_xor(msg.fec_parity_, buffer.constData() + data_start, size);
+            }
         }
+
+        msg.end_time_ = current_time() + std::chrono::seconds(10);
     }
     else
     {
-        add_raw_data_to_packet(data, 0, msg.fragment_size(), msg.data_device_.get());
+        add_raw_data_to_packet(buffer, 0, msg.fragment_size(), msg.data_device_.get());
     }
+    fragment_lock.unlock();
 
-    if (static_cast<uint32_t>(data.size()) > msg.min_compress_size())
+    if (static_cast<uint32_t>(buffer.size() - body_start) > msg.min_compress_size())
     {
-        flags |= COMPRESSED;
-        data = qCompress(data);
-    }
+        const Codec& codec = select_codec(msg.codec_type(), is_extended);
+        QByteArray compressed = codec.compress(msg.cmd(), QByteArray::fromRawData(buffer.constData() + body_start, buffer.size() - body_start));
 
-    if (!msg.id_)
-        msg.id_ = next_tx_msg_id_++;
+        // Small messages may grow after compression, then send them as is.
+        if (compressed.size() < buffer.size() - body_start)
+        {
+            flags |= COMPRESSED;
+            ext_flags |= codec.type() << Packet_Header::CODEC_SHIFT;
+            stats_.add_compression(buffer.size() - body_start, compressed.size());
+            buffer.resize(body_start);
+            buffer += compressed;
+        }
+    }
 
-    QDataStream ds(&packet, QIODevice::WriteOnly);
-    ds.setVersion(DATASTREAM_VERSION);
-    ds << uint16_t(0) << *msg.id_ << msg.cmd() << flags << data;
+    if (is_extended && is_body_checksum_)
+    {
+        ext_flags |= Packet_Header::BODY_CHECKSUM;
+        append_big_endian<uint32_t>(buffer, crc32c(reinterpret_cast<const uint8_t*>(buffer.constData()) + body_start, buffer.size() - body_start));
+    }
 
-    ds.device()->seek(0);
-    ds << qChecksum(packet.constData() + 2, 7);
+    // Acknowledge is needed only for messages which wait for something. Fragments is acknowledged by fragment query.
+    if (msg.end_time_ > now && !(flags & FRAGMENT))
+        ext_flags |= Packet_Header::ACK_REQUEST;
+
+    const uint32_t data_size = buffer.size() - body_start;
+    uchar* header = reinterpret_cast<uchar*>(buffer.data()) + start;
+    header[2] = static_cast<uint8_t>(*msg.id_);
+    header[3] = msg.cmd();
+    header[Packet_Header::FLAGS_POS] = flags;
+    qToBigEndian<quint32>(data_size, header + 5);
+    if (is_extended)
+    {
+        header[9] = static_cast<uint8_t>(*msg.id_ >> 24);
+        header[10] = static_cast<uint8_t>(*msg.id_ >> 16);
+        header[11] = static_cast<uint8_t>(*msg.id_ >> 8);
+        header[12] = ext_flags;
+    }
+    qToBigEndian<quint16>(Packet_Header::calc_checksum(header), header);
 
-    Time_Point now = std::chrono::system_clock::now();
     last_msg_send_time_ = now;
 
     if (DetailLog().isDebugEnabled())
     {
         auto dbg = qDebug(DetailLog).noquote()
-                << title() << "SEND id:" << (int)*msg.id_ << "cmd:" << (int)msg.cmd() << "flags:" << (int)flags << "size:" << data.size() << "wait:" << (msg.end_time_ > now);
+                << title() << "SEND id:" << *msg.id_ << "cmd:" << (int)msg.cmd() << "flags:" << (int)flags << "size:" << data_size << "wait:" << (msg.end_time_ > now);
         if (tt.time_since_epoch().count())
             dbg << "tt:" << std::chrono::duration_cast<std::chrono::milliseconds>(tt - now).count();
 
         if (flags & REPEATED) dbg << "REPEATED";
         if (flags & FRAGMENT_QUERY) dbg << "FRAGMENT_QUERY";
         if (flags & FRAGMENT) dbg << "FRAGMENT";
-        if (flags & ANSWER) dbg << "ANSWER " << int (*data.constData());
+        if (flags & ANSWER) dbg << "ANSWER " << *msg.answer_id_;
         if (flags & COMPRESSED) dbg << "COMPRESSED";
     }
 
+    msg.send_time_ = now;
+    if (!msg.begin_time_.time_since_epoch().count())
+        msg.begin_time_ = now;
+
+    stats_.add_out(buffer.size() - start);
+    if (flags & REPEATED)
+        stats_.add_retransmit();
+    if (flags & FRAGMENT_QUERY)
+        stats_.add_fragment_query_out();
+
     if (msg.end_time_ > now)
     {
+        std::chrono::milliseconds resend_timeout = msg.resend_timeout_;
+        if (resend_timeout.count() <= 0)
+            resend_timeout = std::min(rtt_.rto() * (1 << std::min<int>(msg.resend_count_, 8)), rtt_.max_rto());
+
         // Если время до повторной посылки меньше чем до таймаута, то используем его
-        Time_Point time_point = msg.resend_timeout_ < (msg.end_time_ - now) ?
-                    now + msg.resend_timeout_ :
+        Time_Point time_point = resend_timeout < (msg.end_time_ - now) ?
+                    now + resend_timeout :
                     msg.end_time_;
 
         int msg_cmd = msg.cmd();
@@ -190,7 +463,7 @@ QByteArray Protocol::prepare_packet_to_send(std::shared_ptr<Message_Item> msg_pt
             qCWarning(Log).noquote() << title() << "Prepare packet, but writer is not set. cmd:" << msg_cmd;
     }
 
-    return packet;
+    return buffer.size() - start;
 }
 
 void Protocol::add_raw_data_to_packet(QByteArray& data, uint32_t pos, uint32_t max_data_size, QIODevice* device)
@@ -210,183 +483,222 @@ void Protocol::process_bytes(const uint8_t* data, size_t size)
     {
         auto writer_ptr = writer();
         if (writer_ptr)
-            writer_ptr->set_last_msg_recv_time(std::chrono::system_clock::now());
+            writer_ptr->set_last_msg_recv_time(current_time());
     }
 
-    packet_end_position_.push(size);
-    device_.seek(device_.size());
-    device_.write(reinterpret_cast<const char*>(data), size);
-    device_.seek(0);
-
-    bool is_first_call = true;
-    while (!process_stream(is_first_call) && !packet_end_position_.empty())
+    if (!recv_buffer_.empty())
     {
-        /* Функция process_stream возвращает false только если чек-сумма используется и не совпала.
-         * И если она не совпала и в текущем device_ хранится несколько пакетов,
-         * то нужно удалить из него первый пакет и попробовать заново.
-         */
-
-        // Отбрасываем удачно обработанные пакеты
-        std::size_t pos = device_.pos();
-        while(!packet_end_position_.empty() && packet_end_position_.front() <= pos)
+        if (recv_buffer_.push(data, size))
         {
-            pos -= packet_end_position_.front();
-            packet_end_position_.pop();
+            recv_record_sizes_.push(size);
+            process_receive_buffer();
+            return;
         }
 
-        // Отбрасываем не удачно обработанный пакет
-        device_.seek(0);
-        device_.buffer().remove(0, static_cast<int>(packet_end_position_.front()));
-        packet_end_position_.pop();
-
-        if (is_first_call)
-            is_first_call = false;
+        qCWarning(Log).noquote() << title() << "Receive buffer overflow. Drop" << recv_buffer_.size() << "buffered bytes";
+        recv_buffer_.clear();
+        recv_record_sizes_ = std::queue<std::size_t>{};
     }
 
-    std::size_t pos = device_.pos();
-    while(!packet_end_position_.empty() && packet_end_position_.front() <= pos)
+    // Whole packets are processed straight from the caller's buffer, only unfinished tail is copied.
+    Packet_Header header;
+    std::size_t pos = 0;
+    while (size - pos >= Packet_Header::SIZE
+           && size - pos >= Packet_Header::size_of(data + pos))
     {
-        pos -= packet_end_position_.front();
-        packet_end_position_.pop();
-    }
+        header.parse(data + pos);
 
-    if (pos && !packet_end_position_.empty())
-        packet_end_position_.front() -= pos;
+        const Packet_Status status = check_packet(header, data + pos, size - pos, true);
+        if (status == PACKET_INCOMPLETE)
+            break;
+        else if (status != PACKET_OK || !process_packet(header, data + pos, true))
+            return; // The rest of the record is dropped, there is no next record to retry from.
 
-    if (device_.bytesAvailable())
-        device_.buffer().remove(0, static_cast<int>(device_.pos()));
-    else
-        device_.buffer().clear();
+        pos += header.size() + header.data_size_;
+    }
+
+    if (pos < size)
+    {
+        recv_buffer_.push(data + pos, size - pos);
+        recv_record_sizes_.push(size - pos);
+    }
 }
 
-bool Protocol::process_stream(bool is_first_call)
+void Protocol::process_receive_buffer()
 {
-    /* TODO:
-     * Нужно обрабатывать входящие пакеты отдельно, а не складывать их.
-     * Т.е. если сообщение состоит из двух пакетов, пришел первый, второй потерялся,
-     * а потом приходит первый пакет нового сообщения, то новое сообщение не будет обработано.
-     * Нужно хранить все пакеты отдельно или хотя бы позиции начала пакета, что бы если первое сообщение неудачное,
-     * то мы удаляем первый пакет, и пробуем заново.
-     *
-     * Но если протокол использует шифрование то это не актуально.
-     */
-
-    /* TODO:
-     * Нужно сделать чек-сумму на заголовки однобайтную,
-     * и добавить двух или трёх-байтную чек-сумму на тело сообщения
-     * если стоит флаг "Использовать чек-сумму".
-     */
-
-    bool checksum_ok;
-    uint8_t msg_id, cmd, flags;
-    uint16_t checksum;
-    uint32_t buffer_size;
-    uint64_t pos;
+    bool is_first_call = true;
+    Packet_Header header;
+    uint8_t header_data[Packet_Header::MAX_SIZE];
 
-    while (device_.bytesAvailable() >= 9)
+    while (recv_buffer_.size() >= Packet_Header::SIZE)
     {
-        pos = device_.pos();
+        recv_buffer_.peek(header_data, Packet_Header::SIZE);
+        const std::size_t header_size = Packet_Header::size_of(header_data);
+        if (recv_buffer_.size() < header_size)
+            break; // Wait more bytes
 
-        // Using QDataStream for auto swap bytes for big or little endian
-        msg_stream_ >> checksum >> msg_id >> cmd >> flags >> buffer_size;
-        checksum_ok = checksum == qChecksum(device_.buffer().constData() + pos + 2, 7);
+        recv_buffer_.peek(header_data, header_size);
+        header.parse(header_data);
 
-        if (DetailLog().isDebugEnabled())
+        const Packet_Status status = check_packet(header, header_data, recv_buffer_.size(), is_first_call);
+        if (status == PACKET_INCOMPLETE)
         {
-            auto dbg = qDebug(DetailLog).noquote() << title();
-            if (!is_first_call)
-                dbg << "Research";
-            dbg << "RECV id:" << (int)msg_id << "cmd:" << (int)cmd << "flags:" << (int)flags << "size:" << buffer_size << "ok:" << checksum_ok
-                    << "avail:" << device_.bytesAvailable() << packet_end_position_.size();
-
-            if (flags & REPEATED) dbg << "REPEATED";
-            if (flags & FRAGMENT_QUERY) dbg << "FRAGMENT_QUERY";
-            if (flags & FRAGMENT) dbg << "FRAGMENT";
-            if (flags & ANSWER) dbg << "ANSWER " << int (*(device_.buffer().constData() + pos + 9));
-            if (flags & COMPRESSED) dbg << "COMPRESSED";
+            break; // Wait more bytes
         }
-
-        if (buffer_size == 0xffffffff)
-            buffer_size = 0;
-
-        if (buffer_size > HELPZ_PROTOCOL_MAX_MESSAGE_SIZE)
+        else if (status == PACKET_TOO_BIG)
         {
-            if (is_first_call)
-                qCWarning(Log).noquote()
-                   << title() << "Message size" << buffer_size << "more then" << HELPZ_PROTOCOL_MAX_MESSAGE_SIZE
-                   << "Checksum in packet:" << qChecksum(device_.buffer().constData() + pos + 2, 7)
-                   << "expected:" << checksum;
-
-            device_.seek(device_.size());
-            return true;
+            recv_buffer_.clear();
+            recv_record_sizes_ = std::queue<std::size_t>{};
+            break;
         }
-        else if (!checksum_ok) // Drop message if checksum bad or too high size
+        else if (status == PACKET_OK)
         {
-            device_.seek(pos);
-
-            if (is_first_call)
+            const std::size_t packet_size = header.size() + header.data_size_;
+            if (process_packet(header, recv_buffer_.linearize(packet_size), is_first_call))
             {
-                qCWarning(Log).noquote() << title() << "Message corrupt, checksum isn't same."
-                               << "In packet:" << qChecksum(device_.buffer().constData() + pos + 2, 7)
-                               << "expected:" << checksum;
+                consume_receive_buffer(packet_size);
+                continue;
             }
-            return false;
-        }
-        else if (device_.bytesAvailable() < buffer_size) // else if all ok, but not enough bytes
-        {
-            device_.seek(pos);
-            return true; // Wait more bytes
         }
 
-        try
+        /* Пакет не прошёл проверку чек-суммы или его обработка завершилась исключением.
+         * Если в буфере хранится несколько записей, то отбрасываем запись с которой начинается пакет
+         * и пробуем заново со следующей.
+         */
+        drop_receive_record();
+        is_first_call = false;
+    }
+}
+
+void Protocol::consume_receive_buffer(std::size_t size)
+{
+    recv_buffer_.pop(size);
+
+    while (size && !recv_record_sizes_.empty())
+    {
+        std::size_t& record_size = recv_record_sizes_.front();
+        if (record_size > size)
         {
-            internal_process_message(msg_id, cmd, flags, device_.buffer().constData() + pos + 9, buffer_size);
+            record_size -= size;
+            break;
         }
-        catch(const std::exception& e)
+
+        size -= record_size;
+        recv_record_sizes_.pop();
+    }
+}
+
+void Protocol::drop_receive_record()
+{
+    if (recv_record_sizes_.empty())
+    {
+        recv_buffer_.clear();
+        return;
+    }
+
+    recv_buffer_.pop(recv_record_sizes_.front());
+    recv_record_sizes_.pop();
+}
+
+Protocol::Packet_Status Protocol::check_packet(const Packet_Header &header, const uint8_t *header_data, std::size_t available, bool is_first_call)
+{
+    const bool checksum_ok = header.is_checksum_valid(header_data);
+
+    if (DetailLog().isDebugEnabled())
+    {
+        auto dbg = qDebug(DetailLog).noquote() << title();
+        if (!is_first_call)
+            dbg << "Research";
+        dbg << "RECV id:" << header.id_ << "cmd:" << (int)header.cmd_ << "flags:" << (int)header.flags_
+            << "size:" << header.data_size_ << "ok:" << checksum_ok
+            << "avail:" << available << recv_record_sizes_.size();
+
+        if (header.flags_ & REPEATED) dbg << "REPEATED";
+        if (header.flags_ & FRAGMENT_QUERY) dbg << "FRAGMENT_QUERY";
+        if (header.flags_ & FRAGMENT) dbg << "FRAGMENT";
+        if (header.flags_ & ANSWER) dbg << "ANSWER";
+        if (header.flags_ & COMPRESSED) dbg << "COMPRESSED";
+        if (header.ext_flags_ & Packet_Header::ACK_REQUEST) dbg << "ACK_REQUEST";
+    }
+
+    if (!checksum_ok) // Drop message if checksum bad
+    {
+        if (is_first_call)
         {
-            if (is_first_call)
-                qCCritical(Log).noquote() << title() << "EXCEPTION: process_stream" << int(cmd) << e.what();
-            return false;
+            qCWarning(Log).noquote() << title() << "Message corrupt, checksum isn't same."
+                                     << "In packet:" << Packet_Header::calc_checksum(header_data)
+                                     << "expected:" << header.checksum_;
         }
-        catch(...)
+        return PACKET_CORRUPT;
+    }
+    else if (header.data_size_ > HELPZ_PROTOCOL_MAX_MESSAGE_SIZE)
+    {
+        if (is_first_call)
+            qCWarning(Log).noquote()
+               << title() << "Message size" << header.data_size_ << "more then" << HELPZ_PROTOCOL_MAX_MESSAGE_SIZE;
+        return PACKET_TOO_BIG;
+    }
+    else if (available - header.size() < header.data_size_) // else if all ok, but not enough bytes
+    {
+        if (header.size() + header.data_size_ > recv_buffer_.capacity())
         {
             if (is_first_call)
-                qCCritical(Log).noquote() << title() << "EXCEPTION Unknown: process_stream" << int(cmd);
-            return false;
+                qCWarning(Log).noquote() << title() << "Message size" << header.data_size_
+                                         << "more then receive buffer" << recv_buffer_.capacity();
+            return PACKET_TOO_BIG;
         }
-
-        device_.seek(pos + 9 + buffer_size);
+        return PACKET_INCOMPLETE;
     }
 
-    return true;
+    return PACKET_OK;
+}
+
+bool Protocol::process_packet(const Packet_Header &header, const uint8_t *data, bool is_first_call)
+{
+    try
+    {
+        internal_process_message(header, reinterpret_cast<const char*>(data) + header.size());
+        stats_.add_in(header.size() + header.data_size_);
+        send_pending_messages();
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        if (is_first_call)
+            qCCritical(Log).noquote() << title() << "EXCEPTION: process_packet" << int(header.cmd_) << e.what();
+    }
+    catch(...)
+    {
+        if (is_first_call)
+            qCCritical(Log).noquote() << title() << "EXCEPTION Unknown: process_packet" << int(header.cmd_);
+    }
+    return false;
 }
 
-bool Protocol::is_lost_message(uint8_t msg_id)
+bool Protocol::is_lost_message(Receive_Sequence& sequence, uint32_t msg_id)
 {
-    auto it = lost_msg_list_.find(msg_id);
-    if (it == lost_msg_list_.end())
+    auto it = sequence.lost_msg_list_.find(msg_id);
+    if (it == sequence.lost_msg_list_.end())
         return false;
 
     const Time_Point tp = it->second;
-    lost_msg_list_.erase(it);
+    sequence.lost_msg_list_.erase(it);
 
-    return std::chrono::system_clock::now() - tp < std::chrono::seconds(10);
+    return current_time() - tp < std::chrono::seconds(10);
 }
 
-void Protocol::fill_lost_msg(uint8_t msg_id)
+void Protocol::fill_lost_msg(Receive_Sequence& sequence, uint32_t msg_id)
 {
-    const Time_Point now = std::chrono::system_clock::now();
+    const Time_Point now = current_time();
 
     const Time_Point max_tp = now - std::chrono::seconds(10);
-    const uint32_t min_id = std::numeric_limits<uint8_t>::max() + static_cast<uint8_t>(msg_id - 100);
-    const uint32_t max_id = std::numeric_limits<uint8_t>::max() + msg_id;
+    const uint32_t window = sequence.window_;
 
-    for (auto it = lost_msg_list_.begin(); it != lost_msg_list_.end(); )
+    for (auto it = sequence.lost_msg_list_.begin(); it != sequence.lost_msg_list_.end(); )
     {
-        const uint32_t tmp_id = std::numeric_limits<uint8_t>::max() + it->first;
+        const uint32_t distance = sequence.distance(it->first, msg_id);
 
-        if (max_tp > it->second
-            || (min_id > tmp_id && tmp_id > max_id))
+        if (max_tp > it->second || distance > window)
         {
             const bool is_fragmented = fragmented_messages_.erase(it->first) > 0;
 
@@ -396,38 +708,77 @@ void Protocol::fill_lost_msg(uint8_t msg_id)
                 if (max_tp > it->second)
                     dbg << "time:" << std::chrono::duration_cast<std::chrono::milliseconds>(max_tp - it->second).count();
                 else
-                    dbg << "min_id" << min_id << "tmp_id" << tmp_id << "max_id" << max_id;
+                    dbg << "distance" << distance << "window" << window;
 
                 if (is_fragmented)
                     dbg << " is_fragmented";
             }
 
-            it = lost_msg_list_.erase(it);
+            it = sequence.lost_msg_list_.erase(it);
         }
         else
             ++it;
     }
 
-    if (msg_id > (next_rx_msg_id_ + 100))
-        next_rx_msg_id_ = static_cast<uint8_t>(msg_id - 100);
+    if (sequence.distance(sequence.next_id_, msg_id) > window)
+        sequence.next_id_ = sequence.before(msg_id, window);
 
-    while (msg_id != next_rx_msg_id_)
-        lost_msg_list_.emplace(next_rx_msg_id_++, now);
+    while (msg_id != sequence.next_id_)
+    {
+        if (sequence.lost_msg_list_.emplace(sequence.next_id_, now).second)
+            stats_.add_lost_msg();
+        sequence.next_id_ = sequence.next_after(sequence.next_id_);
+    }
 }
 
-void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t flags, const char *data_ptr, uint32_t data_size)
+void Protocol::internal_process_message(const Packet_Header& header, const char *data_ptr)
 {
+    const uint32_t msg_id = header.id_;
+    const uint8_t cmd = header.cmd_, flags = header.flags_;
+    uint32_t data_size = header.data_size_;
+    const bool is_extended = header.is_extended();
+
+    // Header is valid, so stream isn't broken, only this packet is dropped. Sender will repeat it if needed.
+    if (header.ext_flags_ & Packet_Header::BODY_CHECKSUM)
+    {
+        if (data_size < 4)
+        {
+            qCWarning(Log).noquote() << title() << "BODY_CHECKSUM flag is setted, but data_size is" << data_size;
+            return;
+        }
+
+        data_size -= 4;
+        const uint32_t crc = qFromBigEndian<quint32>(data_ptr + data_size);
+        const uint32_t expected = crc32c(reinterpret_cast<const uint8_t*>(data_ptr), data_size);
+        if (crc != expected)
+        {
+            qCWarning(Log).noquote() << title() << "Message body corrupt, id:" << msg_id << "cmd:" << int(cmd)
+                                     << "In packet:" << crc << "expected:" << expected;
+            return;
+        }
+    }
+
+    if (flags & (EXTENDED_SUPPORTED | EXTENDED_HEADER)
+        && !is_peer_extended_.exchange(true) && max_version_ >= 2)
+        send_codecs();
+
+    // Repeated message is acknowledged again, because previous acknowledge may be lost.
+    if (header.ext_flags_ & Packet_Header::ACK_REQUEST)
+        add_ack(msg_id);
+
+    Receive_Sequence& sequence = receive_sequence(msg_id, is_extended);
+    const uint32_t distance_to_next = sequence.distance(msg_id, sequence.next_id_);
+
     if (flags & REPEATED
-        || (msg_id < next_rx_msg_id_
-            && (next_rx_msg_id_ - msg_id) < 100))
+        || (distance_to_next != 0 && distance_to_next < sequence.window_))
     {
-        if (is_lost_message(msg_id))
+        if (is_lost_message(sequence, msg_id))
             qCDebug(DetailLog).noquote() << title() << "Find lost message" << msg_id;
         else if (flags & REPEATED)
         {
             if (DetailLog().isDebugEnabled())
             {
-                auto dbg = qDebug(DetailLog).noquote() << title() << "Dropped message" << msg_id << "expected" << next_rx_msg_id_
+                auto dbg = qDebug(DetailLog).noquote() << title() << "Dropped message" << msg_id << "expected" << sequence.next_id_
                                                        << "Cmd:" << cmd << "Flags:" << int(flags) << "Size:" << data_size;
                 if (flags & REPEATED) dbg << "REPEATED";
                 if (flags & FRAGMENT_QUERY) dbg << "FRAGMENT_QUERY";
@@ -440,18 +791,16 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
     }
     else
     {
-        if (msg_id > next_rx_msg_id_
-            || (next_rx_msg_id_ - msg_id) > 100)
+        if (distance_to_next != 0)
         {
-            lost_msg_detected(msg_id, next_rx_msg_id_);
+            lost_msg_detected(msg_id, sequence.next_id_);
 
-            qCDebug(DetailLog).noquote() << title() << "Packet is lost from" << next_rx_msg_id_ << ". Receive message:" << msg_id;
+            qCDebug(DetailLog).noquote() << title() << "Packet is lost from" << sequence.next_id_ << ". Receive message:" << msg_id;
 
-            fill_lost_msg(msg_id);
+            fill_lost_msg(sequence, msg_id);
         }
 
-        if ((msg_id + 1) >= (next_rx_msg_id_ + 1))
-            next_rx_msg_id_ = static_cast<uint8_t>(msg_id + 1);
+        sequence.next_id_ = sequence.next_after(msg_id);
     }
 
     // If COMPRESSED or FRAGMENT flag is setted, then data_size can not be zero.
@@ -464,40 +813,92 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
     QByteArray data;
     if (flags & COMPRESSED)
     {
-        data = qUncompress(reinterpret_cast<const uchar*>(data_ptr), data_size);
-        if (data.isEmpty())
-            throw std::runtime_error("Failed uncompress");
+        const uint8_t codec_type = is_extended ? header.codec_type() : static_cast<uint8_t>(Codec::ZLIB);
+        const Codec* codec = codecs_->get(codec_type);
+        if (!codec)
+            throw std::runtime_error("Unknown codec " + std::to_string(codec_type));
+        data = codec->uncompress(cmd, data_ptr, data_size);
     }
     else
         data.setRawData(data_ptr, data_size);
 
     if (cmd == Cmd::REMOVE_FRAGMENT)
     {
-        uint8_t fragment_id;
-        Helpz::parse_out(DATASTREAM_VERSION, data, fragment_id);
-        fragmented_messages_.erase(fragment_id);
+        QDataStream ds(&data, QIODevice::ReadOnly);
+        ds.setVersion(DATASTREAM_VERSION);
+        fragmented_messages_.erase(read_msg_id(ds, is_extended));
+    }
+    else if (cmd == Cmd::ACK)
+    {
+        process_ack(data);
+    }
+    else if (cmd == Cmd::CODECS)
+    {
+        QDataStream ds(&data, QIODevice::ReadOnly);
+        ds.setVersion(DATASTREAM_VERSION);
+        const uint8_t mask = Helpz::parse<uint8_t>(ds);
+        peer_codec_mask_ = mask | (1 << Codec::ZLIB);
+
+        // Features byte is added after mask, older peers don't send it
+        const uint8_t features = ds.atEnd() ? 0 : Helpz::parse<uint8_t>(ds);
+        if ((features & STREAMS_FEATURE) && max_version_ >= 2 && !is_peer_streams_.exchange(true))
+            rx_ext_sequence_.id_mask_ = (uint32_t(1) << HELPZ_PROTOCOL_STREAM_SHIFT) - 1;
+        qCDebug(DetailLog).noquote() << title() << "Peer codecs mask:" << int(mask) << "features:" << int(features);
     }
     else if (flags & FRAGMENT_QUERY)
     {
-        apply_parse(data, &Protocol::process_fragment_query);
+        QDataStream ds(&data, QIODevice::ReadOnly);
+        ds.setVersion(DATASTREAM_VERSION);
+
+        const uint32_t fragmanted_msg_id = read_msg_id(ds, is_extended);
+        uint32_t pos, fragmanted_size;
+        Helpz::parse_out(ds, pos, fragmanted_size);
+
+        std::vector<std::pair<uint32_t, uint32_t>> next_parts;
+        uint8_t fec_group = 0;
+        if (is_extended && !ds.atEnd())
+        {
+            uint8_t count = Helpz::parse<uint8_t>(ds);
+            next_parts.resize(count);
+            for (std::pair<uint32_t, uint32_t>& part: next_parts)
+                Helpz::parse_out(ds, part.first, part.second);
+
+            // Parity group is added after parts, older receivers don't send it
+            if (!ds.atEnd())
+                fec_group = Helpz::parse<uint8_t>(ds);
+        }
+
+        process_fragment_query(fragmanted_msg_id, pos, fragmanted_size, std::move(next_parts), fec_group);
     }
     else if (flags & (FRAGMENT | ANSWER))
     {
         QDataStream ds(&data, QIODevice::ReadOnly);
         ds.setVersion(DATASTREAM_VERSION);
 
-        uint8_t answer_id;
+        uint32_t answer_id = 0;
         if (flags & ANSWER)
-            Helpz::parse_out(ds, answer_id);
+            answer_id = read_msg_id(ds, is_extended);
 
         if (flags & FRAGMENT)
         {
-            uint32_t full_size, pos;
-            Helpz::parse_out(ds, full_size, pos);
+            const bool is_fec_parity = header.ext_flags_ & Packet_Header::FEC_PARITY;
+            uint32_t full_size = Helpz::parse<uint32_t>(ds), pos = 0, max_fragment_size = 0;
 
-            uint32_t max_fragment_size = full_size == pos ? Helpz::parse<uint32_t>(ds) : 0;
+            std::vector<QPair<uint32_t, uint32_t>> fec_parts;
+            if (is_fec_parity)
+            {
+                fec_parts.resize(Helpz::parse<uint8_t>(ds));
+                for (QPair<uint32_t, uint32_t>& part: fec_parts)
+                    Helpz::parse_out(ds, part.first, part.second);
+            }
+            else
+            {
+                pos = Helpz::parse<uint32_t>(ds);
+                if (full_size == pos)
+                    max_fragment_size = Helpz::parse<uint32_t>(ds);
+            }
 
-            std::map<uint8_t, Fragmented_Message>::iterator it = fragmented_messages_.find(msg_id);
+            std::map<uint32_t, Fragmented_Message>::iterator it = fragmented_messages_.find(msg_id);
 
             if (full_size >= HELPZ_PROTOCOL_MAX_MESSAGE_SIZE)
             {
@@ -509,10 +910,17 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
 
             if (it == fragmented_messages_.end())
             {
+                // Parity of finished message or of one which isn't started yet is useless
+                if (is_fec_parity)
+                    return;
+
                 if (max_fragment_size == 0 || max_fragment_size > HELPZ_MAX_PACKET_DATA_SIZE)
                     max_fragment_size = HELPZ_MAX_MESSAGE_DATA_SIZE;
 
                 Fragmented_Message msg{msg_id, cmd, max_fragment_size, full_size};
+                msg.is_extended_ = is_extended;
+                if (!(flags & ANSWER) && is_stream_receive(cmd))
+                    msg.stream_.reset(new Fragment_Stream(full_size));
                 it = fragmented_messages_.emplace(msg_id, std::move(msg)).first;
             }
             Fragmented_Message &msg = it->second;
@@ -526,15 +934,33 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
 
             qCDebug(DetailLog).noquote() << title() << "Fragment msg" << msg_id << "full" << full_size << "pos" << pos << "size" << ds.device()->bytesAvailable();
 
+            bool is_part_received = !is_fec_parity;
             if (!ds.atEnd())
             {
                 uint32_t data_pos = static_cast<uint32_t>(ds.device()->pos());
-                msg.add_data(pos, data.constData() + data_pos, data.size() - data_pos);
+                if (is_fec_parity)
+                {
+                    is_part_received = msg.add_parity(fec_parts, data.constData() + data_pos, data.size() - data_pos);
+                    if (is_part_received)
+                    {
+                        qCDebug(DetailLog).noquote() << title() << "Fragment restored by parity msg" << msg_id;
+                        stats_.add_fec_restored();
+                    }
+                }
+                else
+                    msg.add_data(pos, data.constData() + data_pos, data.size() - data_pos);
             }
 
+            // Restored part was lost too
+            if (msg.is_extended_ && (is_part_received || !is_fec_parity))
+                fec_estimator_.add(is_fec_parity);
+
             auto msg_out = send(cmd);
             msg_out.msg_.set_flags(msg_out.msg_.flags() | FRAGMENT_QUERY, Message_Item::Only_Protocol());
-            msg_out << msg_id;
+            msg_out.set_priority(INTERACTIVE_PRIORITY);
+            if (is_peer_streams_)
+                msg_out.set_stream(stream_of(msg_id));
+            write_msg_id(msg_out, msg_id, msg_out.msg_.flags() & EXTENDED_HEADER);
 
             if (msg.is_parts_empty())
             {
@@ -556,6 +982,11 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
                         process_answer_message(msg_id, cmd, *msg.data_device_);
                     }
                 }
+                else if (msg.stream_)
+                {
+                    msg.update_stream();
+                    process_stream_message(msg_id, cmd, *msg.stream_);
+                }
                 else
                 {
                     process_message(msg_id, cmd, *msg.data_device_);
@@ -565,14 +996,23 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
             }
             else
             {
+                if (msg.update_stream())
+                    process_stream_message(msg_id, cmd, *msg.stream_);
+
                 msg.data_device_->close();
 
-                Time_Point now = std::chrono::system_clock::now();
-                auto emp_it = lost_msg_list_.emplace(msg_id, now);
+                Time_Point now = current_time();
+                auto emp_it = sequence.lost_msg_list_.emplace(msg_id, now);
                 if (!emp_it.second)
                     emp_it.first->second = now;
                 msg.last_part_time_ = now;
 
+                if (!is_part_received)
+                {
+                    msg_out.release();
+                    return;
+                }
+
                 if (msg.max_fragment_size_ < HELPZ_MAX_MESSAGE_DATA_SIZE)
                 {
                     msg.max_fragment_size_ += msg.max_fragment_size_ / 5;
@@ -580,8 +1020,35 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
                         msg.max_fragment_size_ = HELPZ_MAX_MESSAGE_DATA_SIZE;
                 }
 
-                const QPair<uint32_t, uint32_t> next_part = msg.get_next_part();
-                msg_out << next_part;
+                if (msg.is_extended_)
+                {
+                    if (msg.in_flight_)
+                        --msg.in_flight_;
+
+                    // Next parts are requested when half of window is received, so sender always has parts to send.
+                    if (msg.in_flight_ > msg.window_ / 2)
+                    {
+                        msg_out.release();
+                        return;
+                    }
+
+                    if (msg.window_ < HELPZ_PROTOCOL_MAX_FRAGMENT_WINDOW)
+                        ++msg.window_;
+
+                    if (!add_fragment_window_query(msg_out, msg))
+                    {
+                        msg_out.release();
+                        return;
+                    }
+                }
+                else
+                {
+                    const QPair<uint32_t, uint32_t> next_part = msg.get_next_part();
+                    msg_out << next_part;
+
+                    qCDebug(DetailLog).noquote() << title() << "Send fragment query msg" << msg_id
+                                                 << "full" << full_size << "part" << next_part;
+                }
 
                 auto writer_ptr = writer();
                 if (writer_ptr)
@@ -589,17 +1056,22 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
                     intptr_t value = FRAGMENT;
                     writer_ptr->add_timeout_at(now + std::chrono::milliseconds(1505), reinterpret_cast<void*>(value));
                 }
-
-                qCDebug(DetailLog).noquote() << title() << "Send fragment query msg" << msg_id
-                                             << "full" << full_size << "part" << next_part;
             }
         }
         else
         {
             std::shared_ptr<Message_Item> msg = pop_waiting_answer(answer_id, cmd);
+            if (msg)
+            {
+                const Time_Point now = current_time();
+                if (!(msg->flags() & REPEATED))
+                    rtt_.add_sample(std::chrono::duration_cast<std::chrono::microseconds>(now - msg->send_time_));
+                stats_.add_answer_latency(std::chrono::duration_cast<std::chrono::microseconds>(now - msg->begin_time_));
+            }
+
             if (msg && msg->answer_func_)
             {
-                data.remove(0, 1);
+                data.remove(0, static_cast<int>(ds.device()->pos()));
 
                 QBuffer buffer(&data);
                 msg->answer_func_(buffer);
@@ -621,24 +1093,218 @@ void Protocol::internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t fla
     }
 }
 
-void Protocol::process_fragment_query(uint8_t fragmanted_msg_id, uint32_t pos, uint32_t fragmanted_size)
+void Protocol::process_stream_message(uint32_t msg_id, uint8_t cmd, Fragment_Stream &stream)
+{
+    if (stream.is_finished())
+        process_message(msg_id, cmd, stream);
+}
+
+void Protocol::process_fragment_query(uint32_t fragmanted_msg_id, uint32_t pos, uint32_t fragmanted_size,
+                                      std::vector<std::pair<uint32_t, uint32_t>>&& next_parts, uint8_t fec_group)
 {
+    stats_.add_fragment_query_in();
     std::shared_ptr<Message_Item> msg = pop_waiting_fragment(fragmanted_msg_id);
+
+    // Message is written out of lock, because writer may prepare packet right in send_message
+    std::unique_lock lock(mutex_);
+
+    // Query to windowed transfer may come before last sent parts is received, so it isn't measured
+    if (msg && !msg->is_fragment_window_ && !(msg->flags() & REPEATED))
+        rtt_.add_sample(std::chrono::duration_cast<std::chrono::microseconds>(current_time() - msg->send_time_));
+
     if (msg && msg->data_device_ && pos < msg->data_device_->size())
     {
-        qCDebug(DetailLog).noquote() << title() << "Process fragment query msg" << fragmanted_msg_id << "full" << msg->data_device_->size() << "pos" << pos << "size" << fragmanted_size;
+        qCDebug(DetailLog).noquote() << title() << "Process fragment query msg" << fragmanted_msg_id << "full" << msg->data_device_->size()
+                                     << "pos" << pos << "size" << fragmanted_size << "next parts" << next_parts.size();
+
+        if (next_parts.empty() && !msg->is_fragment_window_)
+        {
+            msg->set_fragment_size(fragmanted_size);
+            msg->data_device_->seek(pos);
+            lock.unlock();
+            send_message(std::move(msg));
+            return;
+        }
 
-        msg->set_fragment_size(fragmanted_size);
-        msg->data_device_->seek(pos);
-        send_message(std::move(msg));
+        /* Each write sends one part. Writes which are already posted for previous query
+         * send parts of this one, so only missing writes are posted.
+         */
+        const std::size_t posted_count = msg->fragment_parts_.size();
+        msg->is_fragment_window_ = true;
+        msg->fragment_parts_.clear();
+        msg->fragment_parts_.emplace_back(pos, fragmanted_size);
+        for (const std::pair<uint32_t, uint32_t>& part: next_parts)
+            if (part.first < msg->data_device_->size())
+                msg->fragment_parts_.push_back(part);
+
+        // Parity part is queued after each group of parts, parts of previous query which are sent without it stay unprotected
+        msg->fec_group_ = fec_group;
+        msg->fec_parts_.clear();
+        msg->fec_parity_.clear();
+        if (fec_group)
+        {
+            const std::size_t part_count = msg->fragment_parts_.size();
+            for (std::size_t i = part_count; i > 0; --i)
+                if (i % fec_group == 0 || (i == part_count && i % fec_group > 1))
+                    msg->fragment_parts_.emplace(msg->fragment_parts_.begin() + i, Message_Item::FEC_PARITY_PART, 0);
+        }
+
+        const std::size_t queued_count = msg->fragment_parts_.size();
+        lock.unlock();
+
+        for (std::size_t i = posted_count; i < queued_count; ++i)
+            send_message(msg);
     }
     else
     {
+        lock.unlock();
         if (msg && msg->answer_func_)
             add_to_waiting(msg->end_time_, msg);
 
         qCDebug(DetailLog).noquote() << title() << "Send remove unknown fragment" << fragmanted_msg_id;
-        send(Cmd::REMOVE_FRAGMENT) << fragmanted_msg_id;
+        auto msg_out = send(Cmd::REMOVE_FRAGMENT);
+        write_msg_id(msg_out, fragmanted_msg_id, msg_out.msg_.flags() & EXTENDED_HEADER);
+    }
+}
+
+bool Protocol::add_fragment_window_query(Protocol_Sender &msg_out, Fragmented_Message &msg)
+{
+    const uint32_t count = msg.window_ > msg.in_flight_ ? msg.window_ - msg.in_flight_ : 0;
+    std::vector<QPair<uint32_t, uint32_t>> parts = msg.get_next_parts(msg.requested_pos_, count);
+
+    // All parts is requested, repeat lost ones from the beginning
+    if (parts.empty() && msg.in_flight_ == 0)
+        parts = msg.get_next_parts(0, count);
+
+    if (parts.empty())
+        return false;
+
+    msg_out << parts.front() << static_cast<uint8_t>(parts.size() - 1);
+    for (std::size_t i = 1; i < parts.size(); ++i)
+        msg_out << parts.at(i);
+
+    const uint8_t fec_group = is_fec_ ? fec_estimator_.group_size() : 0;
+    if (fec_group)
+        msg_out << fec_group;
+
+    msg.in_flight_ += static_cast<uint32_t>(parts.size());
+    msg.requested_pos_ = parts.back().first + parts.back().second;
+
+    qCDebug(DetailLog).noquote() << title() << "Send fragment query msg" << msg.id_ << "parts" << parts.size()
+                                 << "from" << parts.front() << "window" << msg.window_;
+    return true;
+}
+
+void Protocol::add_ack(uint32_t msg_id)
+{
+    bool is_first, is_full;
+    {
+        std::lock_guard lock(mutex_);
+        is_first = ack_ranges_.empty();
+
+        if (!is_first && ack_ranges_.back().second + 1 == msg_id)
+            ack_ranges_.back().second = msg_id;
+        else if (is_first || ack_ranges_.back().second != msg_id)
+            ack_ranges_.emplace_back(msg_id, msg_id);
+
+        is_full = ack_ranges_.size() >= HELPZ_PROTOCOL_MAX_ACK_RANGES;
+    }
+
+    if (is_full)
+    {
+        send_ack();
+    }
+    else if (is_first)
+    {
+        // Wait a bit to acknowledge several messages in one packet
+        auto writer_ptr = writer();
+        if (writer_ptr)
+        {
+            intptr_t value = Cmd::ACK;
+            writer_ptr->add_timeout_at(current_time() + std::chrono::milliseconds(20), reinterpret_cast<void*>(value));
+        }
+    }
+}
+
+void Protocol::send_ack()
+{
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    {
+        std::lock_guard lock(mutex_);
+        ranges.swap(ack_ranges_);
+    }
+
+    if (ranges.empty())
+        return;
+
+    auto msg_out = send(Cmd::ACK);
+    msg_out << static_cast<uint8_t>(ranges.size());
+    for (const std::pair<uint32_t, uint32_t>& range: ranges)
+        msg_out << range.first << range.second;
+}
+
+void Protocol::process_ack(const QByteArray &data)
+{
+    QDataStream ds(data);
+    ds.setVersion(DATASTREAM_VERSION);
+
+    uint8_t count;
+    Helpz::parse_out(ds, count);
+
+    std::vector<std::shared_ptr<Message_Item>> messages;
+    uint32_t first_id, last_id;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        Helpz::parse_out(ds, first_id, last_id);
+
+        std::lock_guard lock(mutex_);
+        std::vector<std::shared_ptr<Message_Item>> acked = waiting_messages_.pop_unacked(first_id, last_id);
+        std::move(acked.begin(), acked.end(), std::back_inserter(messages));
+    }
+
+    const Time_Point now = current_time();
+    auto writer_ptr = writer();
+
+    for (std::shared_ptr<Message_Item>& msg: messages)
+    {
+        qCDebug(DetailLog).noquote() << title() << "Message acknowledged" << msg->id_.value_or(0);
+
+        // Message is delivered, but still wait answer, so don't resend it
+        if (msg->answer_func_ && msg->end_time_ > now)
+        {
+            const Time_Point end_time = msg->end_time_;
+            add_to_waiting(end_time, std::move(msg), true);
+            if (writer_ptr)
+                writer_ptr->add_timeout_at(end_time);
+        }
+    }
+}
+
+void Protocol::send_pending_messages()
+{
+    std::vector<std::shared_ptr<Message_Item>> messages;
+    {
+        std::lock_guard lock(mutex_);
+        std::size_t unacked_count = waiting_messages_.unacked_count();
+        while (!pending_messages_.empty() && unacked_count++ < window_size_)
+        {
+            messages.push_back(std::move(pending_messages_.front()));
+            pending_messages_.pop_front();
+        }
+    }
+
+    const Time_Point now = current_time();
+    for (std::shared_ptr<Message_Item>& msg: messages)
+    {
+        if (msg->end_time_ > now)
+            send_message(std::move(msg));
+        else
+        {
+            qCDebug(DetailLog).noquote() << title() << "Message timeout in send queue. cmd:" << int(msg->cmd());
+
+            if (msg->timeout_func_)
+                msg->timeout_func_();
+        }
     }
 }
 
@@ -649,41 +1315,76 @@ void Protocol::process_wait_list(void *data)
         intptr_t value = reinterpret_cast<intptr_t>(data);
         if (value == FRAGMENT)
         {
-            Time_Point now = std::chrono::system_clock::now();
+            Time_Point now = current_time();
+            Time_Point next_check_time;
             auto writer_ptr = writer();
 
             for (auto& it: fragmented_messages_)
             {
                 Fragmented_Message& msg = it.second;
-                if (!msg.is_parts_empty()
-                    && now - msg.last_part_time_ >= std::chrono::milliseconds(1500))
-                {
-                    msg.max_fragment_size_ /= 2;
-                    if (msg.max_fragment_size_ < 128)
-                        msg.max_fragment_size_ = 128;
+                if (msg.is_parts_empty())
+                    continue;
 
-                    lost_msg_list_.emplace(msg.id_, now);
+                if (now - msg.last_part_time_ < std::chrono::milliseconds(1500))
+                {
+                    // Timer is one per connection, so it's set again for the nearest waiting message
+                    const Time_Point check_time = msg.last_part_time_ + std::chrono::milliseconds(1505);
+                    if (next_check_time == Time_Point{} || check_time < next_check_time)
+                        next_check_time = check_time;
+                }
+                else
+                {
+                    Receive_Sequence& sequence = receive_sequence(msg.id_, msg.is_extended_);
+                    sequence.lost_msg_list_.emplace(msg.id_, now);
                     msg.last_part_time_ = now;
 
-                    const QPair<uint32_t, uint32_t> next_part = msg.get_next_part();
-
                     auto msg_out = send(msg.cmd_);
                     msg_out.msg_.set_flags(msg_out.msg_.flags() | FRAGMENT_QUERY, Message_Item::Only_Protocol());
-                    msg_out << msg.id_ << next_part;
+                    msg_out.set_priority(INTERACTIVE_PRIORITY);
+                    if (is_peer_streams_)
+                        msg_out.set_stream(stream_of(msg.id_));
+                    write_msg_id(msg_out, msg.id_, msg_out.msg_.flags() & EXTENDED_HEADER);
+
+                    if (msg.is_extended_)
+                    {
+                        // Requested parts is lost, so link is congested. Request lost parts again with smaller window.
+                        fec_estimator_.add(true, msg.in_flight_);
+                        msg.window_ = std::max<uint32_t>(msg.window_ / 2, 1);
+                        msg.in_flight_ = 0;
+                        msg.requested_pos_ = 0;
+                        add_fragment_window_query(msg_out, msg);
+                    }
+                    else
+                    {
+                        msg.max_fragment_size_ /= 2;
+                        if (msg.max_fragment_size_ < 128)
+                            msg.max_fragment_size_ = 128;
+
+                        const QPair<uint32_t, uint32_t> next_part = msg.get_next_part();
+                        msg_out << next_part;
+
+                        qCDebug(DetailLog).noquote() << title() << "Send fragment query msg" << msg.id_ << "part" << next_part;
+                    }
 
                     if (writer_ptr)
                         writer_ptr->add_timeout_at(now + std::chrono::milliseconds(1505), reinterpret_cast<void*>(value));
-
-                    qCDebug(DetailLog).noquote() << title() << "Send fragment query msg" << msg.id_ << "part" << next_part;
                 }
             }
+
+            if (writer_ptr && next_check_time != Time_Point{})
+                writer_ptr->add_timeout_at(next_check_time, reinterpret_cast<void*>(value));
+            return;
+        }
+        else if (value == Cmd::ACK)
+        {
+            send_ack();
             return;
         }
     }
 
     std::vector<std::shared_ptr<Message_Item>> messages = pop_waiting_messages();
 
-    Time_Point now = std::chrono::system_clock::now();
+    Time_Point now = current_time();
     for (std::shared_ptr<Message_Item>& msg: messages)
     {
         if (!msg)
@@ -691,8 +1392,15 @@ void Protocol::process_wait_list(void *data)
 
         if (msg->end_time_ > now && msg->data_device_)
         {
-            msg->set_fragment_size(msg->fragment_size() / 2);
+            {
+                std::lock_guard lock(mutex_);
+                msg->is_fragment_window_ = false;
+                msg->fragment_parts_.clear();
+                msg->set_fragment_size(msg->fragment_size() / 2);
+            }
             msg->set_flags(msg->flags() | REPEATED, Message_Item::Only_Protocol());
+            if (msg->resend_count_ < 0xff)
+                ++msg->resend_count_;
             send_message(std::move(msg));
         }
         else
@@ -703,59 +1411,142 @@ void Protocol::process_wait_list(void *data)
                 msg->timeout_func_();
         }
     }
+
+    send_pending_messages();
+
+    Time_Point next_time_point;
+    {
+        std::lock_guard lock(mutex_);
+        next_time_point = waiting_messages_.next_time_point();
+    }
+
+    if (next_time_point != Time_Point{})
+    {
+        auto writer_ptr = writer();
+        if (writer_ptr)
+            writer_ptr->add_timeout_at(next_time_point);
+    }
 }
 
-void Protocol::add_to_waiting(Time_Point time_point, std::shared_ptr<Message_Item> message)
+bool Protocol::is_extended_tx() const
 {
-    std::lock_guard lock(mutex_);
+    return max_version_ >= 2 && is_peer_extended_;
+}
+
+Protocol::Receive_Sequence &Protocol::receive_sequence(uint32_t msg_id, bool is_extended)
+{
+    if (!is_extended)
+        return rx_sequence_;
 
-    uint8_t msg_id = message->id_.value_or(0);
-    pop_waiting_message([msg_id](const Message_Item &item) { return item.id_.value_or(0) == msg_id; });
+    const uint8_t stream = stream_of(msg_id);
+    if (!stream || !is_peer_streams_)
+        return rx_ext_sequence_;
 
-    waiting_messages_.emplace(std::move(time_point), std::move(message));
+    auto it = rx_streams_.find(stream);
+    if (it == rx_streams_.end())
+    {
+        const uint32_t base = static_cast<uint32_t>(stream) << HELPZ_PROTOCOL_STREAM_SHIFT;
+        it = rx_streams_.emplace(stream, Receive_Sequence{rx_ext_sequence_.id_mask_, rx_ext_sequence_.window_,
+                                                          HELPZ_PROTOCOL_FIRST_EXTENDED_ID, base}).first;
+    }
+    return it->second;
 }
 
-std::vector<std::shared_ptr<Message_Item>> Protocol::pop_waiting_messages()
+uint32_t Protocol::next_tx_ext_msg_id(uint8_t stream)
 {
-    std::vector<std::shared_ptr<Message_Item>> messages;
-    std::lock_guard lock(mutex_);
+    const uint32_t id_mask = is_peer_streams_ ? (uint32_t(1) << HELPZ_PROTOCOL_STREAM_SHIFT) - 1 : 0xffffffff;
 
-    Time_Point now = std::chrono::system_clock::now() + std::chrono::milliseconds(20);
-    for (auto it = waiting_messages_.begin(); it != waiting_messages_.end(); )
+    // Sequence number in id_mask, ids of version 1 are skipped on wrap
+    auto extended_id = [id_mask](uint32_t id)
     {
-        if (it->first > now)
-            break;
+        id &= id_mask;
+        return id < HELPZ_PROTOCOL_FIRST_EXTENDED_ID ? HELPZ_PROTOCOL_FIRST_EXTENDED_ID : id;
+    };
+
+    if (!stream || !is_peer_streams_)
+    {
+        uint32_t id = next_tx_ext_msg_id_;
+        while (!next_tx_ext_msg_id_.compare_exchange_weak(id, extended_id(extended_id(id) + 1)));
+        return extended_id(id);
+    }
+
+    // Called from prepare_packet_to_send under mutex_
+    auto it = tx_stream_ids_.emplace(stream, HELPZ_PROTOCOL_FIRST_EXTENDED_ID).first;
+    const uint32_t id = extended_id(it->second);
+    it->second = extended_id(id + 1);
+    return (static_cast<uint32_t>(stream) << HELPZ_PROTOCOL_STREAM_SHIFT) | id;
+}
+
+Protocol_Sender Protocol::make_sender(uint8_t cmd, std::optional<uint32_t> answer_id)
+{
+    auto ptr = writer();
+    Protocol_Sender sender(ptr ? ptr->protocol() : std::shared_ptr<Protocol>(), cmd, std::move(answer_id), message_pool_->take_buffer());
+    if (is_extended_tx())
+        sender.msg_.set_flags(sender.msg_.flags() | EXTENDED_HEADER, Message_Item::Only_Protocol());
+    sender.msg_.set_codec_type(default_codec_type_);
+    if (answer_id && is_peer_streams_)
+        sender.set_stream(stream_of(*answer_id));
+    if (cmd < Cmd::USER_COMMAND)
+        sender.set_priority(INTERACTIVE_PRIORITY);
+    return sender;
+}
 
-        messages.push_back(std::move(it->second));
-        it = waiting_messages_.erase(it);
+const Codec& Protocol::select_codec(uint8_t codec_type, bool is_extended) const
+{
+    if (is_extended && codec_type <= Codec::MAX_TYPE && (peer_codec_mask_ & (1 << codec_type)))
+    {
+        const Codec* codec = codecs_->get(codec_type);
+        if (codec)
+            return *codec;
     }
-    return messages;
+
+    static const Zlib_Codec zlib_codec;
+    const Codec* codec = codecs_->get(Codec::ZLIB);
+    return codec ? *codec : zlib_codec;
+}
+
+void Protocol::send_codecs()
+{
+    send(Cmd::CODECS) << codecs_->mask() << static_cast<uint8_t>(STREAMS_FEATURE);
+}
+
+/*static*/ void Protocol::write_msg_id(QDataStream &ds, uint32_t msg_id, bool is_extended)
+{
+    if (is_extended)
+        ds << msg_id;
+    else
+        ds << static_cast<uint8_t>(msg_id);
 }
 
-std::shared_ptr<Message_Item> Protocol::pop_waiting_answer(uint8_t answer_id, uint8_t cmd)
+/*static*/ uint32_t Protocol::read_msg_id(QDataStream &ds, bool is_extended)
+{
+    if (is_extended)
+        return Helpz::parse<uint32_t>(ds);
+    return Helpz::parse<uint8_t>(ds);
+}
+
+void Protocol::add_to_waiting(Time_Point time_point, std::shared_ptr<Message_Item> message, bool is_acked)
 {
     std::lock_guard lock(mutex_);
-    return pop_waiting_message([answer_id, cmd](const Message_Item &item){ return item.id_.value_or(0) == answer_id && item.cmd() == cmd; });
+    waiting_messages_.add(std::move(time_point), std::move(message), is_acked);
 }
 
-std::shared_ptr<Message_Item> Protocol::pop_waiting_fragment(uint8_t fragmanted_msg_id)
+std::vector<std::shared_ptr<Message_Item>> Protocol::pop_waiting_messages()
 {
     std::lock_guard lock(mutex_);
-    return pop_waiting_message([fragmanted_msg_id](const Message_Item &item){ return item.id_.value_or(0) == fragmanted_msg_id; });
+    return waiting_messages_.pop_expired(current_time() + std::chrono::milliseconds(20));
 }
 
-std::shared_ptr<Message_Item> Protocol::pop_waiting_message(std::function<bool (const Message_Item &)> check_func)
+std::shared_ptr<Message_Item> Protocol::pop_waiting_answer(uint32_t answer_id, uint8_t cmd)
 {
-    for (auto it = waiting_messages_.begin(); it != waiting_messages_.end(); ++it)
-    {
-        if (check_func(*it->second))
-        {
-            std::shared_ptr<Message_Item> msg = std::move(it->second);
-            waiting_messages_.erase(it);
-            return msg;
-        }
-    }
-    return {};
+    std::lock_guard lock(mutex_);
+    return waiting_messages_.pop_answer(answer_id, cmd);
+}
+
+std::shared_ptr<Message_Item> Protocol::pop_waiting_fragment(uint32_t fragmanted_msg_id)
+{
+    std::lock_guard lock(mutex_);
+    return waiting_messages_.pop(fragmanted_msg_id);
 }
 
 } // namespace Net
@@ -1,10 +1,14 @@
 #ifndef HELPZ_NETWORK_PROTOCOL_H
 #define HELPZ_NETWORK_PROTOCOL_H
 
+#include <array>
 #include <chrono>
 #include <mutex>
 #include <queue>
+#include <deque>
+#include <map>
 #include <atomic>
+#include <functional>
 
 #include <QBuffer>
 #include <QLoggingCategory>
@@ -13,6 +17,15 @@
 #include <Helpz/net_protocol_writer.h>
 #include <Helpz/net_protocol_sender.h>
 #include <Helpz/net_fragmented_message.h>
+#include <Helpz/net_ring_buffer.h>
+#include <Helpz/net_packet_header.h>
+#include <Helpz/net_waiting_table.h>
+#include <Helpz/net_codec.h>
+#include <Helpz/net_crc32c.h>
+#include <Helpz/net_message_pool.h>
+#include <Helpz/net_rtt_estimator.h>
+#include <Helpz/net_protocol_stats.h>
+#include <Helpz/net_fec.h>
 
 namespace Helpz {
 namespace Net {
@@ -26,6 +39,8 @@ enum ReservedCommands {
     PING,
     REMOVE_FRAGMENT,
     CLOSE,
+    ACK,
+    CODECS,
 
     USER_COMMAND = 16
 };
@@ -35,7 +50,18 @@ enum ReservedCommands {
  * @brief The Protocol class
  *
  * Protocol structure:
- * [2bytes Checksum][2bytes [13bits cmd][3bits flags]][4bytes data][Nbytes... data]
+ * [2bytes Checksum][1byte id][1byte cmd][1byte flags][4bytes data size][Nbytes... data]
+ *
+ * Version 2 packets have EXTENDED_HEADER flag and 32bit message id:
+ * [2bytes Checksum][1byte id][1byte cmd][1byte flags][4bytes data size][3bytes id high part][1byte ext flags][Nbytes... data]
+ * Message ids in data (answer id, fragment id) are 32bit too.
+ * Version 2 fragment query may have [1byte count][count * [4bytes pos][4bytes size]] after first part,
+ * sender streams all requested parts. Receiver controls count: it grows while parts come and halves on timeout.
+ * Version 1 packets have EXTENDED_SUPPORTED flag if version 2 allowed,
+ * version 2 is used for new messages only after peer has sent this flag.
+ * When version 2 is detected both sides send CODECS with mask of supported codecs,
+ * compressed version 2 packets have codec type in ext flags. Version 1 always uses zlib.
+ * Version 2 packets with BODY_CHECKSUM ext flag end with [4bytes CRC32C of data], it's counted in data size.
  */
 class Protocol
 {
@@ -44,7 +70,8 @@ public:
     enum { DATASTREAM_VERSION = QDataStream::Qt_5_6 };
 
     enum Flags {
-        RESERVED                    = 0x04,
+        EXTENDED_SUPPORTED          = 0x02,
+        EXTENDED_HEADER             = Packet_Header::EXTENDED_FLAG,
 
         REPEATED                    = 0x08,
         FRAGMENT_QUERY              = 0x10,
@@ -52,7 +79,7 @@ public:
         ANSWER                      = 0x40,
         COMPRESSED                  = 0x80,
 
-        FLAGS_ALL                   = RESERVED | REPEATED | FRAGMENT_QUERY | FRAGMENT | ANSWER | COMPRESSED
+        FLAGS_ALL                   = EXTENDED_SUPPORTED | EXTENDED_HEADER | REPEATED | FRAGMENT_QUERY | FRAGMENT | ANSWER | COMPRESSED
     };
 
     template<typename... Args>
@@ -70,6 +97,12 @@ public:
         Helpz::parse_out(ds, args...);
     }
 
+    template<typename RetType, class T, typename... FArgs, typename... Args>
+    RetType apply_parse_fixed(QIODevice& data_dev, RetType(T::*__f)(FArgs...), Args&&... args)
+    {
+        return Helpz::apply_parse_fixed(data_dev, __f, static_cast<T*>(this), std::forward<Args&&>(args)...);
+    }
+
     template<typename RetType, class T, typename... FArgs, typename... Args>
     RetType apply_parse(QDataStream &ds, RetType(T::*__f)(FArgs...), Args&&... args)
     {
@@ -122,6 +155,112 @@ public:
 
     void reset_msg_id();
 
+    /**
+     * @brief set_max_version
+     * Version 2 has 32bit message id, send window and selective acknowledgement.
+     * Default is 2, set 1 to always use old format.
+     */
+    void set_max_version(uint8_t version);
+    uint8_t max_version() const;
+
+    /**
+     * @brief version
+     * Version of new messages, it's 2 when both sides support it.
+     */
+    uint8_t version() const;
+
+    /**
+     * @brief set_window_size
+     * Max count of not acknowledged messages which wait for answer or timeout in version 2.
+     * Next messages wait in queue. Also it's window for lost messages detection.
+     */
+    void set_window_size(uint32_t size);
+    uint32_t window_size() const;
+
+    /**
+     * @brief set_codecs
+     * Codecs which may be used for this connection, default is Codec_Registry::default_registry().
+     * Set it before connection is established.
+     */
+    void set_codecs(std::shared_ptr<const Codec_Registry> codecs);
+    std::shared_ptr<const Codec_Registry> codecs() const;
+
+    /**
+     * @brief set_default_codec_type
+     * Codec type of new messages, Protocol_Sender::set_codec_type overrides it.
+     */
+    void set_default_codec_type(uint8_t codec_type);
+    uint8_t default_codec_type() const;
+
+    /**
+     * @brief set_body_checksum
+     * Add CRC32C of data to version 2 packets. Use it on transports without own integrity check.
+     * Received checksum is always verified if packet has it.
+     */
+    void set_body_checksum(bool state);
+    bool is_body_checksum() const;
+
+    /**
+     * @brief set_fec
+     * Ask sender of windowed fragmented messages for XOR parity parts, so one lost part of group
+     * is restored without fragment query round. Parity is asked only if parts are lost,
+     * group size is chosen by loss of parts seen on this connection. Older senders ignore it.
+     */
+    void set_fec(bool state);
+    bool is_fec() const;
+
+    /**
+     * @brief set_coalescing
+     * Writer joins packets which are sent within window in one datagram up to max_size bytes.
+     * Receiver doesn't need support, several packets in one record is always allowed.
+     * Zero window disables it, it's default.
+     */
+    void set_coalescing(std::chrono::milliseconds window, std::size_t max_size = HELPZ_PROTOCOL_COALESCE_SIZE);
+    std::chrono::milliseconds coalesce_window() const;
+    std::size_t coalesce_max_size() const;
+
+    /**
+     * @brief rtt
+     * Round trip time is measured by answers and fragment queries of not repeated messages.
+     * Messages without own resend timeout are resent after retransmission_timeout(),
+     * it's doubled for each next resend of the message.
+     */
+    std::chrono::microseconds rtt() const;
+    std::chrono::microseconds rtt_variation() const;
+    std::chrono::milliseconds retransmission_timeout() const;
+    void set_retransmission_timeout_limits(std::chrono::milliseconds min_rto, std::chrono::milliseconds max_rto);
+
+    /**
+     * @brief message_pool
+     * Memory of sent messages and their data buffers is reused from it.
+     */
+    std::shared_ptr<Message_Pool> message_pool() const;
+
+    /**
+     * @brief set_stream_receive
+     * Fragmented messages of cmd are given to process_stream_message while they are received:
+     * each time more data from the beginning is available and last time when whole message is received.
+     * Answers are always received whole.
+     */
+    void set_stream_receive(uint8_t cmd, bool state = true);
+    bool is_stream_receive(uint8_t cmd) const;
+
+    /**
+     * @brief is_streams_supported
+     * Version 2 peers which send streams feature in CODECS use high byte of message id as stream number,
+     * each stream has own id sequence and loss tracking, so a loss in one stream doesn't hold others.
+     * Without support all messages go in one sequence. Answers and fragment queries go in stream of their message.
+     */
+    bool is_streams_supported() const;
+    static uint8_t stream_of(uint32_t msg_id);
+
+    /**
+     * @brief stats
+     * Transport counters since creation of protocol and current depth of waiting and pending queues.
+     * Answer latency is measured from first send of message, so it includes its resends.
+     */
+    Protocol_Stats::Snapshot stats() const;
+
     virtual bool operator ==(const Protocol&) const { return false; }
 
     std::shared_ptr<Protocol_Writer> writer();
@@ -129,17 +268,39 @@ public:
     void set_writer(std::shared_ptr<Protocol_Writer> protocol_writer);
 
     typedef std::chrono::time_point<std::chrono::system_clock> Time_Point;
+    typedef std::function<Time_Point()> Clock_Func;
+
+    /**
+     * @brief current_time
+     * All times of protocol are taken from it, system clock if clock isn't set.
+     */
+    Time_Point current_time() const;
+
+    /**
+     * @brief set_clock
+     * Replace time source, Emulator sets virtual time by it. Must be set before protocol is used.
+     */
+    void set_clock(Clock_Func clock);
 
     Time_Point last_msg_send_time() const;
 
     Protocol_Sender send(uint8_t cmd);
-    Protocol_Sender send_answer(uint8_t cmd, std::optional<uint8_t> msg_id);
+    Protocol_Sender send_answer(uint8_t cmd, std::optional<uint32_t> msg_id);
     void send_byte(uint8_t cmd, char byte);
     void send_array(uint8_t cmd, const QByteArray &buff);
     void send_message(std::shared_ptr<Message_Item> msg);
 
 public:
     QByteArray prepare_packet_to_send(std::shared_ptr<Message_Item> msg_ptr);
+
+    /**
+     * @brief prepare_packet_to_send
+     * Appends packet to the end of buffer. Header place is reserved first and payload is read
+     * from data device straight after it, so capacity of reused buffer makes it without allocations and copies.
+     * @param max_fragment_size not zero limits data of fragment packet, rest of part is requested by peer again
+     * @return size of appended packet, zero if there is nothing to send now
+     */
+    std::size_t prepare_packet_to_send(std::shared_ptr<Message_Item> msg_ptr, QByteArray& buffer, uint32_t max_fragment_size = 0);
     void add_raw_data_to_packet(QByteArray& data, uint32_t pos, uint32_t max_data_size, QIODevice* device);
     void process_bytes(const uint8_t* data, size_t size);
 
@@ -149,45 +310,113 @@ public:
      */
     virtual void ready_write() {}
     virtual void closed() {}
-    virtual void lost_msg_detected(uint8_t /*msg_id*/, uint8_t /*expected*/) {}
+    virtual void lost_msg_detected(uint32_t /*msg_id*/, uint32_t /*expected*/) {}
 protected:
 
-    virtual void process_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) = 0;
-    virtual void process_answer_message(uint8_t msg_id, uint8_t cmd, QIODevice& data_dev) = 0;
+    virtual void process_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) = 0;
+    virtual void process_answer_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) = 0;
+
+    /**
+     * @brief process_stream_message
+     * Called for commands with stream receive. Not read data stays in stream for next call.
+     * Default waits for whole message and gives it to process_message.
+     */
+    virtual void process_stream_message(uint32_t msg_id, uint8_t cmd, Fragment_Stream& stream);
 
 //    friend class Protocol_Sender;
 private:
-    bool process_stream(bool is_first_call);
-    bool is_lost_message(uint8_t msg_id);
-    void fill_lost_msg(uint8_t msg_id);
-    void internal_process_message(uint8_t msg_id, uint8_t cmd, uint8_t flags, const char* data_ptr, uint32_t data_size);
-    void process_fragment_query(uint8_t fragmanted_msg_id, uint32_t pos, uint32_t fragmanted_size);
+    // Defined by tests only, lets them reach internal state such as wrap of id sequence
+    friend struct Protocol_Test_Access;
+
+    enum Features { STREAMS_FEATURE = 0x01 };
+
+    struct Receive_Sequence
+    {
+        Receive_Sequence(uint32_t id_mask, uint32_t window, uint32_t first_id, uint32_t base = 0);
+        uint32_t distance(uint32_t from_id, uint32_t to_id) const;
+        uint32_t next_after(uint32_t id) const;
+        uint32_t before(uint32_t id, uint32_t count) const;
+
+        // Ids are base_ with sequence number from first_id_ to id_mask_, on wrap it goes to first_id_
+        uint32_t id_mask_, first_id_, base_;
+        uint32_t window_, next_id_;
+        std::map<uint32_t, Time_Point> lost_msg_list_;
+    };
+
+    bool is_extended_tx() const;
+    Receive_Sequence& receive_sequence(uint32_t msg_id, bool is_extended);
+    uint32_t next_tx_ext_msg_id(uint8_t stream);
+    Protocol_Sender make_sender(uint8_t cmd, std::optional<uint32_t> answer_id);
+    static void write_msg_id(QDataStream& ds, uint32_t msg_id, bool is_extended);
+    const Codec& select_codec(uint8_t codec_type, bool is_extended) const;
+    void send_codecs();
+    static uint32_t read_msg_id(QDataStream& ds, bool is_extended);
+
+    enum Packet_Status { PACKET_OK, PACKET_INCOMPLETE, PACKET_CORRUPT, PACKET_TOO_BIG };
+    Packet_Status check_packet(const Packet_Header& header, const uint8_t* header_data, std::size_t available, bool is_first_call);
+    bool process_packet(const Packet_Header& header, const uint8_t* data, bool is_first_call);
+    void process_receive_buffer();
+    void consume_receive_buffer(std::size_t size);
+    void drop_receive_record();
+
+    bool is_lost_message(Receive_Sequence& sequence, uint32_t msg_id);
+    void fill_lost_msg(Receive_Sequence& sequence, uint32_t msg_id);
+    void internal_process_message(const Packet_Header& header, const char* data_ptr);
+    void process_fragment_query(uint32_t fragmanted_msg_id, uint32_t pos, uint32_t fragmanted_size,
+                                std::vector<std::pair<uint32_t, uint32_t>>&& next_parts, uint8_t fec_group = 0);
+    bool add_fragment_window_query(Protocol_Sender& msg_out, Fragmented_Message& msg);
+
+    void add_ack(uint32_t msg_id);
+    void send_ack();
+    void process_ack(const QByteArray& data);
+    void send_pending_messages();
 
 public:
     void process_wait_list(void* data);
 
 private:
-    void add_to_waiting(Time_Point time_point, std::shared_ptr<Message_Item> message);
+    void add_to_waiting(Time_Point time_point, std::shared_ptr<Message_Item> message, bool is_acked = false);
     std::vector<std::shared_ptr<Message_Item>> pop_waiting_messages();
-    std::shared_ptr<Message_Item> pop_waiting_answer(uint8_t answer_id, uint8_t cmd);
-    std::shared_ptr<Message_Item> pop_waiting_fragment(uint8_t fragmanted_msg_id);
-    std::shared_ptr<Message_Item> pop_waiting_message(std::function<bool(const Message_Item&)> check_func);
-
-    std::atomic<uint8_t> next_rx_msg_id_, next_tx_msg_id_;
-    std::map<uint8_t, Time_Point> lost_msg_list_;
-
-    QBuffer device_;
-    QDataStream msg_stream_;
+    std::shared_ptr<Message_Item> pop_waiting_answer(uint32_t answer_id, uint8_t cmd);
+    std::shared_ptr<Message_Item> pop_waiting_fragment(uint32_t fragmanted_msg_id);
+
+    std::atomic<uint8_t> max_version_;
+    std::atomic<bool> is_peer_extended_;
+    std::atomic<uint32_t> window_size_;
+    std::atomic<uint8_t> peer_codec_mask_, default_codec_type_;
+    std::atomic<bool> is_body_checksum_, is_fec_;
+    std::atomic<std::chrono::milliseconds> coalesce_window_;
+    std::atomic<std::size_t> coalesce_max_size_;
+    std::array<std::atomic<uint64_t>, 4> stream_cmd_mask_;
+    Rtt_Estimator rtt_;
+    Fec_Estimator fec_estimator_;
+    Protocol_Stats stats_;
+    std::shared_ptr<const Codec_Registry> codecs_;
+    std::shared_ptr<Message_Pool> message_pool_;
+
+    std::atomic<uint8_t> next_tx_msg_id_;
+    std::atomic<uint32_t> next_tx_ext_msg_id_;
+    Receive_Sequence rx_sequence_, rx_ext_sequence_;
+
+    // Streams except zero, which uses ext ids
+    std::atomic<bool> is_peer_streams_;
+    std::map<uint8_t, uint32_t> tx_stream_ids_;
+    std::map<uint8_t, Receive_Sequence> rx_streams_;
+
+    Ring_Buffer recv_buffer_;
+    std::queue<std::size_t> recv_record_sizes_;
 
     std::atomic<Time_Point> last_msg_send_time_;
+    Clock_Func clock_;
 
-    std::map<uint8_t, Fragmented_Message> fragmented_messages_;
+    std::map<uint32_t, Fragmented_Message> fragmented_messages_;
 
-    std::map<Time_Point, std::shared_ptr<Message_Item>> waiting_messages_;
+    Waiting_Table waiting_messages_;
+    std::deque<std::shared_ptr<Message_Item>> pending_messages_;
+    std::vector<std::pair<uint32_t, uint32_t>> ack_ranges_;
     mutable std::recursive_mutex mutex_;
 
     std::shared_ptr<Protocol_Writer> protocol_writer_;
-    std::queue<std::size_t> packet_end_position_;
 };
 
 } // namespace Net
@@ -11,7 +11,7 @@ namespace Net {
 
 Q_DECLARE_LOGGING_CATEGORY(Log)
 
-Protocol_Sender::Protocol_Sender(std::shared_ptr<Protocol> p, uint8_t command, std::optional<uint8_t> answer_id,
+Protocol_Sender::Protocol_Sender(std::shared_ptr<Protocol> p, uint8_t command, std::optional<uint32_t> answer_id,
                                  std::unique_ptr<QIODevice> device_ptr, std::chrono::milliseconds resend_timeout) :
     QDataStream(device_ptr.get()),
     protocol_(std::move(p)), msg_{command, std::move(answer_id), std::move(device_ptr), std::move(resend_timeout)}
@@ -41,7 +41,7 @@ Protocol_Sender::~Protocol_Sender()
     if (protocol_ && msg_.data_device_)
     {
         msg_.data_device_->seek(msg_.data_device_->size());
-        auto const msg_ptr = std::make_shared<Message_Item>(std::move(msg_));
+        auto const msg_ptr = protocol_->message_pool()->make(std::move(msg_));
         protocol_->send_message(msg_ptr);
     }
 
@@ -63,6 +63,21 @@ void Protocol_Sender::set_min_compress_size(uint32_t min_compress_size)
     msg_.set_min_compress_size(min_compress_size);
 }
 
+void Protocol_Sender::set_codec_type(uint8_t codec_type)
+{
+    msg_.set_codec_type(codec_type);
+}
+
+void Protocol_Sender::set_priority(Message_Priority priority)
+{
+    msg_.set_priority(priority);
+}
+
+void Protocol_Sender::set_stream(uint8_t stream)
+{
+    msg_.set_stream(stream);
+}
+
 void Protocol_Sender::set_data_device(std::unique_ptr<QIODevice> data_dev, uint32_t fragment_size)
 {
     if (!data_dev)
@@ -78,7 +93,7 @@ Protocol_Sender& Protocol_Sender::answer(std::function<void(QIODevice&)> answer_
 {
     assert(!msg_.answer_id_ && "Attempt to wait answer to answer");
     msg_.answer_func_ = std::move(answer_func);
-    auto now = std::chrono::system_clock::now();
+    auto now = protocol_ ? protocol_->current_time() : std::chrono::system_clock::now();
     if (msg_.end_time_ < now)
         msg_.end_time_ = now + std::chrono::seconds(10);
     return *this;
@@ -86,7 +101,7 @@ Protocol_Sender& Protocol_Sender::answer(std::function<void(QIODevice&)> answer_
 Protocol_Sender& Protocol_Sender::timeout(std::function<void()> timeout_func, std::chrono::milliseconds timeout_duration, std::chrono::milliseconds resend_timeout)
 {
     msg_.timeout_func_ = std::move(timeout_func);
-    msg_.end_time_ = std::chrono::system_clock::now() + timeout_duration;
+    msg_.end_time_ = (protocol_ ? protocol_->current_time() : std::chrono::system_clock::now()) + timeout_duration;
     msg_.resend_timeout_ = resend_timeout;
     return *this;
 }
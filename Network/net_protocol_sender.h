@@ -19,6 +19,7 @@ using std::experimental::optional;
 
 #include <QDataStream>
 
+#include <Helpz/fixed_codec.h>
 #include <Helpz/net_message_item.h>
 
 namespace Helpz {
@@ -29,8 +30,8 @@ class Protocol;
 class Protocol_Sender : public QDataStream
 {
 public:
-    Protocol_Sender(std::shared_ptr<Protocol> p, uint8_t command, std::optional<uint8_t> answer_id = {}, std::unique_ptr<QIODevice> device_ptr = nullptr,
-                    std::chrono::milliseconds resend_timeout = std::chrono::milliseconds{3000});
+    Protocol_Sender(std::shared_ptr<Protocol> p, uint8_t command, std::optional<uint32_t> answer_id = {}, std::unique_ptr<QIODevice> device_ptr = nullptr,
+                    std::chrono::milliseconds resend_timeout = std::chrono::milliseconds::zero());
     Protocol_Sender(const Protocol_Sender& obj) = delete;
     Protocol_Sender(Protocol_Sender&& obj) noexcept;
     ~Protocol_Sender();
@@ -39,15 +40,41 @@ public:
 
     void set_fragment_size(uint32_t fragment_size);
     void set_min_compress_size(uint32_t min_compress_size);
+    void set_codec_type(uint8_t codec_type);
+
+    /**
+     * @brief set_priority
+     * Writer with send scheduler interleaves bulk messages with interactive ones by it. Default is NORMAL_PRIORITY.
+     */
+    void set_priority(Message_Priority priority);
+
+    /**
+     * @brief set_stream
+     * Messages of other streams aren't held by losses in this one. See Protocol::is_streams_supported.
+     */
+    void set_stream(uint8_t stream);
 
     void set_data_device(std::unique_ptr<QIODevice> data_dev, uint32_t fragment_size = HELPZ_MAX_MESSAGE_DATA_SIZE);
     Protocol_Sender &answer(std::function<void(QIODevice &)> answer_func);
     Protocol_Sender &timeout(std::function<void()> timeout_func, std::chrono::milliseconds timeout_duration,
-                             std::chrono::milliseconds resend_timeout = std::chrono::milliseconds{3000});
+                             std::chrono::milliseconds resend_timeout = std::chrono::milliseconds::zero());
     Protocol_Sender &finally(std::function<void(bool)> func);
 
     template<typename T>
     QDataStream& operator <<(const T& item) { return static_cast<QDataStream&>(*this) << item; }
+
+    /**
+     * @brief write_fixed
+     * Encode fixed size arguments with Fixed_Codec in one device write, same bytes as operator <<.
+     */
+    template<typename... Args>
+    Protocol_Sender& write_fixed(const Args&... args)
+    {
+        uchar data[fixed_size_v<Args...> ? fixed_size_v<Args...> : 1];
+        fixed_write(data, args...);
+        writeRawData(reinterpret_cast<const char*>(data), fixed_size_v<Args...>);
+        return *this;
+    }
 private:
     std::shared_ptr<Protocol> protocol_;
     Message_Item msg_;
@@ -0,0 +1,121 @@
+#include "net_protocol_stats.h"
+
+namespace Helpz {
+namespace Net {
+
+namespace {
+
+inline void add_relaxed(std::atomic<uint64_t>& counter, uint64_t value = 1)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline uint64_t load_relaxed(const std::atomic<uint64_t>& counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+double Protocol_Stats::Snapshot::compression_ratio() const
+{
+    return compress_in_bytes_ ? static_cast<double>(compress_out_bytes_) / compress_in_bytes_ : 1.;
+}
+
+Protocol_Stats::Snapshot &Protocol_Stats::Snapshot::operator +=(const Snapshot &other)
+{
+    bytes_in_ += other.bytes_in_;
+    bytes_out_ += other.bytes_out_;
+    packets_in_ += other.packets_in_;
+    packets_out_ += other.packets_out_;
+    retransmits_ += other.retransmits_;
+    lost_msgs_ += other.lost_msgs_;
+    fragment_queries_in_ += other.fragment_queries_in_;
+    fragment_queries_out_ += other.fragment_queries_out_;
+    compress_in_bytes_ += other.compress_in_bytes_;
+    compress_out_bytes_ += other.compress_out_bytes_;
+    fec_parity_out_ += other.fec_parity_out_;
+    fec_restored_ += other.fec_restored_;
+    for (std::size_t i = 0; i < answer_latency_.size(); ++i)
+        answer_latency_[i] += other.answer_latency_[i];
+    waiting_count_ += other.waiting_count_;
+    pending_count_ += other.pending_count_;
+    connection_count_ += other.connection_count_;
+    return *this;
+}
+
+Protocol_Stats::Protocol_Stats() :
+    bytes_in_(0), bytes_out_(0), packets_in_(0), packets_out_(0), retransmits_(0), lost_msgs_(0),
+    fragment_queries_in_(0), fragment_queries_out_(0), compress_in_bytes_(0), compress_out_bytes_(0),
+    fec_parity_out_(0), fec_restored_(0)
+{
+    for (std::atomic<uint64_t>& bucket: answer_latency_)
+        bucket = 0;
+}
+
+void Protocol_Stats::add_in(std::size_t bytes)
+{
+    add_relaxed(packets_in_);
+    add_relaxed(bytes_in_, bytes);
+}
+
+void Protocol_Stats::add_out(std::size_t bytes)
+{
+    add_relaxed(packets_out_);
+    add_relaxed(bytes_out_, bytes);
+}
+
+void Protocol_Stats::add_retransmit() { add_relaxed(retransmits_); }
+void Protocol_Stats::add_lost_msg() { add_relaxed(lost_msgs_); }
+void Protocol_Stats::add_fragment_query_in() { add_relaxed(fragment_queries_in_); }
+void Protocol_Stats::add_fragment_query_out() { add_relaxed(fragment_queries_out_); }
+
+void Protocol_Stats::add_compression(std::size_t in_bytes, std::size_t out_bytes)
+{
+    add_relaxed(compress_in_bytes_, in_bytes);
+    add_relaxed(compress_out_bytes_, out_bytes);
+}
+
+void Protocol_Stats::add_fec_parity_out() { add_relaxed(fec_parity_out_); }
+void Protocol_Stats::add_fec_restored() { add_relaxed(fec_restored_); }
+
+void Protocol_Stats::add_answer_latency(std::chrono::microseconds latency)
+{
+    add_relaxed(answer_latency_[latency_bucket(latency)]);
+}
+
+Protocol_Stats::Snapshot Protocol_Stats::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.bytes_in_ = load_relaxed(bytes_in_);
+    snapshot.bytes_out_ = load_relaxed(bytes_out_);
+    snapshot.packets_in_ = load_relaxed(packets_in_);
+    snapshot.packets_out_ = load_relaxed(packets_out_);
+    snapshot.retransmits_ = load_relaxed(retransmits_);
+    snapshot.lost_msgs_ = load_relaxed(lost_msgs_);
+    snapshot.fragment_queries_in_ = load_relaxed(fragment_queries_in_);
+    snapshot.fragment_queries_out_ = load_relaxed(fragment_queries_out_);
+    snapshot.compress_in_bytes_ = load_relaxed(compress_in_bytes_);
+    snapshot.compress_out_bytes_ = load_relaxed(compress_out_bytes_);
+    snapshot.fec_parity_out_ = load_relaxed(fec_parity_out_);
+    snapshot.fec_restored_ = load_relaxed(fec_restored_);
+    for (std::size_t i = 0; i < answer_latency_.size(); ++i)
+        snapshot.answer_latency_[i] = load_relaxed(answer_latency_[i]);
+    snapshot.connection_count_ = 1;
+    return snapshot;
+}
+
+/*static*/ std::size_t Protocol_Stats::latency_bucket(std::chrono::microseconds latency)
+{
+    uint64_t ms = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) / 1000 : 0;
+    std::size_t bucket = 0;
+    while (ms && bucket < LATENCY_BUCKETS - 1)
+    {
+        ms >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+} // namespace Net
+} // namespace Helpz
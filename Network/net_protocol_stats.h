@@ -0,0 +1,83 @@
+#ifndef HELPZ_NETWORK_PROTOCOL_STATS_H
+#define HELPZ_NETWORK_PROTOCOL_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Protocol_Stats class
+ *
+ * Transport counters of one connection. Counters are relaxed atomics,
+ * so they are always on and snapshot may be taken from any thread.
+ * Answer latency is histogram with power of two buckets in milliseconds:
+ * bucket 0 is less than 1ms, bucket N is [2^(N-1), 2^N) ms, last one has all bigger.
+ */
+class Protocol_Stats
+{
+public:
+    enum { LATENCY_BUCKETS = 16 };
+
+    struct Snapshot
+    {
+        uint64_t bytes_in_ = 0, bytes_out_ = 0;
+        uint64_t packets_in_ = 0, packets_out_ = 0;
+        uint64_t retransmits_ = 0;
+        uint64_t lost_msgs_ = 0;
+        uint64_t fragment_queries_in_ = 0, fragment_queries_out_ = 0;
+        uint64_t compress_in_bytes_ = 0, compress_out_bytes_ = 0;
+        uint64_t fec_parity_out_ = 0, fec_restored_ = 0;
+        std::array<uint64_t, LATENCY_BUCKETS> answer_latency_{};
+
+        std::size_t waiting_count_ = 0, pending_count_ = 0;
+        std::size_t connection_count_ = 0;
+
+        /**
+         * @brief compression_ratio
+         * Compressed size to original size of payloads which were big enough for compression, 1 if there are none.
+         */
+        double compression_ratio() const;
+
+        Snapshot& operator +=(const Snapshot& other);
+    };
+
+    Protocol_Stats();
+
+    void add_in(std::size_t bytes);
+    void add_out(std::size_t bytes);
+    void add_retransmit();
+    void add_lost_msg();
+    void add_fragment_query_in();
+    void add_fragment_query_out();
+    void add_compression(std::size_t in_bytes, std::size_t out_bytes);
+    void add_fec_parity_out();
+    void add_fec_restored();
+    void add_answer_latency(std::chrono::microseconds latency);
+
+    /**
+     * @brief snapshot
+     * Queue depth is filled by Protocol.
+     */
+    Snapshot snapshot() const;
+
+    static std::size_t latency_bucket(std::chrono::microseconds latency);
+
+private:
+    std::atomic<uint64_t> bytes_in_, bytes_out_;
+    std::atomic<uint64_t> packets_in_, packets_out_;
+    std::atomic<uint64_t> retransmits_;
+    std::atomic<uint64_t> lost_msgs_;
+    std::atomic<uint64_t> fragment_queries_in_, fragment_queries_out_;
+    std::atomic<uint64_t> compress_in_bytes_, compress_out_bytes_;
+    std::atomic<uint64_t> fec_parity_out_, fec_restored_;
+    std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> answer_latency_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_PROTOCOL_STATS_H
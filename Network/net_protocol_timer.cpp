@@ -1,18 +1,35 @@
 #include <iostream>
-#include <queue>
+
+#include <boost/asio/post.hpp>
 
 #include "net_protocol_timer.h"
 
 namespace Helpz {
 namespace Net {
 
-Protocol_Timer::Protocol_Timer(Protocol_Timer_Emiter *emiter) :
+Protocol_Timer::Protocol_Timer(Protocol_Timer_Emiter *emiter, std::size_t shard_count, std::chrono::milliseconds tick) :
     emiter_(emiter),
-    break_flag_(false), new_timeout_flag_(false)
+    break_flag_(false), is_idle_(false),
+    io_context_(nullptr)
 {
+    if (!shard_count)
+        shard_count = 1;
+    for (std::size_t i = 0; i < shard_count; ++i)
+        shards_.emplace_back(new Shard{tick});
+
     thread_ = new std::thread(&Protocol_Timer::run, this);
 }
 
+Protocol_Timer::Protocol_Timer(Protocol_Timer_Emiter *emiter, boost::asio::io_context *io_context, std::chrono::milliseconds tick) :
+    emiter_(emiter),
+    break_flag_(false), is_idle_(true),
+    thread_(nullptr),
+    io_context_(io_context),
+    tick_timer_(new boost::asio::steady_timer{*io_context})
+{
+    shards_.emplace_back(new Shard{tick});
+}
+
 Protocol_Timer::~Protocol_Timer()
 {
     stop();
@@ -31,64 +48,146 @@ void Protocol_Timer::stop()
 
 void Protocol_Timer::join()
 {
-    if (thread_->joinable())
+    if (thread_ && thread_->joinable())
         thread_->join();
 }
 
 void Protocol_Timer::add(Time_Point time_point, boost::asio::ip::udp::endpoint endpoint, void *data)
 {
-    std::lock_guard lock(mutex_);
-    items_.emplace(time_point, Item{endpoint, data});
-    new_timeout_flag_ = true;
-    cond_.notify_one();
+    const Timing_Wheel::Clock::time_point steady_point =
+            Timing_Wheel::Clock::now() + std::chrono::duration_cast<Timing_Wheel::Clock::duration>(time_point - std::chrono::system_clock::now());
+
+    Shard& item_shard = shard(endpoint);
+    bool is_wake = false;
+    {
+        std::lock_guard lock(item_shard.mutex_);
+        item_shard.wheel_.add(Timing_Wheel::Key{std::move(endpoint), data}, steady_point);
+        if (io_context_)
+            is_wake = is_idle_.exchange(false);
+    }
+
+    if (io_context_)
+    {
+        // Steady timer isn't thread safe, so it's started on io_context
+        if (is_wake)
+            boost::asio::post(*io_context_, [this]() { start_tick(); });
+    }
+    // Thread sets idle flag before last check for emptiness, so timer added after the check wakes it
+    else if (is_idle_)
+    {
+        std::lock_guard lock(mutex_);
+        cond_.notify_one();
+    }
+}
+
+void Protocol_Timer::cancel(const boost::asio::ip::udp::endpoint &endpoint, void *data)
+{
+    Shard& item_shard = shard(endpoint);
+    std::lock_guard lock(item_shard.mutex_);
+    item_shard.wheel_.cancel(Timing_Wheel::Key{endpoint, data});
+}
+
+void Protocol_Timer::cancel_all(const boost::asio::ip::udp::endpoint &endpoint)
+{
+    Shard& item_shard = shard(endpoint);
+    std::lock_guard lock(item_shard.mutex_);
+    item_shard.wheel_.cancel_all(endpoint);
+}
+
+std::size_t Protocol_Timer::size() const
+{
+    std::size_t count = 0;
+    for (const std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        std::lock_guard lock(item_shard->mutex_);
+        count += item_shard->wheel_.size();
+    }
+    return count;
 }
 
 void Protocol_Timer::run()
 {
-    std::queue<Item> clients;
-    auto pred_func = [this]() { return break_flag_ || new_timeout_flag_; };
-    bool timeout;
+    std::vector<Timing_Wheel::Key> expired;
+    const std::chrono::milliseconds tick = shards_.front()->wheel_.tick();
 
     std::unique_lock lock(mutex_, std::defer_lock);
     while (!break_flag_)
     {
-        timeout = false;
-
         lock.lock();
-        if (items_.empty())
-            cond_.wait(lock, pred_func);
-        else
-            timeout = !cond_.wait_until(lock, items_.begin()->first, pred_func);
+        is_idle_ = true;
+        if (is_empty())
+            cond_.wait(lock, [this]() { return break_flag_ || !is_empty(); });
+        is_idle_ = false;
+
+        if (!break_flag_)
+            cond_.wait_for(lock, tick, [this]() { return break_flag_.load(); });
+        lock.unlock();
 
         if (break_flag_)
             break;
 
-        if (new_timeout_flag_)
-            new_timeout_flag_ = false;
-
-        if (timeout && items_.size())
+        const Timing_Wheel::Clock::time_point now = Timing_Wheel::Clock::now();
+        for (std::unique_ptr<Shard>& item_shard: shards_)
         {
-            auto expires_close = std::chrono::system_clock::now() + std::chrono::milliseconds(10);
-            for (auto it = items_.begin(); it != items_.end(); )
-            {
-                if (expires_close >= it->first)
-                {
-                    clients.push(std::move(it->second));
-                    it = items_.erase(it);
-                }
-                else
-                    break;
-            }
+            std::lock_guard shard_lock(item_shard->mutex_);
+            item_shard->wheel_.advance(now, expired);
         }
 
-        lock.unlock();
+        for (const Timing_Wheel::Key& key: expired)
+            emiter_->on_protocol_timeout(key.endpoint_, key.data_);
+        expired.clear();
+    }
+}
 
-        while (clients.size())
-        {
-            emiter_->on_protocol_timeout(clients.front().endpoint_, clients.front().data_);
-            clients.pop();
-        }
+void Protocol_Timer::start_tick()
+{
+    tick_timer_->expires_after(shards_.front()->wheel_.tick());
+    tick_timer_->async_wait([this](const boost::system::error_code& err)
+    {
+        // Aborted wait may come after timer is destroyed
+        if (!err)
+            on_tick();
+    });
+}
+
+void Protocol_Timer::on_tick()
+{
+    if (break_flag_)
+        return;
+
+    Shard& item_shard = *shards_.front();
+    bool is_empty;
+    {
+        std::lock_guard lock(item_shard.mutex_);
+        item_shard.wheel_.advance(Timing_Wheel::Clock::now(), expired_);
+
+        // Idle flag is changed under lock of wheel, so add after it posts new tick
+        is_empty = item_shard.wheel_.empty();
+        is_idle_ = is_empty;
     }
+
+    for (const Timing_Wheel::Key& key: expired_)
+        emiter_->on_protocol_timeout(key.endpoint_, key.data_);
+    expired_.clear();
+
+    if (!is_empty)
+        start_tick();
+}
+
+bool Protocol_Timer::is_empty() const
+{
+    for (const std::unique_ptr<Shard>& item_shard: shards_)
+    {
+        std::lock_guard lock(item_shard->mutex_);
+        if (!item_shard->wheel_.empty())
+            return false;
+    }
+    return true;
+}
+
+Protocol_Timer::Shard &Protocol_Timer::shard(const boost::asio::ip::udp::endpoint &endpoint)
+{
+    return *shards_[Timing_Wheel::endpoint_hash(endpoint) % shards_.size()];
 }
 
 } // namespace Net
@@ -1,12 +1,18 @@
 #ifndef HELPZ_NET_PROTOCOL_TIMER_H
 #define HELPZ_NET_PROTOCOL_TIMER_H
 
-#include <map>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
 #include <condition_variable>
 
 #include <boost/asio/ip/udp.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <Helpz/net_timing_wheel.h>
 
 namespace Helpz {
 namespace Net {
@@ -18,10 +24,25 @@ public:
     virtual void on_protocol_timeout(boost::asio::ip::udp::endpoint endpoint, void* data) = 0;
 };
 
+/**
+ * @brief The Protocol_Timer class
+ *
+ * Timers of all connections in sharded hierarchical timing wheels, shard is chosen by endpoint,
+ * so connections on different threads rarely take same mutex.
+ * One thread advances wheels every tick and calls emiter for expired timers.
+ * Timer created for io_context has one wheel and no thread, steady timer of io_context advances it
+ * while it isn't empty and emiter is called there. Server shard uses it, so its timers don't share
+ * locks or thread with other shards.
+ * Timer is unique by endpoint and data, repeated add keeps earlier time point,
+ * so timeout handler must add timer again if something is still waiting.
+ */
 class Protocol_Timer
 {
 public:
-    Protocol_Timer(Protocol_Timer_Emiter* emiter);
+    Protocol_Timer(Protocol_Timer_Emiter* emiter, std::size_t shard_count = std::thread::hardware_concurrency(),
+                   std::chrono::milliseconds tick = std::chrono::milliseconds(HELPZ_PROTOCOL_TIMER_TICK));
+    Protocol_Timer(Protocol_Timer_Emiter* emiter, boost::asio::io_context* io_context,
+                   std::chrono::milliseconds tick = std::chrono::milliseconds(HELPZ_PROTOCOL_TIMER_TICK));
     virtual ~Protocol_Timer();
 
     void stop();
@@ -30,22 +51,37 @@ public:
     typedef std::chrono::time_point<std::chrono::system_clock> Time_Point;
 
     void add(Time_Point time_point, boost::asio::ip::udp::endpoint endpoint, void* data);
+    void cancel(const boost::asio::ip::udp::endpoint& endpoint, void* data);
+    void cancel_all(const boost::asio::ip::udp::endpoint& endpoint);
+    std::size_t size() const;
 private:
     void run();
+    bool is_empty() const;
+
+    void start_tick();
+    void on_tick();
+
+    struct Shard
+    {
+        explicit Shard(std::chrono::milliseconds tick) : wheel_(tick) {}
+
+        mutable std::mutex mutex_;
+        Timing_Wheel wheel_;
+    };
+    Shard& shard(const boost::asio::ip::udp::endpoint& endpoint);
 
     Protocol_Timer_Emiter *emiter_;
 
-    bool break_flag_, new_timeout_flag_;
+    std::atomic<bool> break_flag_, is_idle_;
     std::thread* thread_;
     std::mutex mutex_;
     std::condition_variable cond_;
 
-    struct Item
-    {
-        boost::asio::ip::udp::endpoint endpoint_;
-        void* data_;
-    };
-    std::map<Time_Point, Item> items_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    boost::asio::io_context* io_context_;
+    std::unique_ptr<boost::asio::steady_timer> tick_timer_;
+    std::vector<Timing_Wheel::Key> expired_;
 };
 
 } // namespace Net
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cstring>
+
+#include "net_ring_buffer.h"
+
+namespace Helpz {
+namespace Net {
+
+Ring_Buffer::Ring_Buffer(std::size_t capacity) :
+    capacity_(capacity), head_(0), size_(0)
+{
+}
+
+std::size_t Ring_Buffer::capacity() const { return capacity_; }
+std::size_t Ring_Buffer::size() const { return size_; }
+bool Ring_Buffer::empty() const { return size_ == 0; }
+
+bool Ring_Buffer::push(const uint8_t *data, std::size_t size)
+{
+    if (size > capacity_ - size_)
+        return false;
+
+    if (!data_)
+        data_.reset(new uint8_t[capacity_]);
+
+    std::size_t tail = (head_ + size_) % capacity_;
+    const std::size_t first_part = std::min(size, capacity_ - tail);
+    memcpy(data_.get() + tail, data, first_part);
+    if (first_part < size)
+        memcpy(data_.get(), data + first_part, size - first_part);
+
+    size_ += size;
+    return true;
+}
+
+void Ring_Buffer::peek(uint8_t *out, std::size_t size) const
+{
+    size = std::min(size, size_);
+    const std::size_t first_part = std::min(size, capacity_ - head_);
+    memcpy(out, data_.get() + head_, first_part);
+    if (first_part < size)
+        memcpy(out + first_part, data_.get(), size - first_part);
+}
+
+const uint8_t *Ring_Buffer::linearize(std::size_t size)
+{
+    if (head_ + std::min(size, size_) > capacity_)
+    {
+        std::rotate(data_.get(), data_.get() + head_, data_.get() + capacity_);
+        head_ = 0;
+    }
+    return data_.get() + head_;
+}
+
+void Ring_Buffer::pop(std::size_t size)
+{
+    if (size >= size_)
+    {
+        clear();
+        return;
+    }
+
+    head_ = (head_ + size) % capacity_;
+    size_ -= size;
+}
+
+void Ring_Buffer::clear()
+{
+    head_ = 0;
+    size_ = 0;
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,47 @@
+#ifndef HELPZ_NETWORK_RING_BUFFER_H
+#define HELPZ_NETWORK_RING_BUFFER_H
+
+#include <memory>
+#include <cstdint>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Ring_Buffer class
+ *
+ * Fixed capacity byte queue. Memory is allocated on first push,
+ * so idle connections do not hold a receive buffer.
+ */
+class Ring_Buffer
+{
+public:
+    explicit Ring_Buffer(std::size_t capacity);
+    Ring_Buffer(const Ring_Buffer&) = delete;
+    Ring_Buffer& operator =(const Ring_Buffer&) = delete;
+
+    std::size_t capacity() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    bool push(const uint8_t* data, std::size_t size);
+    void peek(uint8_t* out, std::size_t size) const;
+
+    /**
+     * @brief linearize
+     * Returns pointer to first size bytes. If they wrap around the end of the storage,
+     * contents are rotated to the beginning first.
+     */
+    const uint8_t* linearize(std::size_t size);
+    void pop(std::size_t size);
+    void clear();
+
+private:
+    std::size_t capacity_, head_, size_;
+    std::unique_ptr<uint8_t[]> data_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_RING_BUFFER_H
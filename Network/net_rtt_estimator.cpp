@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include <algorithm>
+
+#include "net_rtt_estimator.h"
+
+namespace Helpz {
+namespace Net {
+
+Rtt_Estimator::Rtt_Estimator() :
+    srtt_(0), rttvar_(0), rto_(HELPZ_PROTOCOL_INITIAL_RTO * 1000),
+    min_rto_(HELPZ_PROTOCOL_MIN_RTO * 1000), max_rto_(HELPZ_PROTOCOL_MAX_RTO * 1000),
+    sample_count_(0)
+{
+}
+
+void Rtt_Estimator::add_sample(std::chrono::microseconds rtt)
+{
+    const int64_t r = std::max<int64_t>(rtt.count(), 0);
+    int64_t srtt = srtt_, rttvar = rttvar_;
+
+    if (sample_count_ == 0)
+    {
+        srtt = r;
+        rttvar = r / 2;
+    }
+    else
+    {
+        rttvar = (3 * rttvar + std::abs(srtt - r)) / 4;
+        srtt = (7 * srtt + r) / 8;
+    }
+
+    // Clock granularity is the protocol timer tick
+    const int64_t rto = srtt + std::max<int64_t>(HELPZ_PROTOCOL_TIMER_TICK * 1000, 4 * rttvar);
+
+    srtt_ = srtt;
+    rttvar_ = rttvar;
+    rto_ = std::clamp<int64_t>(rto, min_rto_, max_rto_);
+    ++sample_count_;
+}
+
+void Rtt_Estimator::reset()
+{
+    sample_count_ = 0;
+    srtt_ = 0;
+    rttvar_ = 0;
+    rto_ = HELPZ_PROTOCOL_INITIAL_RTO * 1000;
+}
+
+void Rtt_Estimator::set_limits(std::chrono::milliseconds min_rto, std::chrono::milliseconds max_rto)
+{
+    min_rto_ = std::chrono::duration_cast<std::chrono::microseconds>(min_rto).count();
+    max_rto_ = std::max<int64_t>(min_rto_, std::chrono::duration_cast<std::chrono::microseconds>(max_rto).count());
+    if (sample_count_)
+        rto_ = std::clamp<int64_t>(rto_, min_rto_, max_rto_);
+}
+
+std::chrono::microseconds Rtt_Estimator::srtt() const { return std::chrono::microseconds(srtt_); }
+std::chrono::microseconds Rtt_Estimator::rttvar() const { return std::chrono::microseconds(rttvar_); }
+
+std::chrono::milliseconds Rtt_Estimator::rto() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(rto_ + 999));
+}
+
+std::chrono::milliseconds Rtt_Estimator::max_rto() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(max_rto_));
+}
+
+uint32_t Rtt_Estimator::sample_count() const { return sample_count_; }
+
+} // namespace Net
+} // namespace Helpz
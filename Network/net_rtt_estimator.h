@@ -0,0 +1,49 @@
+#ifndef HELPZ_NETWORK_RTT_ESTIMATOR_H
+#define HELPZ_NETWORK_RTT_ESTIMATOR_H
+
+#include <atomic>
+#include <chrono>
+
+#include <Helpz/net_defs.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Rtt_Estimator class
+ *
+ * Smoothed round trip time and its variation as in RFC 6298:
+ * RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|, SRTT = 7/8 * SRTT + 1/8 * R,
+ * RTO = SRTT + max(G, 4 * RTTVAR) limited by min and max.
+ * Until first sample RTO is HELPZ_PROTOCOL_INITIAL_RTO.
+ * Samples are added from one thread, values may be read from any.
+ */
+class Rtt_Estimator
+{
+public:
+    Rtt_Estimator();
+
+    void add_sample(std::chrono::microseconds rtt);
+    void reset();
+
+    /**
+     * @brief set_limits
+     * Default is HELPZ_PROTOCOL_MIN_RTO and HELPZ_PROTOCOL_MAX_RTO milliseconds.
+     */
+    void set_limits(std::chrono::milliseconds min_rto, std::chrono::milliseconds max_rto);
+
+    std::chrono::microseconds srtt() const;
+    std::chrono::microseconds rttvar() const;
+    std::chrono::milliseconds rto() const;
+    std::chrono::milliseconds max_rto() const;
+    uint32_t sample_count() const;
+
+private:
+    std::atomic<int64_t> srtt_, rttvar_, rto_, min_rto_, max_rto_;
+    std::atomic<uint32_t> sample_count_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_RTT_ESTIMATOR_H
@@ -0,0 +1,103 @@
+#include "net_send_scheduler.h"
+
+namespace Helpz {
+namespace Net {
+
+Send_Scheduler::Send_Scheduler(const Weights &weights) :
+    size_(0)
+{
+    set_weights(weights);
+}
+
+/*static*/ Send_Scheduler::Weights Send_Scheduler::default_weights()
+{
+    return {HELPZ_PROTOCOL_INTERACTIVE_WEIGHT, HELPZ_PROTOCOL_NORMAL_WEIGHT, HELPZ_PROTOCOL_BULK_WEIGHT};
+}
+
+Send_Scheduler::Weights Send_Scheduler::weights() const
+{
+    std::lock_guard lock(mutex_);
+    return weights_;
+}
+
+void Send_Scheduler::set_weights(const Weights &weights)
+{
+    std::lock_guard lock(mutex_);
+    weights_ = weights;
+    for (uint32_t& weight: weights_)
+        if (!weight)
+            weight = 1;
+    credits_ = weights_;
+}
+
+bool Send_Scheduler::push(std::shared_ptr<Message_Item> message)
+{
+    if (!message)
+        return false;
+
+    std::lock_guard lock(mutex_);
+    queues_[message->priority()].push_back(std::move(message));
+    return size_++ == 0;
+}
+
+std::shared_ptr<Message_Item> Send_Scheduler::pop()
+{
+    std::lock_guard lock(mutex_);
+    if (!size_)
+        return {};
+
+    for (;;)
+    {
+        for (std::size_t priority = 0; priority < queues_.size(); ++priority)
+        {
+            std::deque<std::shared_ptr<Message_Item>>& queue = queues_[priority];
+            if (!queue.empty() && credits_[priority])
+            {
+                --credits_[priority];
+                --size_;
+                std::shared_ptr<Message_Item> message = std::move(queue.front());
+                queue.pop_front();
+                return message;
+            }
+        }
+
+        // All not empty queues spent their weight, next round
+        credits_ = weights_;
+    }
+}
+
+bool Send_Scheduler::has_pending_above(Message_Priority priority) const
+{
+    std::lock_guard lock(mutex_);
+    for (std::size_t i = 0; i < priority && i < queues_.size(); ++i)
+        if (!queues_[i].empty())
+            return true;
+    return false;
+}
+
+bool Send_Scheduler::empty() const
+{
+    std::lock_guard lock(mutex_);
+    return size_ == 0;
+}
+
+std::size_t Send_Scheduler::size() const
+{
+    std::lock_guard lock(mutex_);
+    return size_;
+}
+
+void Send_Scheduler::clear()
+{
+    std::array<std::deque<std::shared_ptr<Message_Item>>, PRIORITY_COUNT> queues;
+    {
+        std::lock_guard lock(mutex_);
+        queues.swap(queues_);
+        size_ = 0;
+        credits_ = weights_;
+    }
+    // Messages are destroyed without lock, their finally callbacks may send again
+}
+
+} // namespace Net
+} // namespace Helpz
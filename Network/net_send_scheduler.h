@@ -0,0 +1,66 @@
+#ifndef HELPZ_NETWORK_SEND_SCHEDULER_H
+#define HELPZ_NETWORK_SEND_SCHEDULER_H
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <memory>
+
+#include <Helpz/net_message_item.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Send_Scheduler class
+ *
+ * Queues of messages waiting for write, one per Message_Priority.
+ * Weighted round robin: in each round queue gives up to its weight messages,
+ * higher priority first, so bulk transfer can't hold interactive messages
+ * and still isn't starved by them. Thread safe.
+ */
+class Send_Scheduler
+{
+public:
+    typedef std::array<uint32_t, PRIORITY_COUNT> Weights;
+
+    explicit Send_Scheduler(const Weights& weights = default_weights());
+
+    static Weights default_weights();
+
+    Weights weights() const;
+    void set_weights(const Weights& weights);
+
+    /**
+     * @brief push
+     * @return true if scheduler was empty, then caller should start writing
+     */
+    bool push(std::shared_ptr<Message_Item> message);
+
+    /**
+     * @brief pop
+     * @return next message to write, empty if there are no messages
+     */
+    std::shared_ptr<Message_Item> pop();
+
+    /**
+     * @brief has_pending_above
+     * Is any message with higher priority than priority waiting.
+     */
+    bool has_pending_above(Message_Priority priority) const;
+
+    bool empty() const;
+    std::size_t size() const;
+    void clear();
+
+private:
+    mutable std::mutex mutex_;
+    std::array<std::deque<std::shared_ptr<Message_Item>>, PRIORITY_COUNT> queues_;
+    Weights weights_, credits_;
+    std::size_t size_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_SEND_SCHEDULER_H
@@ -0,0 +1,252 @@
+#include <functional>
+
+#include "net_timing_wheel.h"
+
+namespace Helpz {
+namespace Net {
+
+bool Timing_Wheel::Key::operator ==(const Key &other) const
+{
+    return data_ == other.data_ && endpoint_ == other.endpoint_;
+}
+
+std::size_t Timing_Wheel::Key_Hash::operator()(const Key &key) const
+{
+    return endpoint_hash(key.endpoint_) ^ (std::hash<void*>()(key.data_) * 31);
+}
+
+std::size_t Timing_Wheel::Endpoint_Hash::operator()(const boost::asio::ip::udp::endpoint &endpoint) const
+{
+    return endpoint_hash(endpoint);
+}
+
+/*static*/ std::size_t Timing_Wheel::endpoint_hash(const boost::asio::ip::udp::endpoint &endpoint)
+{
+    uint64_t hash = endpoint.port();
+    const boost::asio::ip::address address = endpoint.address();
+    if (address.is_v4())
+        hash |= uint64_t(address.to_v4().to_uint()) << 16;
+    else
+    {
+        for (unsigned char byte: address.to_v6().to_bytes())
+            hash = (hash ^ byte) * 0x100000001B3ull;
+    }
+
+    // splitmix64 finalizer, without it low bits depend only on port
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return static_cast<std::size_t>(hash);
+}
+
+Timing_Wheel::Timing_Wheel(std::chrono::milliseconds tick, Clock::time_point start) :
+    tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)), start_(start), current_tick_(0)
+{
+    for (uint32_t level = 0; level < LEVELS; ++level)
+    {
+        level_sizes_[level] = 0;
+        for (uint32_t slot = 0; slot < SLOTS; ++slot)
+            slots_[level][slot] = nullptr;
+    }
+}
+
+bool Timing_Wheel::empty() const { return entries_.empty(); }
+std::size_t Timing_Wheel::size() const { return entries_.size(); }
+std::chrono::milliseconds Timing_Wheel::tick() const { return tick_; }
+
+void Timing_Wheel::add(const Key &key, Clock::time_point time_point)
+{
+    // Timer never fires earlier than its time point, so round up.
+    const uint64_t tick = std::max(tick_of(time_point + tick_ - std::chrono::nanoseconds(1)), current_tick_ + 1);
+
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        if (it->second.tick_ <= tick)
+            return;
+        unlink(it->second);
+    }
+    else
+    {
+        it = entries_.emplace(key, Entry{0, 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}).first;
+        it->second.key_ = &it->first;
+        link_endpoint(it->second);
+    }
+
+    it->second.tick_ = tick;
+    link(it->second);
+}
+
+bool Timing_Wheel::cancel(const Key &key)
+{
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+        return false;
+
+    unlink(it->second);
+    unlink_endpoint(it->second);
+    entries_.erase(it);
+    return true;
+}
+
+std::size_t Timing_Wheel::cancel_all(const boost::asio::ip::udp::endpoint &endpoint)
+{
+    auto endpoint_it = endpoint_entries_.find(endpoint);
+    if (endpoint_it == endpoint_entries_.end())
+        return 0;
+
+    Entry* entry = endpoint_it->second;
+    endpoint_entries_.erase(endpoint_it);
+
+    std::size_t count = 0;
+    while (entry)
+    {
+        Entry* next = entry->endpoint_next_;
+        unlink(*entry);
+        entries_.erase(entries_.find(*entry->key_));
+        entry = next;
+        ++count;
+    }
+    return count;
+}
+
+void Timing_Wheel::advance(Clock::time_point time_point, std::vector<Key> &expired)
+{
+    const uint64_t target_tick = tick_of(time_point);
+    if (entries_.empty())
+    {
+        current_tick_ = std::max(current_tick_, target_tick);
+        return;
+    }
+
+    while (current_tick_ < target_tick && !entries_.empty())
+    {
+        // Nothing can expire until turn of the lowest not empty level, so skip to it
+        uint32_t lowest = 0;
+        while (!level_sizes_[lowest])
+            ++lowest;
+        if (lowest)
+        {
+            const uint32_t shift = SLOT_BITS * lowest;
+            const uint64_t turn_tick = ((current_tick_ >> shift) + 1) << shift;
+            if (turn_tick > target_tick)
+                break;
+            current_tick_ = turn_tick - 1;
+        }
+
+        ++current_tick_;
+
+        // On turn of each level its next slot is moved to lower levels
+        for (uint32_t level = 1; level < LEVELS; ++level)
+        {
+            if (current_tick_ & ((uint64_t(1) << (SLOT_BITS * level)) - 1))
+                break;
+            cascade(level);
+        }
+
+        Entry*& slot = slots_[0][current_tick_ & (SLOTS - 1)];
+        while (slot)
+        {
+            Entry* entry = slot;
+            unlink(*entry);
+            unlink_endpoint(*entry);
+            expired.push_back(*entry->key_);
+            entries_.erase(*entry->key_);
+        }
+    }
+
+    current_tick_ = std::max(current_tick_, target_tick);
+}
+
+uint64_t Timing_Wheel::tick_of(Clock::time_point time_point) const
+{
+    if (time_point <= start_)
+        return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time_point - start_).count() / tick_.count();
+}
+
+void Timing_Wheel::link(Entry &entry)
+{
+    const uint64_t max_delta = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    const uint64_t delta = entry.tick_ - current_tick_;
+    const uint64_t tick = delta > max_delta ? current_tick_ + max_delta : entry.tick_;
+
+    uint32_t level = 0;
+    while (level < LEVELS - 1 && (tick - current_tick_) >> (SLOT_BITS * (level + 1)))
+        ++level;
+
+    Entry*& slot = slots_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    ++level_sizes_[level];
+    entry.level_ = level;
+    entry.slot_ = &slot;
+    entry.prev_ = nullptr;
+    entry.next_ = slot;
+    if (slot)
+        slot->prev_ = &entry;
+    slot = &entry;
+}
+
+void Timing_Wheel::unlink(Entry &entry)
+{
+    --level_sizes_[entry.level_];
+
+    if (entry.prev_)
+        entry.prev_->next_ = entry.next_;
+    else
+        *entry.slot_ = entry.next_;
+
+    if (entry.next_)
+        entry.next_->prev_ = entry.prev_;
+
+    entry.prev_ = entry.next_ = nullptr;
+    entry.slot_ = nullptr;
+}
+
+void Timing_Wheel::link_endpoint(Entry &entry)
+{
+    Entry*& head = endpoint_entries_[entry.key_->endpoint_];
+    entry.endpoint_prev_ = nullptr;
+    entry.endpoint_next_ = head;
+    if (head)
+        head->endpoint_prev_ = &entry;
+    head = &entry;
+}
+
+void Timing_Wheel::unlink_endpoint(Entry &entry)
+{
+    if (entry.endpoint_prev_)
+        entry.endpoint_prev_->endpoint_next_ = entry.endpoint_next_;
+    else
+    {
+        auto it = endpoint_entries_.find(entry.key_->endpoint_);
+        if (entry.endpoint_next_)
+            it->second = entry.endpoint_next_;
+        else
+            endpoint_entries_.erase(it);
+    }
+
+    if (entry.endpoint_next_)
+        entry.endpoint_next_->endpoint_prev_ = entry.endpoint_prev_;
+
+    entry.endpoint_prev_ = entry.endpoint_next_ = nullptr;
+}
+
+void Timing_Wheel::cascade(uint32_t level)
+{
+    Entry*& slot = slots_[level][(current_tick_ >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    Entry* entry = slot;
+    slot = nullptr;
+
+    while (entry)
+    {
+        Entry* next = entry->next_;
+        --level_sizes_[level];
+        link(*entry);
+        entry = next;
+    }
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,115 @@
+#ifndef HELPZ_NETWORK_TIMING_WHEEL_H
+#define HELPZ_NETWORK_TIMING_WHEEL_H
+
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+
+#include <boost/asio/ip/udp.hpp>
+
+#include <Helpz/net_defs.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Timing_Wheel class
+ *
+ * Hierarchical timing wheel on steady_clock: LEVELS wheels of SLOTS slots,
+ * slot of each next level is whole turn of previous one.
+ * Timer is unique by endpoint and data, adding existing timer keeps earlier time point.
+ * Add and cancel are O(1), timers of far levels are moved to near ones when their turn comes.
+ * Not thread safe, Protocol_Timer keeps one wheel per shard.
+ */
+class Timing_Wheel
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum { SLOT_BITS = 6, SLOTS = 1 << SLOT_BITS, LEVELS = 4 };
+
+    struct Key
+    {
+        boost::asio::ip::udp::endpoint endpoint_;
+        void* data_;
+
+        bool operator ==(const Key& other) const;
+    };
+
+    struct Key_Hash
+    {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    struct Endpoint_Hash
+    {
+        std::size_t operator()(const boost::asio::ip::udp::endpoint& endpoint) const;
+    };
+
+    /**
+     * @brief endpoint_hash
+     * All bits of address and port are mixed, so modulo of any shard count depends on both.
+     */
+    static std::size_t endpoint_hash(const boost::asio::ip::udp::endpoint& endpoint);
+
+    explicit Timing_Wheel(std::chrono::milliseconds tick = std::chrono::milliseconds(HELPZ_PROTOCOL_TIMER_TICK), Clock::time_point start = Clock::now());
+    Timing_Wheel(const Timing_Wheel&) = delete;
+    Timing_Wheel& operator =(const Timing_Wheel&) = delete;
+
+    bool empty() const;
+    std::size_t size() const;
+    std::chrono::milliseconds tick() const;
+
+    void add(const Key& key, Clock::time_point time_point);
+    bool cancel(const Key& key);
+
+    /**
+     * @brief cancel_all
+     * Cancel all timers of endpoint, returns their count.
+     */
+    std::size_t cancel_all(const boost::asio::ip::udp::endpoint& endpoint);
+
+    /**
+     * @brief advance
+     * Move wheel to time point and append expired timers to expired.
+     * Timers fire not earlier than their time point, but may be late up to one tick.
+     */
+    void advance(Clock::time_point time_point, std::vector<Key>& expired);
+
+private:
+    struct Entry
+    {
+        uint64_t tick_;
+        uint32_t level_;
+        Entry* prev_;
+        Entry* next_;
+        Entry** slot_;
+        const Key* key_;
+
+        // Timers of same endpoint
+        Entry* endpoint_prev_;
+        Entry* endpoint_next_;
+    };
+    typedef std::unordered_map<Key, Entry, Key_Hash> Entry_Map;
+
+    uint64_t tick_of(Clock::time_point time_point) const;
+    void link(Entry& entry);
+    void unlink(Entry& entry);
+    void link_endpoint(Entry& entry);
+    void unlink_endpoint(Entry& entry);
+    void cascade(uint32_t level);
+
+    const std::chrono::milliseconds tick_;
+    const Clock::time_point start_;
+    uint64_t current_tick_;
+
+    Entry* slots_[LEVELS][SLOTS];
+    std::size_t level_sizes_[LEVELS];
+    Entry_Map entries_;
+    std::unordered_map<boost::asio::ip::udp::endpoint, Entry*, Endpoint_Hash> endpoint_entries_;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_TIMING_WHEEL_H
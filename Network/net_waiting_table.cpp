@@ -0,0 +1,119 @@
+#include "net_waiting_table.h"
+
+namespace Helpz {
+namespace Net {
+
+bool Waiting_Table::empty() const { return items_.empty(); }
+std::size_t Waiting_Table::size() const { return items_.size(); }
+std::size_t Waiting_Table::unacked_count() const { return unacked_count_; }
+
+void Waiting_Table::add(Time_Point time_point, std::shared_ptr<Message_Item> message, bool is_acked)
+{
+    const uint32_t msg_id = message->id_.value_or(0);
+
+    auto it = items_.find(msg_id);
+    if (it != items_.end())
+    {
+        deadlines_.erase(it->second.deadline_it_);
+        if (!it->second.is_acked_)
+            --unacked_count_;
+        it->second.message_ = std::move(message);
+        it->second.is_acked_ = is_acked;
+    }
+    else
+        it = items_.emplace(msg_id, Item{std::move(message), deadlines_.end(), is_acked}).first;
+
+    if (!is_acked)
+        ++unacked_count_;
+    it->second.deadline_it_ = deadlines_.emplace(time_point, msg_id);
+}
+
+Waiting_Table::Time_Point Waiting_Table::next_time_point() const
+{
+    return deadlines_.empty() ? Time_Point{} : deadlines_.begin()->first;
+}
+
+std::shared_ptr<Message_Item> Waiting_Table::pop(uint32_t msg_id)
+{
+    auto it = items_.find(msg_id);
+    if (it == items_.end())
+        return {};
+    return take(it);
+}
+
+std::shared_ptr<Message_Item> Waiting_Table::pop_answer(uint32_t msg_id, uint8_t cmd)
+{
+    auto it = items_.find(msg_id);
+    if (it == items_.end() || it->second.message_->cmd() != cmd)
+        return {};
+    return take(it);
+}
+
+std::vector<std::shared_ptr<Message_Item>> Waiting_Table::pop_expired(Time_Point time_point)
+{
+    std::vector<std::shared_ptr<Message_Item>> messages;
+    for (auto it = deadlines_.begin(); it != deadlines_.end() && it->first <= time_point; )
+    {
+        auto item_it = items_.find(it->second);
+        if (!item_it->second.is_acked_)
+            --unacked_count_;
+        messages.push_back(std::move(item_it->second.message_));
+        items_.erase(item_it);
+        it = deadlines_.erase(it);
+    }
+    return messages;
+}
+
+std::vector<std::shared_ptr<Message_Item>> Waiting_Table::pop_unacked(uint32_t first_id, uint32_t last_id)
+{
+    std::vector<std::shared_ptr<Message_Item>> messages;
+    const uint32_t range_size = last_id - first_id;
+
+    if (range_size < items_.size())
+    {
+        for (uint32_t msg_id = first_id; ; ++msg_id)
+        {
+            auto it = items_.find(msg_id);
+            if (it != items_.end() && !it->second.is_acked_)
+                messages.push_back(take(it));
+
+            if (msg_id == last_id)
+                break;
+        }
+    }
+    else
+    {
+        for (auto it = items_.begin(); it != items_.end(); )
+        {
+            if (!it->second.is_acked_ && it->first - first_id <= range_size)
+            {
+                auto next_it = std::next(it);
+                messages.push_back(take(it));
+                it = next_it;
+            }
+            else
+                ++it;
+        }
+    }
+    return messages;
+}
+
+void Waiting_Table::clear()
+{
+    items_.clear();
+    deadlines_.clear();
+    unacked_count_ = 0;
+}
+
+std::shared_ptr<Message_Item> Waiting_Table::take(Item_Map::iterator it)
+{
+    std::shared_ptr<Message_Item> message = std::move(it->second.message_);
+    if (!it->second.is_acked_)
+        --unacked_count_;
+    deadlines_.erase(it->second.deadline_it_);
+    items_.erase(it);
+    return message;
+}
+
+} // namespace Net
+} // namespace Helpz
@@ -0,0 +1,79 @@
+#ifndef HELPZ_NETWORK_WAITING_TABLE_H
+#define HELPZ_NETWORK_WAITING_TABLE_H
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include <Helpz/net_message_item.h>
+
+namespace Helpz {
+namespace Net {
+
+/**
+ * @brief The Waiting_Table class
+ *
+ * Messages which wait for answer, fragment query or resend.
+ * Indexed by message id, with separate deadline index for timer expiration.
+ * Message id is unique in table, so answer lookup by id and cmd is a single find.
+ * Acknowledged messages wait only for answer and don't take place in send window.
+ * Not thread safe, Protocol locks it.
+ */
+class Waiting_Table
+{
+public:
+    typedef std::chrono::time_point<std::chrono::system_clock> Time_Point;
+
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t unacked_count() const;
+
+    /**
+     * @brief add
+     * Replaces message with the same id if it is already in table.
+     */
+    void add(Time_Point time_point, std::shared_ptr<Message_Item> message, bool is_acked = false);
+
+    std::shared_ptr<Message_Item> pop(uint32_t msg_id);
+    std::shared_ptr<Message_Item> pop_answer(uint32_t msg_id, uint8_t cmd);
+    std::vector<std::shared_ptr<Message_Item>> pop_expired(Time_Point time_point);
+
+    /**
+     * @brief next_time_point
+     * @return nearest deadline or zero time point if table is empty
+     */
+    Time_Point next_time_point() const;
+
+    /**
+     * @brief pop_unacked
+     * Pops not acknowledged messages with id in range [first_id, last_id].
+     * Range may wrap around zero.
+     */
+    std::vector<std::shared_ptr<Message_Item>> pop_unacked(uint32_t first_id, uint32_t last_id);
+
+    void clear();
+
+private:
+    typedef std::multimap<Time_Point, uint32_t> Deadline_Map;
+
+    struct Item
+    {
+        std::shared_ptr<Message_Item> message_;
+        Deadline_Map::iterator deadline_it_;
+        bool is_acked_;
+    };
+    typedef std::unordered_map<uint32_t, Item> Item_Map;
+
+    std::shared_ptr<Message_Item> take(Item_Map::iterator it);
+
+    Item_Map items_;
+    Deadline_Map deadlines_;
+    std::size_t unacked_count_ = 0;
+};
+
+} // namespace Net
+} // namespace Helpz
+
+#endif // HELPZ_NETWORK_WAITING_TABLE_H
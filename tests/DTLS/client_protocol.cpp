@@ -85,12 +85,12 @@ void Client_Protocol::ready_write()
 //    test_message_with_answer();
 }
 
-void Client_Protocol::process_message(uint8_t msg_id, uint8_t cmd, QIODevice &data_dev)
+void Client_Protocol::process_message(uint32_t msg_id, uint8_t cmd, QIODevice &data_dev)
 {
     std::cout << "process_message #" << msg_id << ' ' << int(cmd) << " size " << data_dev.size() << std::endl;
 }
 
-void Client_Protocol::process_answer_message(uint8_t msg_id, uint8_t cmd, QIODevice &data_dev)
+void Client_Protocol::process_answer_message(uint32_t msg_id, uint8_t cmd, QIODevice &data_dev)
 {
     std::cout << "process_answer_message #" << msg_id << ' ' << int(cmd) << " size " << data_dev.size() << std::endl;
 }
@@ -70,7 +70,7 @@ void Server_Protocol::ready_write()
     qDebug().noquote() << title() << "CONNECTED";
 }
 
-void Server_Protocol::process_message(uint8_t msg_id, uint8_t cmd, QIODevice &data_dev)
+void Server_Protocol::process_message(uint32_t msg_id, uint8_t cmd, QIODevice &data_dev)
 {
     // Maybe you want call server->remove_copy(this); after authentication process done.
 
@@ -86,7 +86,7 @@ void Server_Protocol::process_message(uint8_t msg_id, uint8_t cmd, QIODevice &da
     }
 }
 
-void Server_Protocol::process_answer_message(uint8_t msg_id, uint8_t cmd, QIODevice &data_dev)
+void Server_Protocol::process_answer_message(uint32_t msg_id, uint8_t cmd, QIODevice &data_dev)
 {
     qDebug().noquote() << title() << "process_answer_message #" << int(msg_id) << int(cmd) << "size" << data_dev.size();
 }
@@ -97,7 +97,7 @@ void Server_Protocol::process_simple(QString value1)
     qDebug().noquote() << title() << "MSG_SIMPLE" << value1;
 }
 
-void Server_Protocol::process_answered(bool value1, uint32_t value2, uint8_t cmd, uint8_t msg_id)
+void Server_Protocol::process_answered(bool value1, uint32_t value2, uint8_t cmd, uint32_t msg_id)
 {
     promise_answer_.set_value(value2);
     qDebug().noquote() << title() << "MSG_ANSWERED" << value1 << "v" << value2;
@@ -1,3 +1,11 @@
+#include <map>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
+
 #include <QString>
 #include <QtTest>
 #include <QCoreApplication>
@@ -185,6 +193,342 @@ void DTLS_Test::check_parallel_message()
     QCOMPARE(file_future.get(), hash);
 }
 
+void DTLS_Test::check_buffer_pool()
+{
+    auto pool = std::make_shared<DTLS::Buffer_Pool>(64, 1, 1024, 2);
+
+    uint8_t* small_data;
+    {
+        DTLS::Buffer_Pool::Buffer buffer = pool->take(10);
+        QVERIFY(buffer);
+        small_data = buffer.get();
+    }
+    QCOMPARE(pool->take(64).get(), small_data);
+    QCOMPARE(pool->slab_count(), static_cast<std::size_t>(1));
+    QCOMPARE(pool->cached_small(), static_cast<std::size_t>(HELPZ_SOCKET_SLAB_SIZE));
+
+    {
+        DTLS::Buffer_Pool::Buffer record1 = pool->take(100);
+        DTLS::Buffer_Pool::Buffer record2 = pool->take(1024);
+        DTLS::Buffer_Pool::Buffer record3 = pool->take(500);
+        QVERIFY(record1 && record2 && record3);
+    }
+    // Only max_cached_records record buffers are kept
+    QCOMPARE(pool->cached_record(), static_cast<std::size_t>(2));
+    QCOMPARE(pool->cached_large(), static_cast<std::size_t>(0));
+
+    {
+        DTLS::Buffer_Pool::Buffer large1 = pool->take(1025);
+        DTLS::Buffer_Pool::Buffer large2 = pool->take(HELPZ_MAX_UDP_PACKET_SIZE);
+        QVERIFY(large1 && large2);
+    }
+    // Only max_cached large buffers are kept
+    QCOMPARE(pool->cached_large(), static_cast<std::size_t>(1));
+    QVERIFY(pool->take(HELPZ_MAX_UDP_PACKET_SIZE));
+
+    {
+        DTLS::Buffer_Pool::Buffer huge = pool->take(HELPZ_MAX_UDP_PACKET_SIZE + 1);
+        QVERIFY(huge);
+    }
+    QCOMPARE(pool->cached_large(), static_cast<std::size_t>(1));
+
+    // Buffer keeps its pool alive
+    DTLS::Buffer_Pool::Buffer last = pool->take(1);
+    pool.reset();
+    last[0] = 1;
+}
+
+void DTLS_Test::check_server_shards()
+{
+    if (!DTLS::Server::is_sharding_supported())
+        QSKIP("SO_REUSEPORT sharding isn't supported");
+
+    Helpz::DTLS::Server_Thread_Config server_conf;
+    server_conf.set_port(0);
+    server_conf.set_tls_police_file_name(config_files_.at(0).toStdString());
+    server_conf.set_certificate_file_name(config_files_.at(1).toStdString());
+    server_conf.set_certificate_key_file_name(config_files_.at(2).toStdString());
+    server_conf.set_record_thread_count(1);
+    server_conf.set_shard_count(3);
+    server_conf.set_create_protocol_func(Helpz::DTLS::Create_Server_Protocol_Func_T(Server_Protocol::create));
+
+    Helpz::DTLS::Server_Thread sharded_thread{std::move(server_conf)};
+    DTLS::Server* server = sharded_thread.server();
+    QVERIFY(server);
+    QCOMPARE(server->shard_count(), static_cast<std::size_t>(3));
+
+    const uint16_t port = server->get_local_port();
+    QVERIFY(port != 0);
+    for (std::size_t i = 0; i < server->shard_count(); ++i)
+        QCOMPARE(server->shard(i)->get_local_port(), port);
+
+    QVERIFY(!server->find_client([](const Helpz::Net::Protocol* ) { return true; }));
+
+    // Each client address is pinned to one shard
+    Helpz::DTLS::Client_Thread_Config client_conf;
+    client_conf.set_tls_police_file_name(config_files_.at(0).toStdString());
+    client_conf.set_host("localhost");
+    client_conf.set_port(std::to_string(port));
+    client_conf.set_next_protocols({Server_Protocol::name()});
+    client_conf.set_reconnect_interval(std::chrono::seconds(5));
+    client_conf.set_create_protocol_func(Client_Protocol::create);
+
+    Helpz::DTLS::Client_Thread client_thread{std::move(client_conf)};
+
+    std::size_t shards_with_client = 0;
+    for (int attempt = 0; attempt < 3 && !shards_with_client; ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1500});
+        for (std::size_t i = 0; i < server->shard_count(); ++i)
+            if (server->shard(i)->controller()->find_client([](const Helpz::Net::Protocol* ) { return true; }))
+                ++shards_with_client;
+    }
+    QCOMPARE(shards_with_client, static_cast<std::size_t>(1));
+    QVERIFY(server->find_client([](const Helpz::Net::Protocol* ) { return true; }));
+}
+
+void DTLS_Test::check_client_registry()
+{
+    {
+        // Clients with same local port are spread over all shards
+        DTLS::Client_Registry registry;
+        std::vector<std::size_t> shard_sizes(registry.shard_count(), 0);
+        for (uint32_t i = 0; i < 10000; ++i)
+            ++shard_sizes.at(registry.shard_index({boost::asio::ip::address_v4(0x0A000000 + i), 5555}));
+        QVERIFY(*std::min_element(shard_sizes.cbegin(), shard_sizes.cend()) > 0);
+        QVERIFY(*std::max_element(shard_sizes.cbegin(), shard_sizes.cend()) < 10000 / registry.shard_count() * 2);
+    }
+
+    auto node = server_thread_->server()->find_client([](const Helpz::Net::Protocol* ) { return true; });
+    QVERIFY(node);
+
+    DTLS::Server_Controller* controller = server_thread_->server()->shard(0)->controller();
+    QCOMPARE(controller->find_client(node->receiver_endpoint()), node);
+    QCOMPARE(controller->get_node(node->receiver_endpoint()), std::static_pointer_cast<DTLS::Node>(node));
+
+    // Unknown endpoint isn't added by lookup
+    const boost::asio::ip::udp::endpoint unknown_endpoint{boost::asio::ip::address_v4::loopback(), 1};
+    QVERIFY(!controller->find_client(unknown_endpoint));
+    QVERIFY(!controller->check_copy(node->protocol().get()));
+}
+
+void DTLS_Test::check_record_pool()
+{
+    // Pool never dereferences nodes, so fake pointers are enough here
+    constexpr std::size_t node_count = 8, run_count = 1000;
+    std::shared_ptr<std::array<char, node_count>> owner = std::make_shared<std::array<char, node_count>>();
+    std::vector<std::shared_ptr<DTLS::Server_Node>> nodes;
+    std::map<const DTLS::Server_Node*, std::size_t> node_index;
+    for (std::size_t i = 0; i < node_count; ++i)
+    {
+        nodes.emplace_back(owner, reinterpret_cast<DTLS::Server_Node*>(&owner->at(i)));
+        node_index[nodes.back().get()] = i;
+    }
+
+    std::atomic<std::size_t> done{0};
+    std::atomic<bool> is_parallel{false};
+    std::array<std::atomic<int>, node_count> running;
+    std::array<std::size_t, node_count> remain;
+    for (std::size_t i = 0; i < node_count; ++i)
+    {
+        running[i] = 0;
+        remain[i] = run_count;
+    }
+
+    {
+        DTLS::Record_Pool pool{4, [&](const std::shared_ptr<DTLS::Server_Node>& node)
+        {
+            const std::size_t i = node_index.at(node.get());
+            if (++running[i] != 1)
+                is_parallel = true;
+            const bool is_again = --remain[i] > 0;
+            --running[i];
+            ++done;
+            return is_again;
+        }};
+
+        for (const std::shared_ptr<DTLS::Server_Node>& node: nodes)
+            pool.schedule(node);
+
+        for (int attempt = 0; attempt < 300 && done < node_count * run_count; ++attempt)
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+
+    QCOMPARE(done.load(), node_count * run_count);
+    QVERIFY(!is_parallel);
+}
+
+void DTLS_Test::check_node_mailbox()
+{
+    // Node isn't added to server, so only this test uses its mailbox
+    DTLS::Server_Controller* controller = server_thread_->server()->shard(0)->controller();
+    auto node = std::make_shared<DTLS::Server_Node>(controller, boost::asio::ip::udp::endpoint{boost::asio::ip::address_v4::loopback(), 2});
+
+    constexpr std::size_t producer_count = 4, record_count = 10000;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::size_t schedule_count = 0;
+
+    // Consumer runs node like pool thread: only after add_record reported idle mailbox, until take_record is empty
+    std::size_t consumed = 0, empty_runs = 0;
+    bool is_order_broken = false;
+    std::thread consumer([&]()
+    {
+        std::array<std::size_t, producer_count> next_seq{};
+        DTLS::Server_Node::Record record;
+        while (consumed < producer_count * record_count)
+        {
+            {
+                std::unique_lock lock(mutex);
+                if (!cond.wait_for(lock, std::chrono::seconds(5), [&schedule_count]() { return schedule_count > 0; }))
+                    break;
+                --schedule_count;
+            }
+
+            bool is_empty = true;
+            while (node->take_record(record))
+            {
+                is_empty = false;
+                const std::size_t producer = reinterpret_cast<std::size_t>(record.timeout_data_);
+                if (record.size_ != next_seq.at(producer)++)
+                    is_order_broken = true;
+                ++consumed;
+            }
+            if (is_empty)
+                ++empty_runs;
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (std::size_t i = 0; i < producer_count; ++i)
+    {
+        producers.emplace_back([&, i]()
+        {
+            for (std::size_t seq = 0; seq < record_count; ++seq)
+            {
+                if (node->add_record(DTLS::Server_Node::Record{DTLS::Buffer_Pool::Buffer{}, seq, reinterpret_cast<void*>(i)}))
+                {
+                    std::lock_guard lock(mutex);
+                    ++schedule_count;
+                    cond.notify_one();
+                }
+            }
+        });
+    }
+
+    for (std::thread& producer: producers)
+        producer.join();
+    consumer.join();
+
+    // Each schedule is one run which finds records, none is lost and none is doubled
+    QCOMPARE(consumed, producer_count * record_count);
+    QCOMPARE(empty_runs, static_cast<std::size_t>(0));
+    QCOMPARE(schedule_count, static_cast<std::size_t>(0));
+    QVERIFY(!is_order_broken);
+
+    DTLS::Server_Node::Record record;
+    QVERIFY(!node->take_record(record));
+    QVERIFY(node->add_record(DTLS::Server_Node::Record{DTLS::Buffer_Pool::Buffer{}, 0, nullptr}));
+    QVERIFY(!node->add_record(DTLS::Server_Node::Record{DTLS::Buffer_Pool::Buffer{}, 1, nullptr}));
+}
+
+void DTLS_Test::check_cookie_filter()
+{
+    constexpr int burst = 5;
+    DTLS::Cookie_Filter filter{std::chrono::seconds(60), 0., burst};
+
+    // Addresses of one /24 share bucket
+    using udp = boost::asio::ip::udp;
+    const udp::endpoint first{boost::asio::ip::make_address_v4("10.0.0.1"), 1000},
+            second{boost::asio::ip::make_address_v4("10.0.0.2"), 1000},
+            other{boost::asio::ip::make_address_v4("10.0.1.1"), 1000};
+    for (int i = 0; i < burst; ++i)
+        QVERIFY(filter.check_rate(i % 2 ? first : second));
+    QVERIFY(!filter.check_rate(first));
+    QVERIFY(!filter.check_rate(second));
+    QVERIFY(filter.check_rate(other));
+
+    // Not a ClientHello
+    std::vector<uint8_t> out;
+    const std::vector<uint8_t> garbage(64, 0x17);
+    QCOMPARE(filter.check(other, garbage.data(), garbage.size(), out), DTLS::Cookie_Filter::DROP);
+    QVERIFY(out.empty());
+
+    QVERIFY(server_thread_->server()->cookie_filter());
+}
+
+void DTLS_Test::check_cookie_handshake()
+{
+    // DTLS 1.2 ClientHello datagram: record header, handshake header, body with one cipher suite
+    auto make_hello = [](uint64_t record_seq, uint16_t message_seq, const std::vector<uint8_t>& cookie)
+    {
+        std::vector<uint8_t> body{254, 253};
+        for (uint8_t i = 0; i < 32; ++i)
+            body.push_back(i);                              // random
+        body.push_back(0);                                  // session id
+        body.push_back(static_cast<uint8_t>(cookie.size()));
+        body.insert(body.end(), cookie.cbegin(), cookie.cend());
+        body.insert(body.end(), {0, 2, 0xC0, 0x2B, 1, 0});  // cipher suites and compression
+
+        const std::size_t size = 12 + body.size();
+        std::vector<uint8_t> datagram{22, 254, 253, 0, 0};
+        for (int shift = 40; shift >= 0; shift -= 8)
+            datagram.push_back(static_cast<uint8_t>(record_seq >> shift));
+        datagram.insert(datagram.end(), {static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size),
+                                         1, 0, static_cast<uint8_t>(body.size() >> 8), static_cast<uint8_t>(body.size()),
+                                         static_cast<uint8_t>(message_seq >> 8), static_cast<uint8_t>(message_seq),
+                                         0, 0, 0, 0, static_cast<uint8_t>(body.size() >> 8), static_cast<uint8_t>(body.size())});
+        datagram.insert(datagram.end(), body.cbegin(), body.cend());
+        return datagram;
+    };
+
+    // HelloVerifyRequest body is server version and cookie
+    auto cookie_of = [](const std::vector<uint8_t>& verify)
+    {
+        return std::vector<uint8_t>(verify.cbegin() + 13 + 12 + 3, verify.cend());
+    };
+
+    const boost::asio::ip::udp::endpoint endpoint{boost::asio::ip::make_address_v4("10.0.2.1"), 1000};
+    const std::vector<uint8_t> first_hello = make_hello(5, 0, {});
+    std::vector<uint8_t> out;
+
+    // One token is enough for verify, hello with cookie costs nothing
+    DTLS::Cookie_Filter filter{std::chrono::seconds(60), 0., 1};
+    QCOMPARE(filter.check(endpoint, first_hello.data(), first_hello.size(), out), DTLS::Cookie_Filter::VERIFY);
+    QCOMPARE(out.at(0), uint8_t(22));
+    QCOMPARE(std::vector<uint8_t>(out.cbegin() + 3, out.cbegin() + 11), std::vector<uint8_t>(first_hello.cbegin() + 3, first_hello.cbegin() + 11));
+    QCOMPARE(out.at(13), uint8_t(3));
+    QCOMPARE(out.at(17), uint8_t(0));
+    QCOMPARE(out.at(18), uint8_t(0));
+    const std::vector<uint8_t> cookie = cookie_of(out);
+    QCOMPARE(static_cast<std::size_t>(out.at(13 + 12 + 2)), cookie.size());
+    QVERIFY(!cookie.empty());
+
+    // Repeated hello is rebuilt as first one, because Botan waits for message sequence from zero
+    const std::vector<uint8_t> second_hello = make_hello(6, 1, cookie);
+    QCOMPARE(filter.check(endpoint, second_hello.data(), second_hello.size(), out), DTLS::Cookie_Filter::ACCEPT);
+    QCOMPARE(out, first_hello);
+    QCOMPARE(filter.check(endpoint, second_hello.data(), second_hello.size(), out), DTLS::Cookie_Filter::ACCEPT);
+
+    const std::vector<uint8_t> zero_seq_hello = make_hello(0, 0, cookie);
+    QCOMPARE(filter.check(endpoint, zero_seq_hello.data(), zero_seq_hello.size(), out), DTLS::Cookie_Filter::ACCEPT);
+    QVERIFY(out.empty());
+
+    // Cookie is bound to endpoint, and other endpoint has no tokens left in this prefix
+    const boost::asio::ip::udp::endpoint other_port{endpoint.address(), 1001};
+    QCOMPARE(filter.check(other_port, second_hello.data(), second_hello.size(), out), DTLS::Cookie_Filter::DROP);
+    QCOMPARE(filter.check(endpoint, first_hello.data(), first_hello.size(), out), DTLS::Cookie_Filter::DROP);
+
+    // Secret rotates on each check here: cookie of previous secret is accepted, older one is not
+    DTLS::Cookie_Filter rotating_filter{std::chrono::seconds(0)};
+    QCOMPARE(rotating_filter.check(endpoint, first_hello.data(), first_hello.size(), out), DTLS::Cookie_Filter::VERIFY);
+    const std::vector<uint8_t> rotated_hello = make_hello(6, 1, cookie_of(out));
+    QCOMPARE(rotating_filter.check(endpoint, rotated_hello.data(), rotated_hello.size(), out), DTLS::Cookie_Filter::ACCEPT);
+    QCOMPARE(out, first_hello);
+    rotating_filter.secret();
+    QCOMPARE(rotating_filter.check(endpoint, rotated_hello.data(), rotated_hello.size(), out), DTLS::Cookie_Filter::VERIFY);
+}
+
 std::shared_ptr<Client_Protocol> DTLS_Test::get_client_protocol()
 {
     auto client = client_thread_->client();
@@ -26,6 +26,13 @@ private Q_SLOTS:
     void check_answered_message();
     void check_file_message();
     void check_parallel_message();
+    void check_buffer_pool();
+    void check_server_shards();
+    void check_client_registry();
+    void check_record_pool();
+    void check_node_mailbox();
+    void check_cookie_filter();
+    void check_cookie_handshake();
 
 private:
     std::shared_ptr<Client_Protocol> get_client_protocol();
@@ -1,12 +1,214 @@
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
 #include <QString>
 #include <QtTest>
 #include <QCoreApplication>
 #include <QSignalSpy>
 
 #include <Helpz/net_fragmented_message.h>
+#include <Helpz/net_ring_buffer.h>
+#include <Helpz/net_protocol.h>
+#include <Helpz/net_waiting_table.h>
+#include <Helpz/net_crc32c.h>
+#include <Helpz/net_timing_wheel.h>
+#include <Helpz/net_protocol_timer.h>
+#include <Helpz/net_send_scheduler.h>
+#include <Helpz/net_emulator.h>
 
 namespace Helpz
 {
+
+struct Fixed_Point
+{
+    qint32 x_;
+    double y_;
+    bool is_valid_;
+};
+
+QDataStream& operator <<(QDataStream& ds, const Fixed_Point& point) { return ds << point.x_ << point.y_ << point.is_valid_; }
+
+template<> struct Fixed_Codec<Fixed_Point> : Fixed_Struct_Codec<Fixed_Point, &Fixed_Point::x_, &Fixed_Point::y_, &Fixed_Point::is_valid_> {};
+
+struct Fixed_Handler
+{
+    int handle(quint8 a, Net::Cmd::ReservedCommands cmd, Fixed_Point point, std::array<qint16, 2> arr, float f, int extra)
+    {
+        return a + cmd + point.x_ + static_cast<int>(point.y_) + point.is_valid_ + arr[0] + arr[1] + static_cast<int>(f) + extra;
+    }
+};
+
+namespace Net {
+
+struct Protocol_Test_Access
+{
+    // Id of next version 2 message without stream
+    static void set_next_ext_msg_id(Protocol& protocol, uint32_t msg_id) { protocol.next_tx_ext_msg_id_ = msg_id; }
+};
+
+} // namespace Net
+
+class Test_Protocol : public Net::Protocol
+{
+public:
+    QByteArray make_packet(uint8_t cmd, const QByteArray& data)
+    {
+        std::unique_ptr<QIODevice> device(new QBuffer);
+        device->open(QIODevice::ReadWrite);
+        device->write(data);
+        return prepare_packet_to_send(std::make_shared<Net::Message_Item>(cmd, std::nullopt, std::move(device)));
+    }
+
+    std::vector<uint8_t> cmd_list_;
+    std::vector<QByteArray> data_list_;
+    std::vector<uint32_t> msg_id_list_;
+
+    QByteArray stream_data_;
+    std::size_t stream_call_count_ = 0;
+    bool is_stream_finished_ = false;
+private:
+    void process_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    {
+        if (!data_dev.isOpen())
+            data_dev.open(QIODevice::ReadOnly);
+
+        msg_id_list_.push_back(msg_id);
+        cmd_list_.push_back(cmd);
+        data_list_.push_back(data_dev.readAll());
+    }
+    void process_answer_message(uint32_t /*msg_id*/, uint8_t /*cmd*/, QIODevice& /*data_dev*/) override {}
+    void process_stream_message(uint32_t /*msg_id*/, uint8_t /*cmd*/, Net::Fragment_Stream& stream) override
+    {
+        ++stream_call_count_;
+        stream_data_ += stream.readAll();
+        is_stream_finished_ = stream.is_finished();
+    }
+};
+
+// Compresses only data of same bytes, enough to check codec selection
+class Same_Byte_Codec : public Net::Codec
+{
+public:
+    enum { TYPE = 5 };
+
+    uint8_t type() const override { return TYPE; }
+    QByteArray compress(uint8_t /*cmd*/, const QByteArray& data) const override
+    {
+        QByteArray result;
+        QDataStream ds(&result, QIODevice::WriteOnly);
+        ds << static_cast<uint32_t>(data.size()) << static_cast<uint8_t>(data.at(0));
+        return result;
+    }
+    QByteArray uncompress(uint8_t /*cmd*/, const char* data, uint32_t /*size*/) const override
+    {
+        return QByteArray(static_cast<int>(qFromBigEndian<quint32>(data)), data[4]);
+    }
+};
+
+class Loopback_Writer : public Net::Protocol_Writer
+{
+public:
+    void write(const QByteArray& data) override { packets_.push_back(data); ++packet_count_; }
+    void write(std::shared_ptr<Net::Message_Item> message) override
+    {
+        const QByteArray data = protocol()->prepare_packet_to_send(std::move(message));
+        if (!data.isEmpty())
+        {
+            packets_.push_back(data);
+            ++packet_count_;
+        }
+    }
+    void add_timeout_at(std::chrono::system_clock::time_point, void* data) override { timeouts_.push_back(data); }
+    std::shared_ptr<Net::Protocol> protocol() override { return protocol_.lock(); }
+
+    std::size_t deliver_to(Net::Protocol& peer)
+    {
+        std::vector<QByteArray> packets;
+        packets.swap(packets_);
+        for (const QByteArray& data: packets)
+            peer.process_bytes(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+        return packets.size();
+    }
+
+    std::weak_ptr<Net::Protocol> protocol_;
+    std::vector<QByteArray> packets_;
+    std::vector<void*> timeouts_;
+    std::size_t packet_count_ = 0;
+};
+
+// Drops messages, so only send path is measured
+class Drop_Writer : public Loopback_Writer
+{
+public:
+    using Loopback_Writer::write;
+    void write(std::shared_ptr<Net::Message_Item> /*message*/) override { ++packet_count_; }
+};
+
+// Keeps messages like writer which posts them to other thread
+class Deferred_Writer : public Loopback_Writer
+{
+public:
+    using Loopback_Writer::write;
+    void write(std::shared_ptr<Net::Message_Item> message) override
+    {
+        if (is_deferred_)
+            messages_.push_back(std::move(message));
+        else
+            Loopback_Writer::write(std::move(message));
+    }
+
+    void flush(std::size_t count)
+    {
+        count = std::min(count, messages_.size());
+        std::vector<std::shared_ptr<Net::Message_Item>> messages(messages_.begin(), messages_.begin() + count);
+        messages_.erase(messages_.begin(), messages_.begin() + count);
+        for (std::shared_ptr<Net::Message_Item>& message: messages)
+            Loopback_Writer::write(std::move(message));
+    }
+
+    bool is_deferred_ = true;
+    std::vector<std::shared_ptr<Net::Message_Item>> messages_;
+};
+
+struct Loopback_Pair
+{
+    Loopback_Pair() :
+        a_(std::make_shared<Test_Protocol>()), b_(std::make_shared<Test_Protocol>()),
+        a_writer_(std::make_shared<Loopback_Writer>()), b_writer_(std::make_shared<Loopback_Writer>())
+    {
+        a_writer_->protocol_ = a_;
+        b_writer_->protocol_ = b_;
+        a_->set_writer(a_writer_);
+        b_->set_writer(b_writer_);
+    }
+
+    void deliver()
+    {
+        while (a_writer_->deliver_to(*b_) + b_writer_->deliver_to(*a_));
+    }
+
+    // Both sides see each other's packets and switch to version 2, received lists are cleared
+    void negotiate()
+    {
+        a_->send(Net::Cmd::USER_COMMAND);
+        deliver();
+        b_->send(Net::Cmd::USER_COMMAND);
+        deliver();
+
+        for (Test_Protocol* protocol: {a_.get(), b_.get()})
+        {
+            protocol->cmd_list_.clear();
+            protocol->data_list_.clear();
+            protocol->msg_id_list_.clear();
+        }
+    }
+
+    std::shared_ptr<Test_Protocol> a_, b_;
+    std::shared_ptr<Loopback_Writer> a_writer_, b_writer_;
+};
+
 class Network_Test : public QObject
 {
     Q_OBJECT
@@ -36,40 +238,922 @@ private Q_SLOTS:
         using T = std::vector<std::pair<uint32_t, uint32_t>>;
 
 //        T vect{{0, 100}};
-        QCOMPARE((T{{0, 100}}), msg.part_vect_);
+        QCOMPARE((T{{0, 100}}), msg.parts_.ranges());
 
         msg.add_data(0, data, 5);
-        QCOMPARE((T{{5, 100}}), msg.part_vect_);
+        QCOMPARE((T{{5, 100}}), msg.parts_.ranges());
 
         msg.add_data(1, data, 3);
-        QCOMPARE((T{{5, 100}}), msg.part_vect_);
+        QCOMPARE((T{{5, 100}}), msg.parts_.ranges());
 
         msg.add_data(10, data, 5);
-        QCOMPARE((T{{5, 10},{15, 100}}), msg.part_vect_);
+        QCOMPARE((T{{5, 10},{15, 100}}), msg.parts_.ranges());
 
         msg.add_data(50, data, 5);
-        QCOMPARE((T{{5, 10},{15, 50}, {55, 100}}), msg.part_vect_);
+        QCOMPARE((T{{5, 10},{15, 50}, {55, 100}}), msg.parts_.ranges());
 
         msg.add_data(95, data, 5);
-        QCOMPARE((T{{5, 10},{15, 50}, {55, 95}}), msg.part_vect_);
+        QCOMPARE((T{{5, 10},{15, 50}, {55, 95}}), msg.parts_.ranges());
 
         msg.add_data(96, data, 3);
-        QCOMPARE((T{{5, 10},{15, 50}, {55, 95}}), msg.part_vect_);
+        QCOMPARE((T{{5, 10},{15, 50}, {55, 95}}), msg.parts_.ranges());
 
         msg.add_data(15, data, 5);
-        QCOMPARE((T{{5, 10},{20, 50}, {55, 95}}), msg.part_vect_);
+        QCOMPARE((T{{5, 10},{20, 50}, {55, 95}}), msg.parts_.ranges());
 
         msg.add_data(5, data, 5);
-        QCOMPARE((T{{20, 50}, {55, 95}}), msg.part_vect_);
+        QCOMPARE((T{{20, 50}, {55, 95}}), msg.parts_.ranges());
 
         msg.add_data(0, data, 30);
-        QCOMPARE((T{{30, 50}, {55, 95}}), msg.part_vect_);
+        QCOMPARE((T{{30, 50}, {55, 95}}), msg.parts_.ranges());
 
         msg.add_data(70, data, 30);
-        QCOMPARE((T{{30, 50}, {55, 70}}), msg.part_vect_);
+        QCOMPARE((T{{30, 50}, {55, 70}}), msg.parts_.ranges());
 
         msg.add_data(30, data, 40);
-        QCOMPARE((T{}), msg.part_vect_);
+        QCOMPARE((T{}), msg.parts_.ranges());
+    }
+
+    void fragment_message_mapped_test()
+    {
+        const uint32_t full_size = 2000000, part_size = 30000;
+        QByteArray data(full_size, Qt::Uninitialized);
+        for (uint32_t i = 0; i < full_size; ++i)
+            data[i] = static_cast<char>(i * 7 + i / 1000);
+
+        Helpz::Net::Fragmented_Message msg(1, 1, part_size, full_size);
+        QVERIFY(msg.mapped_file_);
+        QVERIFY(msg.data_device_->open(QIODevice::ReadWrite));
+
+        // Parts are written in place in any order
+        for (uint32_t pos = (full_size / part_size) * part_size; ; pos -= part_size)
+        {
+            msg.add_data(pos, data.constData() + pos, std::min(part_size, full_size - pos));
+            if (pos == 0)
+                break;
+        }
+        QVERIFY(msg.is_parts_empty());
+
+        msg.data_device_->seek(0);
+        QCOMPARE(msg.data_device_->readAll(), data);
+    }
+
+    void fragment_message_parts_benchmark_data()
+    {
+        QTest::addColumn<int>("order");
+        QTest::newRow("in order") << 0;
+        QTest::newRow("reverse") << 1;
+        QTest::newRow("random") << 2;
+    }
+
+    void fragment_message_parts_benchmark()
+    {
+        QFETCH(int, order);
+
+        const uint32_t fragment_size = 1000, fragment_count = 10000;
+        std::vector<uint32_t> positions(fragment_count);
+        for (uint32_t i = 0; i < fragment_count; ++i)
+            positions[i] = i * fragment_size;
+
+        if (order == 1)
+            std::reverse(positions.begin(), positions.end());
+        else if (order == 2)
+            std::shuffle(positions.begin(), positions.end(), std::mt19937{42});
+
+        QBENCHMARK
+        {
+            Net::Gap_Tracker parts{fragment_size * fragment_count};
+            for (std::size_t i = 0; i < positions.size(); ++i)
+            {
+                parts.remove(positions[i], positions[i] + fragment_size);
+                if (i % 64 == 0)
+                    parts.next(0, 16, fragment_size);
+            }
+            QVERIFY(parts.empty());
+        }
+    }
+
+    void ring_buffer_test()
+    {
+        uint8_t data[16];
+        for (uint8_t i = 0; i < sizeof(data); ++i)
+            data[i] = i;
+
+        Helpz::Net::Ring_Buffer buffer(10);
+        QVERIFY(buffer.empty());
+        QVERIFY(buffer.push(data, 6));
+        buffer.pop(4);
+        QCOMPARE(buffer.size(), std::size_t(2));
+
+        // Wraps around the end of the storage
+        QVERIFY(buffer.push(data + 6, 7));
+        QCOMPARE(buffer.size(), std::size_t(9));
+        QVERIFY(!buffer.push(data, 2));
+
+        uint8_t out[9];
+        buffer.peek(out, sizeof(out));
+        QVERIFY(memcmp(out, data + 4, sizeof(out)) == 0);
+
+        const uint8_t* linear = buffer.linearize(9);
+        QVERIFY(memcmp(linear, data + 4, 9) == 0);
+
+        buffer.pop(9);
+        QVERIFY(buffer.empty());
+    }
+
+    void waiting_table_test()
+    {
+        auto make_msg = [](uint8_t id, uint8_t cmd)
+        {
+            auto msg = std::make_shared<Net::Message_Item>(cmd, std::nullopt, nullptr);
+            msg->id_ = id;
+            return msg;
+        };
+
+        Net::Waiting_Table table;
+        const auto now = std::chrono::system_clock::now();
+
+        // Messages with same time point must not collide
+        table.add(now, make_msg(1, 20));
+        table.add(now, make_msg(2, 21));
+        QCOMPARE(table.size(), std::size_t(2));
+
+        // Answer with other cmd isn't popped
+        QVERIFY(!table.pop_answer(1, 21));
+        QCOMPARE(table.size(), std::size_t(2));
+
+        // Same id replaces message and its deadline
+        table.add(now + std::chrono::seconds(5), make_msg(1, 22));
+        QCOMPARE(table.size(), std::size_t(2));
+
+        auto expired = table.pop_expired(now);
+        QCOMPARE(expired.size(), std::size_t(1));
+        QCOMPARE(expired.front()->cmd(), uint8_t(21));
+
+        QVERIFY(table.pop_answer(1, 22));
+        QVERIFY(table.empty());
+    }
+
+    void protocol_receive_split_test()
+    {
+        Test_Protocol sender, receiver;
+
+        QByteArray stream;
+        for (uint8_t i = 0; i < 3; ++i)
+            stream += sender.make_packet(Net::Cmd::USER_COMMAND + i, QByteArray(100 + i, 'a' + i));
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(stream.constData());
+
+        // Packets split between records in any place must be received in order
+        receiver.process_bytes(data, 5);
+        receiver.process_bytes(data + 5, 150);
+        receiver.process_bytes(data + 155, stream.size() - 155);
+
+        QCOMPARE(receiver.cmd_list_, (std::vector<uint8_t>{Net::Cmd::USER_COMMAND, Net::Cmd::USER_COMMAND + 1, Net::Cmd::USER_COMMAND + 2}));
+        for (uint8_t i = 0; i < 3; ++i)
+            QCOMPARE(receiver.data_list_.at(i), QByteArray(100 + i, 'a' + i));
+
+        // Corrupt record is dropped, next record is still processed
+        QByteArray corrupt = sender.make_packet(Net::Cmd::USER_COMMAND, QByteArray(10, 'x'));
+        corrupt[0] = ~corrupt[0];
+        QByteArray valid = sender.make_packet(Net::Cmd::USER_COMMAND + 5, QByteArray(10, 'y'));
+
+        receiver.cmd_list_.clear();
+        receiver.process_bytes(reinterpret_cast<const uint8_t*>(corrupt.constData()), corrupt.size());
+        receiver.process_bytes(reinterpret_cast<const uint8_t*>(valid.constData()), valid.size());
+        QCOMPARE(receiver.cmd_list_, (std::vector<uint8_t>{Net::Cmd::USER_COMMAND + 5}));
+    }
+
+    void protocol_version_test()
+    {
+        Loopback_Pair pair;
+        QCOMPARE(pair.a_->version(), uint8_t(1));
+
+        pair.a_->send(Net::Cmd::USER_COMMAND) << QString("v1");
+        QCOMPARE(pair.a_writer_->packets_.size(), std::size_t(1));
+        QVERIFY(!(pair.a_writer_->packets_.front().at(4) & Net::Protocol::EXTENDED_HEADER));
+        pair.deliver();
+        QCOMPARE(pair.b_->version(), uint8_t(2));
+
+        pair.b_->send(Net::Cmd::USER_COMMAND) << QString("v2");
+        QVERIFY(pair.b_writer_->packets_.front().at(4) & Net::Protocol::EXTENDED_HEADER);
+        pair.deliver();
+        QCOMPARE(pair.a_->version(), uint8_t(2));
+        QCOMPARE(pair.a_->cmd_list_.size(), std::size_t(1));
+
+        // Old device never sees extended packets
+        Loopback_Pair old_pair;
+        old_pair.b_->set_max_version(1);
+        old_pair.a_->send(Net::Cmd::USER_COMMAND) << QString("v1");
+        old_pair.deliver();
+        old_pair.b_->send(Net::Cmd::USER_COMMAND) << QString("v1");
+        QVERIFY(!(old_pair.b_writer_->packets_.front().at(4) & Net::Protocol::EXTENDED_SUPPORTED));
+        old_pair.deliver();
+        old_pair.a_->send(Net::Cmd::USER_COMMAND) << QString("v1");
+        QVERIFY(!(old_pair.a_writer_->packets_.front().at(4) & Net::Protocol::EXTENDED_HEADER));
+        QCOMPARE(old_pair.a_->version(), uint8_t(1));
+    }
+
+    void protocol_codec_test()
+    {
+        auto registry = std::make_shared<Net::Codec_Registry>();
+        registry->add(std::make_shared<Same_Byte_Codec>());
+
+        auto handshake = [&registry](Loopback_Pair& pair, bool is_b_supported)
+        {
+            pair.a_->set_codecs(registry);
+            if (is_b_supported)
+                pair.b_->set_codecs(registry);
+            pair.a_->set_default_codec_type(Same_Byte_Codec::TYPE);
+
+            pair.negotiate();
+        };
+        const QByteArray data(1000, 'z');
+
+        // Peer without codec receives zlib
+        Loopback_Pair pair;
+        handshake(pair, false);
+        pair.a_->send(Net::Cmd::USER_COMMAND).writeRawData(data.constData(), data.size());
+        const QByteArray zlib_packet = pair.a_writer_->packets_.front();
+        QVERIFY(zlib_packet.at(4) & Net::Protocol::COMPRESSED);
+        QCOMPARE((zlib_packet.at(12) & Net::Packet_Header::CODEC_MASK) >> Net::Packet_Header::CODEC_SHIFT, int(Net::Codec::ZLIB));
+        pair.deliver();
+        QCOMPARE(pair.b_->data_list_, (std::vector<QByteArray>{data}));
+
+        // Negotiated codec is used when both sides support it
+        Loopback_Pair codec_pair;
+        handshake(codec_pair, true);
+        codec_pair.a_->send(Net::Cmd::USER_COMMAND).writeRawData(data.constData(), data.size());
+        const QByteArray codec_packet = codec_pair.a_writer_->packets_.front();
+        QVERIFY(codec_packet.at(4) & Net::Protocol::COMPRESSED);
+        QCOMPARE((codec_packet.at(12) & Net::Packet_Header::CODEC_MASK) >> Net::Packet_Header::CODEC_SHIFT, int(Same_Byte_Codec::TYPE));
+        codec_pair.deliver();
+        QCOMPARE(codec_pair.b_->data_list_, (std::vector<QByteArray>{data}));
+    }
+
+    void crc32c_test()
+    {
+        const QByteArray check("123456789");
+        QCOMPARE(Net::crc32c(reinterpret_cast<const uint8_t*>(check.constData()), check.size()), uint32_t(0xE3069283));
+
+        QByteArray data(1000, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i * 7 + 3);
+        const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data.constData());
+
+        for (std::size_t size: {0, 1, 7, 8, 9, 17, 1000})
+            QCOMPARE(Net::crc32c(ptr, size), Net::crc32c_software(ptr, size));
+        QCOMPARE(Net::crc32c(ptr + 10, 990, Net::crc32c(ptr, 10)), Net::crc32c(ptr, 1000));
+    }
+
+    void protocol_body_checksum_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+        pair.a_->set_body_checksum(true);
+
+        const QByteArray data(100, 'c');
+        pair.a_->send(Net::Cmd::USER_COMMAND).writeRawData(data.constData(), data.size());
+        pair.a_->send(Net::Cmd::USER_COMMAND + 1).writeRawData(data.constData(), data.size());
+        QCOMPARE(pair.a_writer_->packets_.size(), std::size_t(2));
+        QVERIFY(pair.a_writer_->packets_.front().at(12) & Net::Packet_Header::BODY_CHECKSUM);
+
+        // Corrupt body drops only its packet, header checksum is still valid
+        QByteArray& corrupt = pair.a_writer_->packets_.front();
+        corrupt[Net::Packet_Header::EXTENDED_SIZE + 10] = 'x';
+        pair.deliver();
+        QCOMPARE(pair.b_->cmd_list_.back(), uint8_t(Net::Cmd::USER_COMMAND + 1));
+        QCOMPARE(pair.b_->data_list_, (std::vector<QByteArray>{data}));
+    }
+
+    void checksum_benchmark_data()
+    {
+        QTest::addColumn<bool>("is_crc32c");
+        QTest::newRow("qChecksum") << false;
+        QTest::newRow("crc32c") << true;
+    }
+
+    void checksum_benchmark()
+    {
+        QFETCH(bool, is_crc32c);
+        const QByteArray data(30 * 1024, 'b');
+
+        // Result is accumulated so the call isn't optimized out
+        uint32_t result = 0;
+        if (is_crc32c)
+        {
+            QBENCHMARK { result ^= Net::crc32c(reinterpret_cast<const uint8_t*>(data.constData()), data.size()); }
+        }
+        else
+        {
+            QBENCHMARK { result ^= qChecksum(data.constData(), data.size()); }
+        }
+        Q_UNUSED(result);
+    }
+
+    void protocol_fragment_window_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+
+        QByteArray data(100 * 1000, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i * 13 + i / 256);
+
+        std::unique_ptr<QIODevice> device(new QBuffer);
+        device->open(QIODevice::ReadWrite);
+        device->write(data);
+
+        const std::size_t query_count = pair.b_writer_->packet_count_;
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND);
+            msg.set_data_device(std::move(device), 1000);
+        }
+        pair.deliver();
+
+        QCOMPARE(pair.b_->data_list_, (std::vector<QByteArray>{data}));
+
+        // 100 fragments are requested by several parts in one query
+        QVERIFY(pair.b_writer_->packet_count_ - query_count < 50);
+    }
+
+    void protocol_fragment_requery_test_data()
+    {
+        QTest::addColumn<bool>("is_fec");
+        QTest::newRow("plain") << false;
+        QTest::newRow("fec") << true;
+    }
+
+    void protocol_fragment_requery_test()
+    {
+        QFETCH(bool, is_fec);
+        Loopback_Pair pair;
+        pair.negotiate();
+        pair.b_->set_fec(is_fec);
+        auto writer = std::make_shared<Deferred_Writer>();
+        writer->protocol_ = pair.a_;
+        pair.a_->set_writer(writer);
+        pair.a_writer_ = writer;
+
+        QByteArray data(100 * 1000, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i * 17 + i / 256);
+
+        std::unique_ptr<QIODevice> device(new QBuffer);
+        device->open(QIODevice::ReadWrite);
+        device->write(data);
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND);
+            msg.set_data_device(std::move(device), 1000);
+        }
+        writer->flush(writer->messages_.size());
+        writer->deliver_to(*pair.b_);
+
+        const std::vector<QByteArray> queries = pair.b_writer_->packets_;
+        QVERIFY(!queries.empty());
+        pair.b_writer_->deliver_to(*pair.a_);
+        QVERIFY(writer->messages_.size() > 2);
+
+        // Half of posted writes is sent, the rest is sent on other thread while same query comes again
+        writer->flush(writer->messages_.size() / 2);
+        std::vector<std::shared_ptr<Net::Message_Item>> pending;
+        pending.swap(writer->messages_);
+
+        std::vector<QByteArray> packets;
+        std::thread sender([&]()
+        {
+            for (std::shared_ptr<Net::Message_Item>& message: pending)
+                packets.push_back(pair.a_->prepare_packet_to_send(std::move(message)));
+        });
+        for (const QByteArray& query: queries)
+            pair.a_->process_bytes(reinterpret_cast<const uint8_t*>(query.constData()), query.size());
+        sender.join();
+
+        for (const QByteArray& packet: packets)
+            if (!packet.isEmpty())
+                writer->packets_.push_back(packet);
+        writer->flush(writer->messages_.size());
+        writer->is_deferred_ = false;
+        pair.deliver();
+
+        QCOMPARE(pair.b_->data_list_, (std::vector<QByteArray>{data}));
+        if (is_fec)
+            QVERIFY(pair.a_->stats().fec_parity_out_ > 0);
+    }
+
+    void protocol_stream_receive_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+        pair.b_->set_stream_receive(Net::Cmd::USER_COMMAND + 1);
+
+        QByteArray data(50 * 1000, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i * 7 + i / 256);
+
+        std::unique_ptr<QIODevice> device(new QBuffer);
+        device->open(QIODevice::ReadWrite);
+        device->write(data);
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND + 1);
+            msg.set_data_device(std::move(device), 1000);
+        }
+        pair.deliver();
+
+        QVERIFY(pair.b_->data_list_.empty());
+        QVERIFY(pair.b_->stream_call_count_ > 10);
+        QVERIFY(pair.b_->is_stream_finished_);
+        QCOMPARE(pair.b_->stream_data_, data);
+    }
+
+    void protocol_streams_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+        QVERIFY(pair.a_->is_streams_supported());
+        QVERIFY(pair.b_->is_streams_supported());
+
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND);
+            msg.set_stream(1);
+            msg << QString("lost");
+        }
+        pair.a_writer_->packets_.clear();
+
+        // Loss in stream 1 isn't visible in stream 2
+        for (int i = 0; i < 3; ++i)
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND);
+            msg.set_stream(2);
+            msg << i;
+        }
+        pair.deliver();
+        QCOMPARE(pair.b_->data_list_.size(), std::size_t(3));
+        QCOMPARE(pair.b_->stats().lost_msgs_, uint64_t(0));
+
+        {
+            auto msg = pair.a_->send(Net::Cmd::USER_COMMAND);
+            msg.set_stream(1);
+        }
+        pair.deliver();
+        QCOMPARE(pair.b_->stats().lost_msgs_, uint64_t(1));
+        QCOMPARE(Net::Protocol::stream_of(0x02000105), uint8_t(2));
+    }
+
+    void protocol_msg_id_wrap_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+        QVERIFY(pair.a_->is_streams_supported());
+
+        // Receiver follows jumps of sender, then sequence wraps over 8bit ids of version 1
+        const uint32_t last_id = (uint32_t(1) << HELPZ_PROTOCOL_STREAM_SHIFT) - 1;
+        for (uint32_t jump_id: {last_id / 2, last_id - 1})
+        {
+            Net::Protocol_Test_Access::set_next_ext_msg_id(*pair.a_, jump_id);
+            pair.a_->send(Net::Cmd::USER_COMMAND);
+            pair.deliver();
+        }
+        const uint64_t lost_msgs = pair.b_->stats().lost_msgs_;
+        pair.b_->msg_id_list_.clear();
+
+        for (int i = 0; i < 3; ++i)
+            pair.a_->send(Net::Cmd::USER_COMMAND);
+        pair.deliver();
+
+        QCOMPARE(pair.b_->msg_id_list_, (std::vector<uint32_t>{last_id, HELPZ_PROTOCOL_FIRST_EXTENDED_ID, HELPZ_PROTOCOL_FIRST_EXTENDED_ID + 1}));
+        QCOMPARE(pair.b_->stats().lost_msgs_, lost_msgs);
+    }
+
+    void emulator_test()
+    {
+        auto run = [](uint32_t seed, std::vector<QByteArray>& received)
+        {
+            Net::Emulator emulator(seed);
+            auto a = std::make_shared<Test_Protocol>();
+            auto b = std::make_shared<Test_Protocol>();
+
+            Net::Emulator::Link_Config config;
+            config.loss_ = 0.2;
+            config.duplicate_ = 0.1;
+            config.reorder_ = 0.1;
+            config.latency_ = std::chrono::milliseconds(20);
+            config.jitter_ = std::chrono::milliseconds(5);
+            auto links = emulator.connect(a, b, config, config);
+
+            for (int i = 0; i < 50; ++i)
+                a->send(Net::Cmd::USER_COMMAND).timeout(nullptr, std::chrono::minutes(5)) << i;
+            emulator.run_for(std::chrono::minutes(1));
+
+            received = b->data_list_;
+            return links.first->stats().dropped_;
+        };
+
+        std::vector<QByteArray> first, second;
+        const uint64_t dropped = run(7, first);
+        QVERIFY(dropped > 0);
+
+        // Each message is processed once in spite of losses and duplicates
+        QCOMPARE(first.size(), std::size_t(50));
+        std::vector<QByteArray> sorted = first;
+        std::sort(sorted.begin(), sorted.end());
+        QVERIFY(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+
+        QCOMPARE(run(7, second), dropped);
+        QCOMPARE(second, first);
+    }
+
+    void protocol_fec_test()
+    {
+        // One lost part of group is restored from parity
+        {
+            const QByteArray data = "0123456789abcdefghijABCDEFGHIJ";
+            const std::vector<QPair<uint32_t, uint32_t>> parts{{0, 10}, {10, 10}, {20, 10}};
+            QByteArray parity;
+            for (const QPair<uint32_t, uint32_t>& part: parts)
+                Net::fec_xor(parity, data.constData() + part.first, part.second);
+
+            Net::Fragmented_Message msg(1, 1, 10, data.size());
+            msg.data_device_->open(QIODevice::ReadWrite);
+            msg.add_data(0, data.constData(), 10);
+            QVERIFY(!msg.add_parity(parts, parity.constData(), parity.size()));
+            msg.add_data(20, data.constData() + 20, 10);
+            QVERIFY(msg.add_parity(parts, parity.constData(), parity.size()));
+            QVERIFY(msg.is_parts_empty());
+            msg.data_device_->seek(0);
+            QCOMPARE(msg.data_device_->readAll(), data);
+        }
+
+        QByteArray data(200 * 1000, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i * 11 + i / 256);
+
+        auto run = [&data](bool is_fec, Net::Protocol_Stats::Snapshot& sender_stats, Net::Protocol_Stats::Snapshot& receiver_stats)
+        {
+            Net::Emulator emulator(5);
+            auto a = std::make_shared<Test_Protocol>();
+            auto b = std::make_shared<Test_Protocol>();
+            b->set_fec(is_fec);
+
+            Net::Emulator::Link_Config config;
+            config.loss_ = 0.1;
+            config.latency_ = std::chrono::milliseconds(50);
+            auto links = emulator.connect(a, b, config, config);
+
+            a->send(Net::Cmd::USER_COMMAND).timeout(nullptr, std::chrono::minutes(1));
+            b->send(Net::Cmd::USER_COMMAND).timeout(nullptr, std::chrono::minutes(1));
+            emulator.run_for(std::chrono::seconds(30));
+            b->data_list_.clear();
+
+            std::unique_ptr<QIODevice> device(new QBuffer);
+            device->open(QIODevice::ReadWrite);
+            device->write(data);
+
+            const Net::Emulator::Time_Point start = emulator.now();
+            {
+                auto msg = a->send(Net::Cmd::USER_COMMAND + 1);
+                msg.set_data_device(std::move(device), 1000);
+            }
+            emulator.run_while([&b]() { return b->data_list_.empty(); }, std::chrono::minutes(30));
+
+            sender_stats = a->stats();
+            receiver_stats = b->stats();
+            return std::make_pair(emulator.now() - start, b->data_list_);
+        };
+
+        Net::Protocol_Stats::Snapshot plain_sender, plain_receiver, fec_sender, fec_receiver;
+        const auto plain = run(false, plain_sender, plain_receiver);
+        const auto fec = run(true, fec_sender, fec_receiver);
+
+        QCOMPARE(plain.second, (std::vector<QByteArray>{data}));
+        QCOMPARE(fec.second, (std::vector<QByteArray>{data}));
+        QCOMPARE(plain_sender.fec_parity_out_, uint64_t(0));
+        QVERIFY(fec_sender.fec_parity_out_ > 0);
+        QVERIFY(fec_receiver.fec_restored_ > 0);
+
+        qDebug() << "10% loss transfer ms without FEC:" << std::chrono::duration_cast<std::chrono::milliseconds>(plain.first).count()
+                 << "queries" << plain_receiver.fragment_queries_out_
+                 << "with FEC:" << std::chrono::duration_cast<std::chrono::milliseconds>(fec.first).count()
+                 << "queries" << fec_receiver.fragment_queries_out_ << "restored" << fec_receiver.fec_restored_;
+
+        // Restored parts aren't queried again. Seed is fixed, so runs are the same each time
+        QVERIFY(fec_receiver.fragment_queries_out_ < plain_receiver.fragment_queries_out_);
+        QVERIFY(fec.first < plain.first);
+    }
+
+    void protocol_send_window_test()
+    {
+        Loopback_Pair pair;
+        pair.negotiate();
+        QCOMPARE(pair.a_->version(), uint8_t(2));
+
+        pair.a_->set_window_size(2);
+
+        std::vector<bool> finally_list;
+        for (int i = 0; i < 4; ++i)
+            pair.a_->send(Net::Cmd::USER_COMMAND + i).timeout(nullptr, std::chrono::seconds(5)).finally([&finally_list](bool ok) { finally_list.push_back(ok); });
+
+        // Only two messages fit in window
+        QCOMPARE(pair.a_writer_->packets_.size(), std::size_t(2));
+        pair.deliver();
+        QCOMPARE(pair.b_->cmd_list_.size(), std::size_t(2));
+
+        // Acknowledge is sent by timer and opens window for the rest
+        void* ack_timer = reinterpret_cast<void*>(static_cast<intptr_t>(Net::Cmd::ACK));
+        QVERIFY(std::find(pair.b_writer_->timeouts_.begin(), pair.b_writer_->timeouts_.end(), ack_timer) != pair.b_writer_->timeouts_.end());
+        pair.b_->process_wait_list(ack_timer);
+        pair.deliver();
+        QCOMPARE(finally_list, (std::vector<bool>{true, true}));
+        QCOMPARE(pair.b_->cmd_list_.size(), std::size_t(4));
+
+        pair.b_->process_wait_list(ack_timer);
+        pair.deliver();
+        QCOMPARE(finally_list.size(), std::size_t(4));
+        QCOMPARE(pair.b_->cmd_list_, (std::vector<uint8_t>{Net::Cmd::USER_COMMAND, Net::Cmd::USER_COMMAND + 1,
+                                                            Net::Cmd::USER_COMMAND + 2, Net::Cmd::USER_COMMAND + 3}));
+    }
+
+    void protocol_message_pool_test()
+    {
+        auto protocol = std::make_shared<Test_Protocol>();
+        auto writer = std::make_shared<Drop_Writer>();
+        writer->protocol_ = protocol;
+        protocol->set_writer(writer);
+
+        const QByteArray data(100, 'a');
+        const std::size_t count = 1000;
+        for (std::size_t i = 0; i < count; ++i)
+            protocol->send(Net::Cmd::USER_COMMAND) << uint32_t(7) << data;
+
+        // Each message returns its buffer and block, so one of each is enough
+        QCOMPARE(writer->packet_count_, count);
+        QCOMPARE(protocol->message_pool()->cached_buffers(), std::size_t(1));
+        QCOMPARE(protocol->message_pool()->cached_blocks(), std::size_t(1));
+    }
+
+    void protocol_packet_buffer_test()
+    {
+        Test_Protocol sender, receiver;
+        const std::vector<QByteArray> data_list{QByteArray(100, 'a'), QByteArray(), QByteArray(2000, 'c')};
+
+        QByteArray buffer;
+        buffer.reserve(8192);
+        const char* reserved = buffer.constData();
+
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < data_list.size(); ++i)
+        {
+            std::unique_ptr<QIODevice> device(new QBuffer);
+            device->open(QIODevice::ReadWrite);
+            device->write(data_list.at(i));
+            size += sender.prepare_packet_to_send(std::make_shared<Net::Message_Item>(Net::Cmd::USER_COMMAND + i, std::nullopt, std::move(device)), buffer);
+        }
+
+        // Packets are appended in place, last one is compressed
+        QCOMPARE(static_cast<std::size_t>(buffer.size()), size);
+        QVERIFY(size < 2100 + 3 * Net::Packet_Header::SIZE);
+        QCOMPARE(buffer.constData(), reserved);
+
+        receiver.process_bytes(reinterpret_cast<const uint8_t*>(buffer.constData()), buffer.size());
+        QCOMPARE(receiver.cmd_list_, (std::vector<uint8_t>{Net::Cmd::USER_COMMAND, Net::Cmd::USER_COMMAND + 1, Net::Cmd::USER_COMMAND + 2}));
+        QCOMPARE(receiver.data_list_, data_list);
+    }
+
+    void fixed_codec_test()
+    {
+        static_assert(fixed_size_v<quint8, Net::Cmd::ReservedCommands, Fixed_Point, std::array<qint16, 2>, float> == 1 + 4 + 13 + 4 + 8);
+        static_assert(!Is_Fixed<QString>::value);
+
+        const Fixed_Point point{-3, 2.5, true};
+        QByteArray expected;
+        {
+            QDataStream ds(&expected, QIODevice::WriteOnly);
+            ds.setVersion(Net::Protocol::DATASTREAM_VERSION);
+            ds << quint8(7) << Net::Cmd::ACK << point << qint16(300) << qint16(-1) << 8.75f;
+        }
+
+        const QByteArray data = fixed_serialize(quint8(7), Net::Cmd::ACK, point, std::array<qint16, 2>{300, -1}, 8.75f);
+        QCOMPARE(data, expected);
+
+        QBuffer buffer(&expected);
+        buffer.open(QIODevice::ReadOnly);
+        Fixed_Handler handler;
+        QCOMPARE(apply_parse_fixed(buffer, &Fixed_Handler::handle, &handler, 1000), 7 + 4 - 3 + 2 + 1 + 300 - 1 + 8 + 1000);
+        QVERIFY(buffer.atEnd());
+
+        buffer.seek(1);
+        QVERIFY_EXCEPTION_THROWN(apply_parse_fixed(buffer, &Fixed_Handler::handle, &handler, 0), std::runtime_error);
+    }
+
+    void timing_wheel_test()
+    {
+        using Clock = Net::Timing_Wheel::Clock;
+        const Clock::time_point start = Clock::now();
+        Net::Timing_Wheel wheel(std::chrono::milliseconds(10), start);
+
+        const boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), 25590);
+        auto key = [&endpoint](intptr_t data) { return Net::Timing_Wheel::Key{endpoint, reinterpret_cast<void*>(data)}; };
+
+        wheel.add(key(1), start + std::chrono::milliseconds(25));
+        wheel.add(key(1), start + std::chrono::milliseconds(500)); // Earlier one is kept
+        wheel.add(key(2), start + std::chrono::seconds(100));       // Far level
+        wheel.add(key(3), start + std::chrono::milliseconds(40));
+        QCOMPARE(wheel.size(), std::size_t(3));
+        QVERIFY(wheel.cancel(key(3)));
+        QVERIFY(!wheel.cancel(key(3)));
+
+        std::vector<Net::Timing_Wheel::Key> expired;
+        wheel.advance(start + std::chrono::milliseconds(20), expired);
+        QVERIFY(expired.empty());
+
+        wheel.advance(start + std::chrono::milliseconds(30), expired);
+        QCOMPARE(expired.size(), std::size_t(1));
+        QVERIFY(expired.front() == key(1));
+
+        expired.clear();
+        wheel.advance(start + std::chrono::milliseconds(99990), expired);
+        QVERIFY(expired.empty());
+        wheel.advance(start + std::chrono::milliseconds(100010), expired);
+        QCOMPARE(expired.size(), std::size_t(1));
+        QVERIFY(expired.front() == key(2));
+        QVERIFY(wheel.empty());
+
+        // Timers of removed connection are cancelled together, others stay
+        const boost::asio::ip::udp::endpoint other(boost::asio::ip::make_address("127.0.0.2"), 25590);
+        wheel.add(key(1), start + std::chrono::seconds(101));
+        wheel.add(key(2), start + std::chrono::seconds(200));
+        wheel.add(Net::Timing_Wheel::Key{other, nullptr}, start + std::chrono::seconds(101));
+        QCOMPARE(wheel.cancel_all(endpoint), std::size_t(2));
+        QCOMPARE(wheel.cancel_all(endpoint), std::size_t(0));
+        QCOMPARE(wheel.size(), std::size_t(1));
+        wheel.advance(start + std::chrono::seconds(300), expired);
+        QCOMPARE(expired.size(), std::size_t(2));
+        QVERIFY(expired.back() == (Net::Timing_Wheel::Key{other, nullptr}));
+    }
+
+    void protocol_timer_io_context_test()
+    {
+        struct Emiter : Net::Protocol_Timer_Emiter
+        {
+            void on_protocol_timeout(boost::asio::ip::udp::endpoint endpoint, void* data) override
+            {
+                thread_ids_.push_back(std::this_thread::get_id());
+                if (data)
+                    timer_->add(std::chrono::system_clock::now() + std::chrono::milliseconds(15), endpoint, nullptr);
+            }
+
+            Net::Protocol_Timer* timer_ = nullptr;
+            std::vector<std::thread::id> thread_ids_;
+        } emiter;
+
+        boost::asio::io_context io_context;
+        Net::Protocol_Timer timer(&emiter, &io_context);
+        emiter.timer_ = &timer;
+
+        const boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), 25590);
+        timer.add(std::chrono::system_clock::now() + std::chrono::milliseconds(20), endpoint, &emiter);
+
+        // Timeouts are emitted on thread of io_context, which has no work when wheel is empty
+        io_context.run();
+        QCOMPARE(emiter.thread_ids_, (std::vector<std::thread::id>(2, std::this_thread::get_id())));
+        QCOMPARE(timer.size(), std::size_t(0));
+
+        io_context.restart();
+        timer.add(std::chrono::system_clock::now() + std::chrono::milliseconds(10), endpoint, nullptr);
+        io_context.run();
+        QCOMPARE(emiter.thread_ids_.size(), std::size_t(3));
+    }
+
+    void endpoint_hash_test()
+    {
+        // Clients with fixed local port still spread over shards
+        const std::size_t shard_count = 64;
+        std::vector<std::size_t> shard_sizes(shard_count, 0);
+        for (uint32_t i = 0; i < 10000; ++i)
+        {
+            const boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address_v4(0x0A000000 + i), 5555);
+            ++shard_sizes[Net::Timing_Wheel::endpoint_hash(endpoint) % shard_count];
+        }
+        QVERIFY(*std::min_element(shard_sizes.cbegin(), shard_sizes.cend()) > 10000 / shard_count / 2);
+        QVERIFY(*std::max_element(shard_sizes.cbegin(), shard_sizes.cend()) < 10000 / shard_count * 2);
+    }
+
+    void rtt_estimator_test()
+    {
+        using std::chrono::microseconds;
+        using std::chrono::milliseconds;
+
+        Net::Rtt_Estimator rtt;
+        QCOMPARE(rtt.rto(), milliseconds(HELPZ_PROTOCOL_INITIAL_RTO));
+
+        rtt.add_sample(milliseconds(100));
+        QCOMPARE(rtt.srtt(), microseconds(100000));
+        QCOMPARE(rtt.rttvar(), microseconds(50000));
+        QCOMPARE(rtt.rto(), milliseconds(300));
+
+        rtt.add_sample(milliseconds(200));
+        QCOMPARE(rtt.rttvar(), microseconds((3 * 50000 + 100000) / 4));
+        QCOMPARE(rtt.srtt(), microseconds((7 * 100000 + 200000) / 8));
+        QCOMPARE(rtt.rto(), milliseconds(363));
+
+        // Fast link is limited by min RTO
+        for (int i = 0; i < 50; ++i)
+            rtt.add_sample(microseconds(300));
+        QCOMPARE(rtt.rto(), milliseconds(HELPZ_PROTOCOL_MIN_RTO));
+
+        rtt.set_limits(milliseconds(20), milliseconds(1000));
+        rtt.add_sample(microseconds(300));
+        QVERIFY(rtt.rto() < milliseconds(HELPZ_PROTOCOL_MIN_RTO));
+        QVERIFY(rtt.rto() >= milliseconds(HELPZ_PROTOCOL_TIMER_TICK));
+
+        rtt.add_sample(std::chrono::seconds(10));
+        QCOMPARE(rtt.rto(), milliseconds(1000));
+    }
+
+    void protocol_rtt_test()
+    {
+        Loopback_Pair pair;
+        QCOMPARE(pair.a_->retransmission_timeout(), std::chrono::milliseconds(HELPZ_PROTOCOL_INITIAL_RTO));
+
+        bool is_answered = false;
+        pair.a_->send(Net::Cmd::PING).answer([&is_answered](QIODevice&) { is_answered = true; });
+        pair.deliver();
+
+        QVERIFY(is_answered);
+        QVERIFY(pair.a_->rtt() < std::chrono::milliseconds(HELPZ_PROTOCOL_MIN_RTO));
+        QCOMPARE(pair.a_->retransmission_timeout(), std::chrono::milliseconds(HELPZ_PROTOCOL_MIN_RTO));
+    }
+
+    void protocol_stats_test()
+    {
+        using std::chrono::milliseconds;
+        QCOMPARE(Net::Protocol_Stats::latency_bucket(std::chrono::microseconds(999)), std::size_t(0));
+        QCOMPARE(Net::Protocol_Stats::latency_bucket(milliseconds(1)), std::size_t(1));
+        QCOMPARE(Net::Protocol_Stats::latency_bucket(milliseconds(5)), std::size_t(3));
+        QCOMPARE(Net::Protocol_Stats::latency_bucket(std::chrono::hours(1)), std::size_t(Net::Protocol_Stats::LATENCY_BUCKETS - 1));
+
+        Loopback_Pair pair;
+        pair.a_->send(Net::Cmd::PING).answer([](QIODevice&) {});
+        QCOMPARE(pair.a_->stats().waiting_count_, std::size_t(1));
+        pair.deliver();
+
+        const Net::Protocol_Stats::Snapshot a = pair.a_->stats(), b = pair.b_->stats();
+        QVERIFY(a.packets_out_ > 0);
+        QCOMPARE(a.packets_out_, b.packets_in_);
+        QCOMPARE(a.bytes_out_, b.bytes_in_);
+        QCOMPARE(b.packets_out_, a.packets_in_);
+        QCOMPARE(a.retransmits_, uint64_t(0));
+        QCOMPARE(a.waiting_count_, std::size_t(0));
+        QCOMPARE(std::accumulate(a.answer_latency_.cbegin(), a.answer_latency_.cend(), uint64_t(0)), uint64_t(1));
+        QCOMPARE(a.compression_ratio(), 1.);
+
+        Net::Protocol_Stats::Snapshot total;
+        total += a;
+        total += b;
+        QCOMPARE(total.connection_count_, std::size_t(2));
+        QCOMPARE(total.packets_in_, a.packets_in_ + b.packets_in_);
+    }
+
+    void send_scheduler_test()
+    {
+        Net::Send_Scheduler scheduler({2, 1, 1});
+        auto make = [](uint8_t cmd, Net::Message_Priority priority)
+        {
+            auto msg = std::make_shared<Net::Message_Item>(cmd, std::nullopt, nullptr);
+            msg->set_priority(priority);
+            return msg;
+        };
+
+        QVERIFY(scheduler.push(make(1, Net::BULK_PRIORITY)));
+        QVERIFY(!scheduler.push(make(2, Net::BULK_PRIORITY)));
+        for (uint8_t cmd = 10; cmd < 15; ++cmd)
+            scheduler.push(make(cmd, Net::INTERACTIVE_PRIORITY));
+        QVERIFY(scheduler.has_pending_above(Net::BULK_PRIORITY));
+        QVERIFY(!scheduler.has_pending_above(Net::INTERACTIVE_PRIORITY));
+
+        std::vector<int> order;
+        while (std::shared_ptr<Net::Message_Item> msg = scheduler.pop())
+            order.push_back(msg->cmd());
+        QCOMPARE(order, (std::vector<int>{10, 11, 1, 12, 13, 2, 14}));
+        QVERIFY(scheduler.empty());
+
+        // Fragment is cut while interactive messages wait
+        auto protocol = std::make_shared<Test_Protocol>();
+        auto writer = std::make_shared<Drop_Writer>();
+        writer->protocol_ = protocol;
+        protocol->set_writer(writer);
+
+        auto msg = std::make_shared<Net::Message_Item>(Net::Cmd::USER_COMMAND, std::nullopt, std::unique_ptr<QIODevice>(new QBuffer));
+        msg->data_device_->open(QIODevice::ReadWrite);
+        msg->data_device_->write(QByteArray(20000, 'a'));
+        msg->data_device_->seek(0);
+        msg->set_fragment_size(8000);
+        msg->set_min_compress_size(100000);
+
+        QByteArray buffer;
+        const std::size_t size = protocol->prepare_packet_to_send(msg, buffer, HELPZ_PROTOCOL_BUSY_FRAGMENT_SIZE);
+        QVERIFY(size > HELPZ_PROTOCOL_BUSY_FRAGMENT_SIZE);
+        QVERIFY(size < HELPZ_PROTOCOL_BUSY_FRAGMENT_SIZE + 64);
     }
 };
 
@@ -0,0 +1,15 @@
+QT       += core
+QT       -= gui
+
+TARGET = bench_network
+CONFIG += c++1z console
+CONFIG += qt warn_on depend_includepath
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp
+
+INCLUDEPATH += $${OUT_PWD}/../../include
+
+LIBS += -L$${OUT_PWD}/../.. -lHelpzBase -lHelpzNetwork -lboost_thread
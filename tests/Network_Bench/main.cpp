@@ -0,0 +1,330 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <QBuffer>
+
+#include <Helpz/net_emulator.h>
+
+/**
+ * Protocol benchmark on Emulator: small messages, answers and one big fragmented transfer
+ * without and with FEC for each link profile. Usage: bench_network [seed]
+ * Before it allocations of send path are counted.
+ */
+
+static std::atomic<std::size_t> allocation_count{0};
+
+#ifdef __GLIBC__
+/* Every malloc of process is counted, including QByteArray data and operator new of Qt and libstdc++,
+ * because symbols of executable come before the ones of shared libraries.
+ */
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void* __libc_calloc(std::size_t count, std::size_t size);
+extern "C" void* __libc_realloc(void* ptr, std::size_t size);
+
+extern "C" void* malloc(std::size_t size)
+{
+    ++allocation_count;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(std::size_t count, std::size_t size)
+{
+    ++allocation_count;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, std::size_t size)
+{
+    ++allocation_count;
+    return __libc_realloc(ptr, size);
+}
+#define HELPZ_BENCH_ALLOCATION_COUNTED
+#endif
+
+namespace Helpz {
+namespace Net {
+
+enum Bench_Command
+{
+    SMALL_COMMAND = Cmd::USER_COMMAND,
+    ANSWER_COMMAND,
+    BIG_COMMAND
+};
+
+class Bench_Protocol : public Protocol
+{
+public:
+    std::vector<Time_Point> receive_times_;
+    Time_Point big_receive_time_;
+    std::size_t big_size_ = 0;
+private:
+    void process_message(uint32_t msg_id, uint8_t cmd, QIODevice& data_dev) override
+    {
+        if (cmd == SMALL_COMMAND)
+        {
+            uint32_t index;
+            parse_out(data_dev, index);
+            if (index >= receive_times_.size())
+                receive_times_.resize(index + 1);
+            if (receive_times_[index] == Time_Point{})
+                receive_times_[index] = current_time();
+        }
+        else if (cmd == ANSWER_COMMAND)
+        {
+            send_answer(cmd, msg_id) << QByteArray(64, 'a');
+        }
+        else if (cmd == BIG_COMMAND)
+        {
+            big_receive_time_ = current_time();
+            big_size_ = data_dev.size();
+        }
+    }
+    void process_answer_message(uint32_t /*msg_id*/, uint8_t /*cmd*/, QIODevice& /*data_dev*/) override {}
+};
+
+struct Profile
+{
+    const char* name_;
+    Emulator::Link_Config config_;
+};
+
+struct Result
+{
+    std::vector<double> latency_ms_;
+    double duration_s_ = 0;
+    std::size_t payload_ = 0;
+    std::size_t lost_ = 0;
+    uint64_t retransmits_ = 0, packets_ = 0;
+};
+
+double percentile(std::vector<double> values, double part)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    const std::size_t index = std::min(values.size() - 1, static_cast<std::size_t>(part * values.size()));
+    return values[index];
+}
+
+double to_seconds(Emulator::Duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(duration).count();
+}
+
+void print(const char* profile, const char* scenario, const Result& result)
+{
+    const double goodput = result.duration_s_ > 0 ? result.payload_ / result.duration_s_ / 1024. : 0;
+    std::printf("%-8s %-8s %10.1f %8.1f %8.1f %8.1f %8.1f %6zu %8llu %8llu\n", profile, scenario, goodput,
+                percentile(result.latency_ms_, 0.5), percentile(result.latency_ms_, 0.9), percentile(result.latency_ms_, 0.99),
+                percentile(result.latency_ms_, 1.), result.lost_,
+                static_cast<unsigned long long>(result.retransmits_), static_cast<unsigned long long>(result.packets_));
+}
+
+struct Bench_Pair
+{
+    Bench_Pair(const Emulator::Link_Config& config, uint32_t seed) :
+        emulator_(seed), a_(std::make_shared<Bench_Protocol>()), b_(std::make_shared<Bench_Protocol>())
+    {
+        links_ = emulator_.connect(a_, b_, config, config);
+
+        // Version 2 is chosen after both sides have sent something
+        a_->send(Cmd::PING).timeout(nullptr, std::chrono::seconds(30));
+        b_->send(Cmd::PING).timeout(nullptr, std::chrono::seconds(30));
+        emulator_.run_for(std::chrono::seconds(5));
+    }
+
+    void fill(Result& result)
+    {
+        result.retransmits_ = a_->stats().retransmits_ + b_->stats().retransmits_;
+        result.packets_ = links_.first->stats().packets_ + links_.second->stats().packets_;
+    }
+
+    Emulator emulator_;
+    std::shared_ptr<Bench_Protocol> a_, b_;
+    std::pair<std::shared_ptr<Emulator::Link>, std::shared_ptr<Emulator::Link>> links_;
+};
+
+Result bench_small(const Emulator::Link_Config& config, uint32_t seed)
+{
+    const uint32_t count = 2000;
+    const QByteArray payload(64, 's');
+
+    Bench_Pair pair(config, seed);
+    const Emulator::Time_Point start = pair.emulator_.now();
+    std::vector<Emulator::Time_Point> send_times(count);
+
+    // One message per millisecond
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        send_times[i] = start + std::chrono::milliseconds(i);
+        pair.emulator_.schedule(send_times[i], [&pair, i, &payload]()
+        {
+            pair.a_->send(SMALL_COMMAND).timeout(nullptr, std::chrono::seconds(60)) << i << payload;
+        });
+    }
+    pair.emulator_.run_for(std::chrono::seconds(120));
+
+    Result result;
+    Emulator::Time_Point end = start;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Protocol::Time_Point receive_time = i < pair.b_->receive_times_.size() ? pair.b_->receive_times_[i] : Protocol::Time_Point{};
+        if (receive_time == Protocol::Time_Point{})
+        {
+            ++result.lost_;
+            continue;
+        }
+        result.latency_ms_.push_back(to_seconds(receive_time - send_times[i]) * 1000.);
+        result.payload_ += payload.size();
+        end = std::max(end, receive_time);
+    }
+    result.duration_s_ = to_seconds(end - start);
+    pair.fill(result);
+    return result;
+}
+
+Result bench_answer(const Emulator::Link_Config& config, uint32_t seed)
+{
+    const uint32_t count = 1000;
+
+    Bench_Pair pair(config, seed);
+    const Emulator::Time_Point start = pair.emulator_.now();
+    Result result;
+    Emulator::Time_Point end = start;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Emulator::Time_Point send_time = start + std::chrono::milliseconds(2 * i);
+        pair.emulator_.schedule(send_time, [&pair, &result, &end, send_time]()
+        {
+            pair.a_->send(ANSWER_COMMAND).answer([&pair, &result, &end, send_time](QIODevice& data_dev)
+            {
+                end = pair.emulator_.now();
+                result.latency_ms_.push_back(to_seconds(end - send_time) * 1000.);
+                result.payload_ += data_dev.size();
+            }).timeout(nullptr, std::chrono::seconds(60));
+        });
+    }
+    pair.emulator_.run_for(std::chrono::seconds(120));
+
+    result.lost_ = count - result.latency_ms_.size();
+    result.duration_s_ = to_seconds(end - start);
+    pair.fill(result);
+    return result;
+}
+
+Result bench_big(const Emulator::Link_Config& config, uint32_t seed, bool is_fec)
+{
+    const int size = 4 * 1024 * 1024;
+
+    Bench_Pair pair(config, seed);
+    pair.b_->set_fec(is_fec);
+    const Emulator::Time_Point start = pair.emulator_.now();
+
+    std::unique_ptr<QIODevice> device(new QBuffer);
+    device->open(QIODevice::ReadWrite);
+    device->write(QByteArray(size, 'b'));
+    {
+        auto msg = pair.a_->send(BIG_COMMAND);
+        msg.set_data_device(std::move(device));
+    }
+    pair.emulator_.run_while([&pair]() { return pair.b_->big_size_ == 0; }, std::chrono::minutes(30));
+
+    Result result;
+    if (pair.b_->big_size_)
+    {
+        result.payload_ = pair.b_->big_size_;
+        result.duration_s_ = to_seconds(pair.b_->big_receive_time_ - start);
+        result.latency_ms_.push_back(result.duration_s_ * 1000.);
+    }
+    else
+        result.lost_ = 1;
+    pair.fill(result);
+    return result;
+}
+
+// Drops messages, so only send path is measured
+class Drop_Writer : public Protocol_Writer
+{
+public:
+    void write(const QByteArray& /*data*/) override {}
+    void write(std::shared_ptr<Message_Item> /*message*/) override {}
+    void add_timeout_at(std::chrono::system_clock::time_point, void* /*data*/) override {}
+    std::shared_ptr<Protocol> protocol() override { return protocol_.lock(); }
+
+    std::weak_ptr<Protocol> protocol_;
+};
+
+double bench_send_allocations()
+{
+    auto protocol = std::make_shared<Bench_Protocol>();
+    auto writer = std::make_shared<Drop_Writer>();
+    writer->protocol_ = protocol;
+    protocol->set_writer(writer);
+
+    const QByteArray payload(100, 's');
+    auto send = [&]() { protocol->send(SMALL_COMMAND) << uint32_t(7) << payload; };
+
+    // First messages fill the pool
+    for (int i = 0; i < 16; ++i)
+        send();
+
+    const std::size_t count = 100000;
+    const std::size_t begin = allocation_count;
+    for (std::size_t i = 0; i < count; ++i)
+        send();
+    return double(allocation_count - begin) / count;
+}
+
+} // namespace Net
+} // namespace Helpz
+
+int main(int argc, char *argv[])
+{
+    using namespace Helpz::Net;
+
+    const uint32_t seed = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1;
+
+    std::vector<Profile> profiles;
+    {
+        Emulator::Link_Config lan;
+        lan.latency_ = std::chrono::microseconds(500);
+        lan.bandwidth_ = 100 * 1000 * 1000 / 8;
+        profiles.push_back({"lan", lan});
+
+        Emulator::Link_Config wan;
+        wan.latency_ = std::chrono::milliseconds(40);
+        wan.jitter_ = std::chrono::milliseconds(10);
+        wan.bandwidth_ = 10 * 1000 * 1000 / 8;
+        wan.loss_ = 0.01;
+        profiles.push_back({"wan", wan});
+
+        Emulator::Link_Config lossy = wan;
+        lossy.loss_ = 0.05;
+        lossy.duplicate_ = 0.01;
+        lossy.reorder_ = 0.05;
+        profiles.push_back({"lossy", lossy});
+    }
+
+#ifdef HELPZ_BENCH_ALLOCATION_COUNTED
+    std::printf("send allocations per message %.3f\n", bench_send_allocations());
+#else
+    std::printf("send allocations per message aren't counted without glibc\n");
+#endif
+
+    std::printf("seed %u\n", seed);
+    std::printf("%-8s %-8s %10s %8s %8s %8s %8s %6s %8s %8s\n", "profile", "scenario", "KiB/s",
+                "p50 ms", "p90 ms", "p99 ms", "max ms", "lost", "resends", "packets");
+
+    for (const Profile& profile: profiles)
+    {
+        print(profile.name_, "small", bench_small(profile.config_, seed));
+        print(profile.name_, "answer", bench_answer(profile.config_, seed));
+        print(profile.name_, "big", bench_big(profile.config_, seed, false));
+        print(profile.name_, "big fec", bench_big(profile.config_, seed, true));
+    }
+    return 0;
+}